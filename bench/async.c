@@ -0,0 +1,124 @@
+/* uv_async_send() throughput with 1 to 64 producer threads.
+ *
+ * Every producer sends to the same handle in a loop for a fixed time while
+ * the loop thread runs the callbacks. Sends that find the handle pending
+ * already return without a write, so the callback count is the number of
+ * eventfd writes. It prints sends/s over all producers and sends per
+ * callback.
+ *
+ * Usage: bench_async [ms per run]
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+#define MAX_PRODUCERS 64
+
+static uv_loop_t loop;
+static uv_async_t handle;
+static uv_async_t quit_handle;
+static unsigned long long callbacks;
+static unsigned long long sends[MAX_PRODUCERS];
+static int running;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void async_cb(uv_async_t* h) {
+  callbacks++;
+}
+
+static void quit_cb(uv_async_t* h) {
+  uv_async_stop(&handle);
+  uv_async_stop(&quit_handle);
+}
+
+static void* loop_thread(void* arg) {
+  uv_run(&loop, UV_RUN_DEFAULT);
+  return NULL;
+}
+
+static void* producer(void* arg) {
+  unsigned long long n;
+
+  n = 0;
+  while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+    uv_async_send(&handle);
+    n++;
+  }
+
+  *(unsigned long long*) arg = n;
+  return NULL;
+}
+
+static void run(unsigned int nproducers, unsigned int ms) {
+  pthread_t threads[MAX_PRODUCERS];
+  pthread_t thread;
+  unsigned long long total;
+  uint64_t start;
+  uint64_t elapsed;
+  unsigned int i;
+
+  if (uv_loop_init(&loop) ||
+      uv_async_init(&loop, &handle, async_cb) ||
+      uv_async_init(&loop, &quit_handle, quit_cb)) {
+    abort();
+  }
+
+  callbacks = 0;
+  running = 1;
+
+  if (pthread_create(&thread, NULL, loop_thread, NULL)) {
+    abort();
+  }
+
+  start = now_ns();
+  for (i = 0; i < nproducers; i++) {
+    if (pthread_create(&threads[i], NULL, producer, &sends[i])) {
+      abort();
+    }
+  }
+
+  usleep(ms * 1000);
+  __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+
+  total = 0;
+  for (i = 0; i < nproducers; i++) {
+    pthread_join(threads[i], NULL);
+    total += sends[i];
+  }
+  elapsed = now_ns() - start;
+
+  uv_async_send(&quit_handle);
+  pthread_join(thread, NULL);
+
+  printf("%2u producers: %.1fM sends/s, %llu callbacks, %.0f sends/callback\n",
+         nproducers,
+         total / (elapsed / 1e9) / 1e6,
+         callbacks,
+         callbacks ? (double) total / callbacks : 0.0);
+}
+
+int main(int argc, char** argv) {
+  unsigned int ms;
+  unsigned int n;
+
+  ms = argc > 1 ? (unsigned int) atoi(argv[1]) : 500;
+  if (ms == 0) {
+    return 1;
+  }
+
+  for (n = 1; n <= MAX_PRODUCERS; n *= 2) {
+    run(n, ms);
+  }
+
+  return 0;
+}
@@ -0,0 +1,335 @@
+/* Compares the epoll and io_uring (UV_USE_IO_URING=1) loop backends.
+ *
+ *   wakeup   another thread writes an eventfd watched with uv_poll_t, or
+ *            raises SIGUSR1 on a uv_signal_t, and waits for the callback;
+ *            p50/p99 latency from the write or kill() to the callback
+ *   churn    1000 eventfds are watched, every iteration flips UV_WRITABLE
+ *            on 100 of them and makes one readable
+ *
+ * Each prints syscalls per loop iteration. They are counted by wrapping
+ * epoll_wait(), epoll_ctl(), read(), write() and syscall() in this binary,
+ * only while the loop runs and not for the callbacks' own reads.
+ *
+ * Usage: bench_backend [iterations]
+ */
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+#define NCHURN 1000
+
+static __thread int counting;
+static unsigned long long syscalls;
+
+static unsigned int iterations;
+static uint64_t* latencies;
+static uint64_t sent_at;
+static unsigned int received;
+static pthread_t loop_thread;
+static int wakeup_fd;
+
+int epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout) {
+  static int (*real)(int, struct epoll_event*, int, int);
+
+  if (real == NULL) {
+    real = (int (*)(int, struct epoll_event*, int, int)) dlsym(RTLD_NEXT, "epoll_wait");
+  }
+
+  syscalls += counting;
+  return real(epfd, events, maxevents, timeout);
+}
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+  static int (*real)(int, int, int, struct epoll_event*);
+
+  if (real == NULL) {
+    real = (int (*)(int, int, int, struct epoll_event*)) dlsym(RTLD_NEXT, "epoll_ctl");
+  }
+
+  syscalls += counting;
+  return real(epfd, op, fd, event);
+}
+
+ssize_t read(int fd, void* buf, size_t count) {
+  static ssize_t (*real)(int, void*, size_t);
+
+  if (real == NULL) {
+    real = (ssize_t (*)(int, void*, size_t)) dlsym(RTLD_NEXT, "read");
+  }
+
+  syscalls += counting;
+  return real(fd, buf, count);
+}
+
+ssize_t write(int fd, const void* buf, size_t count) {
+  static ssize_t (*real)(int, const void*, size_t);
+
+  if (real == NULL) {
+    real = (ssize_t (*)(int, const void*, size_t)) dlsym(RTLD_NEXT, "write");
+  }
+
+  syscalls += counting;
+  return real(fd, buf, count);
+}
+
+long syscall(long number, ...) {
+  static long (*real)(long, ...);
+  long a[6];
+  va_list ap;
+  int i;
+
+  if (real == NULL) {
+    real = (long (*)(long, ...)) dlsym(RTLD_NEXT, "syscall");
+  }
+
+  va_start(ap, number);
+  for (i = 0; i < 6; i++) {
+    a[i] = va_arg(ap, long);
+  }
+  va_end(ap);
+
+  syscalls += counting;
+  return real(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+
+  return (x > y) - (x < y);
+}
+
+static void record(void) {
+  latencies[received] = now_ns() - __atomic_load_n(&sent_at, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&received, received + 1, __ATOMIC_RELEASE);
+}
+
+static void wakeup_poll_cb(uv_poll_t* handle, int status, int events) {
+  uint64_t value;
+
+  counting = 0;
+  if (read(wakeup_fd, &value, sizeof(value)) != sizeof(value)) {
+    abort();
+  }
+  counting = 1;
+
+  record();
+  if (received == iterations) {
+    uv_poll_stop(handle);
+  }
+}
+
+static void wakeup_signal_cb(uv_signal_t* handle, int signum) {
+  record();
+  if (received == iterations) {
+    uv_signal_stop(handle);
+  }
+}
+
+static void* sender(void* arg) {
+  uint64_t one;
+  unsigned int i;
+  int use_signal;
+
+  use_signal = *(int*) arg;
+  one = 1;
+
+  for (i = 0; i < iterations; i++) {
+    __atomic_store_n(&sent_at, now_ns(), __ATOMIC_RELEASE);
+
+    if (use_signal) {
+      pthread_kill(loop_thread, SIGUSR1);
+    } else if (write(wakeup_fd, &one, sizeof(one)) != sizeof(one)) {
+      abort();
+    }
+
+    while (__atomic_load_n(&received, __ATOMIC_ACQUIRE) == i) {
+      sched_yield();
+    }
+  }
+
+  return NULL;
+}
+
+static const char* backend_name(const uv_loop_t* loop) {
+  return loop->iou != NULL ? "io_uring" : "epoll";
+}
+
+static void run_wakeup(int use_signal) {
+  uv_signal_t signal_handle;
+  uv_poll_t poll_handle;
+  uv_loop_t loop;
+  pthread_t thread;
+  unsigned long long loops;
+
+  if (uv_loop_init(&loop)) {
+    abort();
+  }
+
+  received = 0;
+  loop_thread = pthread_self();
+
+  if (use_signal) {
+    uv_signal_init(&loop, &signal_handle);
+    uv_signal_start(&signal_handle, wakeup_signal_cb, SIGUSR1);
+  } else {
+    wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeup_fd == -1 ||
+        uv_poll_init(&loop, &poll_handle, wakeup_fd) ||
+        uv_poll_start(&poll_handle, UV_READABLE, wakeup_poll_cb)) {
+      abort();
+    }
+  }
+
+  /* Get the watchers registered before timing anything. */
+  uv_run(&loop, UV_RUN_NOWAIT);
+
+  if (pthread_create(&thread, NULL, sender, &use_signal)) {
+    abort();
+  }
+
+  syscalls = 0;
+  loops = 0;
+  counting = 1;
+  while (uv_run(&loop, UV_RUN_ONCE)) {
+    loops++;
+  }
+  loops++;
+  counting = 0;
+
+  pthread_join(thread, NULL);
+
+  if (!use_signal) {
+    close(wakeup_fd);
+  }
+
+  qsort(latencies, iterations, sizeof(latencies[0]), compare_u64);
+
+  printf("%-8s wakeup %-6s %.2f syscalls/iteration, latency p50 %llu ns p99 %llu ns\n",
+         backend_name(&loop),
+         use_signal ? "signal" : "poll",
+         (double) syscalls / loops,
+         (unsigned long long) latencies[iterations / 2],
+         (unsigned long long) latencies[(uint64_t) iterations * 99 / 100]);
+}
+
+static void churn_cb(uv_poll_t* handle, int status, int events) {
+  uint64_t value;
+
+  if (events & UV_READABLE) {
+    counting = 0;
+    if (read(handle->io_watcher.fd, &value, sizeof(value)) != sizeof(value)) {
+      abort();
+    }
+    counting = 1;
+  }
+}
+
+static void run_churn(void) {
+  uv_poll_t handles[NCHURN];
+  int fds[NCHURN];
+  uv_loop_t loop;
+  uint64_t one;
+  uint64_t start;
+  uint64_t elapsed;
+  unsigned int i;
+  unsigned int j;
+  int events;
+
+  if (uv_loop_init(&loop)) {
+    abort();
+  }
+
+  for (i = 0; i < NCHURN; i++) {
+    fds[i] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fds[i] == -1 ||
+        uv_poll_init(&loop, &handles[i], fds[i]) ||
+        uv_poll_start(&handles[i], UV_READABLE, churn_cb)) {
+      abort();
+    }
+  }
+
+  uv_run(&loop, UV_RUN_NOWAIT);
+
+  one = 1;
+  syscalls = 0;
+  start = now_ns();
+
+  for (i = 0; i < iterations; i++) {
+    /* An eventfd is always writable, so only flip it off again after one
+     * iteration; what's timed is the interest update.
+     */
+    for (j = 0; j < 100; j++) {
+      events = UV_READABLE;
+      if ((i + j) % 2 == 0) {
+        events |= UV_WRITABLE;
+      }
+      uv_poll_start(&handles[(i * 100 + j) % NCHURN], UV_READABLE, churn_cb);
+      uv_poll_start(&handles[(i * 100 + j) % NCHURN], events, churn_cb);
+    }
+
+    if (write(fds[i % NCHURN], &one, sizeof(one)) != sizeof(one)) {
+      abort();
+    }
+
+    counting = 1;
+    uv_run(&loop, UV_RUN_NOWAIT);
+    counting = 0;
+  }
+
+  elapsed = now_ns() - start;
+
+  for (i = 0; i < NCHURN; i++) {
+    uv_poll_stop(&handles[i]);
+    close(fds[i]);
+  }
+
+  printf("%-8s churn         %.2f syscalls/iteration, %.1f us/iteration\n",
+         backend_name(&loop),
+         (double) syscalls / iterations,
+         elapsed / 1e3 / iterations);
+}
+
+static void run_all(void) {
+  run_wakeup(0);
+  run_wakeup(1);
+  run_churn();
+}
+
+int main(int argc, char** argv) {
+  iterations = argc > 1 ? (unsigned int) atoi(argv[1]) : 20000;
+  if (iterations == 0) {
+    return 1;
+  }
+
+  latencies = malloc(iterations * sizeof(latencies[0]));
+  if (latencies == NULL) {
+    return 1;
+  }
+
+  unsetenv("UV_USE_IO_URING");
+  run_all();
+
+  setenv("UV_USE_IO_URING", "1", 1);
+  run_all();
+
+  free(latencies);
+  return 0;
+}
@@ -0,0 +1,220 @@
+/* Thundering herd: N loops, one thread each, watch the same eventfd.
+ *
+ * Another thread makes the eventfd readable and waits until one of the
+ * loops has read it back, N loops racing for the same work like acceptors
+ * on a shared listening socket. The callbacks that find it drained already
+ * are wasted wakeups.
+ *
+ *   level      plain uv_poll_t, every loop is woken up
+ *   exclusive  UV_EXCLUSIVE, epoll wakes one of them
+ *   edge       UV_EXCLUSIVE | UV_EDGE_TRIGGERED
+ *
+ * It prints callbacks and context switches of the loop threads per event and
+ * the p50/p99 latency from the write to the read, on epoll and io_uring. It
+ * fails if an exclusive watcher gets more than one callback per event, each
+ * event must wake exactly one of them.
+ *
+ * Usage: bench_herd [loops] [events]
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+#define MAX_LOOPS 64
+
+struct herd_loop {
+  uv_loop_t loop;
+  uv_poll_t handle;
+  uv_poll_t quit_handle;
+  int quit_fd;
+  pthread_t thread;
+  long switches;
+};
+
+static struct herd_loop loops[MAX_LOOPS];
+static unsigned int nloops;
+static unsigned int nevents;
+static uint64_t* latencies;
+static uint64_t sent_at;
+static unsigned int received;
+static unsigned long long callbacks;
+static int shared_fd;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+
+  return (x > y) - (x < y);
+}
+
+static void poll_cb(uv_poll_t* handle, int status, int events) {
+  uint64_t value;
+  unsigned int n;
+
+  __atomic_fetch_add(&callbacks, 1, __ATOMIC_RELAXED);
+
+  if (read(shared_fd, &value, sizeof(value)) != sizeof(value)) {
+    return;  /* Another loop got it. */
+  }
+
+  n = __atomic_load_n(&received, __ATOMIC_ACQUIRE);
+  latencies[n] = now_ns() - __atomic_load_n(&sent_at, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&received, n + 1, __ATOMIC_RELEASE);
+}
+
+static void quit_cb(uv_poll_t* handle, int status, int events) {
+  struct herd_loop* l;
+
+  l = (struct herd_loop*) ((char*) handle - offsetof(struct herd_loop, quit_handle));
+  uv_poll_stop(&l->quit_handle);
+  uv_poll_stop(&l->handle);
+}
+
+static void* loop_thread(void* arg) {
+  struct herd_loop* l;
+  struct rusage before;
+  struct rusage after;
+
+  l = arg;
+  getrusage(RUSAGE_THREAD, &before);
+  uv_run(&l->loop, UV_RUN_DEFAULT);
+  getrusage(RUSAGE_THREAD, &after);
+
+  l->switches = (after.ru_nvcsw - before.ru_nvcsw) +
+                (after.ru_nivcsw - before.ru_nivcsw);
+  return NULL;
+}
+
+static int run(const char* name, int mode) {
+  struct herd_loop* l;
+  const char* backend;
+  uint64_t one;
+  long switches;
+  unsigned int i;
+
+  shared_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (shared_fd == -1) {
+    abort();
+  }
+
+  for (i = 0; i < nloops; i++) {
+    l = &loops[i];
+    l->quit_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (l->quit_fd == -1 ||
+        uv_loop_init(&l->loop) ||
+        uv_poll_init(&l->loop, &l->handle, shared_fd) ||
+        uv_poll_start(&l->handle, UV_READABLE | mode, poll_cb) ||
+        uv_poll_init(&l->loop, &l->quit_handle, l->quit_fd) ||
+        uv_poll_start(&l->quit_handle, UV_READABLE, quit_cb)) {
+      abort();
+    }
+  }
+
+  backend = loops[0].loop.iou != NULL ? "io_uring" : "epoll";
+  callbacks = 0;
+  received = 0;
+
+  for (i = 0; i < nloops; i++) {
+    if (pthread_create(&loops[i].thread, NULL, loop_thread, &loops[i])) {
+      abort();
+    }
+  }
+
+  /* Let every loop block in the kernel before the first event. */
+  usleep(100000);
+
+  one = 1;
+  for (i = 0; i < nevents; i++) {
+    __atomic_store_n(&sent_at, now_ns(), __ATOMIC_RELEASE);
+    if (write(shared_fd, &one, sizeof(one)) != sizeof(one)) {
+      abort();
+    }
+
+    while (__atomic_load_n(&received, __ATOMIC_ACQUIRE) == i) {
+      sched_yield();
+    }
+  }
+
+  /* Give the losers of the last event time to run their callbacks. */
+  usleep(10000);
+
+  switches = 0;
+  for (i = 0; i < nloops; i++) {
+    if (write(loops[i].quit_fd, &one, sizeof(one)) != sizeof(one)) {
+      abort();
+    }
+    pthread_join(loops[i].thread, NULL);
+    close(loops[i].quit_fd);
+    switches += loops[i].switches;
+  }
+
+  close(shared_fd);
+
+  qsort(latencies, nevents, sizeof(latencies[0]), compare_u64);
+
+  printf("%-8s %-9s %2u loops: %.2f callbacks/event, %.2f switches/event, "
+         "latency p50 %llu ns p99 %llu ns\n",
+         backend,
+         name,
+         nloops,
+         (double) callbacks / nevents,
+         (double) switches / nevents,
+         (unsigned long long) latencies[nevents / 2],
+         (unsigned long long) latencies[(uint64_t) nevents * 99 / 100]);
+
+  if ((mode & UV_EXCLUSIVE) && callbacks != nevents) {
+    fprintf(stderr, "%s %s: %llu callbacks for %u events\n",
+            backend, name, callbacks, nevents);
+    return 1;
+  }
+
+  return 0;
+}
+
+static int run_all(void) {
+  int err;
+
+  err = run("level", 0);
+  err |= run("exclusive", UV_EXCLUSIVE);
+  err |= run("edge", UV_EXCLUSIVE | UV_EDGE_TRIGGERED);
+  return err;
+}
+
+int main(int argc, char** argv) {
+  int err;
+
+  nloops = argc > 1 ? (unsigned int) atoi(argv[1]) : 8;
+  nevents = argc > 2 ? (unsigned int) atoi(argv[2]) : 20000;
+  if (nloops == 0 || nloops > MAX_LOOPS || nevents == 0) {
+    return 1;
+  }
+
+  latencies = malloc(nevents * sizeof(latencies[0]));
+  if (latencies == NULL) {
+    return 1;
+  }
+
+  unsetenv("UV_USE_IO_URING");
+  err = run_all();
+
+  setenv("UV_USE_IO_URING", "1", 1);
+  err |= run_all();
+
+  free(latencies);
+  return err;
+}
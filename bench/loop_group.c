@@ -0,0 +1,114 @@
+/* Message passing between the loops of a uv_loop_group_t.
+ *
+ *   ping-pong  loops 0 and 1 send one message back and forth; round trips/s
+ *              and the mean round trip time
+ *   fan-out    the main thread sends every message to all loops but 0;
+ *              messages delivered/s and how often a mailbox was full
+ *
+ * Usage: bench_loop_group [loops] [messages]
+ */
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+enum { PING_PONG, FAN_OUT };
+
+static int mode;
+static unsigned long rounds;
+static unsigned long total;
+static unsigned long delivered;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void msg_cb(uv_loop_group_t* group, unsigned int index, void* msg) {
+  if (mode == FAN_OUT) {
+    __atomic_fetch_add(&delivered, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  if (index == 0) {
+    if (++rounds == total) {
+      __atomic_store_n(&delivered, rounds, __ATOMIC_RELEASE);
+      return;
+    }
+  }
+
+  if (uv_loop_group_send(group, !index, msg)) {
+    abort();
+  }
+}
+
+static void wait_for(unsigned long n) {
+  while (__atomic_load_n(&delivered, __ATOMIC_ACQUIRE) < n) {
+    usleep(1000);
+  }
+}
+
+int main(int argc, char** argv) {
+  uv_loop_group_t group;
+  unsigned long eagain;
+  unsigned long i;
+  unsigned int nloops;
+  unsigned int j;
+  uint64_t start;
+  double elapsed;
+
+  nloops = argc > 1 ? (unsigned int) atoi(argv[1]) : 4;
+  total = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+  if (nloops < 2 || total == 0) {
+    return 1;
+  }
+
+  if (uv_loop_group_init(&group, nloops, 0, msg_cb) ||
+      uv_loop_group_start(&group, NULL)) {
+    abort();
+  }
+
+  mode = PING_PONG;
+  start = now_ns();
+  if (uv_loop_group_send(&group, 1, NULL)) {
+    abort();
+  }
+  wait_for(total);
+  elapsed = (now_ns() - start) / 1e9;
+
+  printf("ping-pong  %lu round trips: %.0f round trips/s, %.0f ns each\n",
+         total,
+         total / elapsed,
+         elapsed * 1e9 / total);
+
+  mode = FAN_OUT;
+  delivered = 0;
+  eagain = 0;
+  start = now_ns();
+  for (i = 0; i < total; i++) {
+    for (j = 1; j < nloops; j++) {
+      while (uv_loop_group_send(&group, j, NULL) == EAGAIN) {
+        eagain++;
+        sched_yield();
+      }
+    }
+  }
+  wait_for(total * (nloops - 1));
+  elapsed = (now_ns() - start) / 1e9;
+
+  printf("fan-out    %lu messages to %u loops: %.0f messages/s, %lu full\n",
+         total,
+         nloops - 1,
+         total * (nloops - 1) / elapsed,
+         eagain);
+
+  uv_loop_group_stop(&group);
+  uv_loop_group_close(&group);
+  return 0;
+}
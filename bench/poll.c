@@ -0,0 +1,193 @@
+/* Readiness dispatch through uv_poll_t with 10k watched fds.
+ *
+ * Every fd is an eventfd so the bench only needs one descriptor per watcher.
+ * Each round makes {active} of them readable and runs the loop until all of
+ * their callbacks have read them back, with 1, 100, 1000 and all 10k fds
+ * ready per round. It reports callbacks/s and the mean time per round.
+ *
+ * It then checks on epoll and io_uring that a UV_EDGE_TRIGGERED watcher whose
+ * callback leaves the data unread isn't called again until more is written,
+ * and fails if it is.
+ *
+ * Usage: bench_poll [rounds]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+#define NFDS 10000
+
+static uv_poll_t handles[NFDS];
+static int fds[NFDS];
+static unsigned int pending;
+static unsigned long long callbacks;
+static unsigned int edge_callbacks;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void poll_cb(uv_poll_t* handle, int status, int events) {
+  uint64_t value;
+
+  if (status != 0 || !(events & UV_READABLE)) {
+    abort();
+  }
+
+  if (read(fds[handle - handles], &value, sizeof(value)) != sizeof(value)) {
+    abort();
+  }
+
+  callbacks++;
+  pending--;
+}
+
+static void edge_cb(uv_poll_t* handle, int status, int events) {
+  if (status != 0 || !(events & UV_READABLE)) {
+    abort();
+  }
+
+  edge_callbacks++;  /* Leaves the data unread. */
+}
+
+static int check_edge(void) {
+  uv_loop_t loop;
+  uv_poll_t handle;
+  uint64_t one;
+  int fd;
+  int i;
+
+  fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (fd == -1 ||
+      uv_loop_init(&loop) ||
+      uv_poll_init(&loop, &handle, fd) ||
+      uv_poll_start(&handle, UV_READABLE | UV_EDGE_TRIGGERED, edge_cb)) {
+    abort();
+  }
+
+  edge_callbacks = 0;
+  one = 1;
+
+  for (i = 1; i <= 3; i++) {
+    if (write(fd, &one, sizeof(one)) != sizeof(one)) {
+      abort();
+    }
+
+    while (edge_callbacks < (unsigned int) i) {
+      uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    /* Still readable, but nothing new arrived. */
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_run(&loop, UV_RUN_NOWAIT);
+    if (edge_callbacks != (unsigned int) i) {
+      break;
+    }
+  }
+
+  printf("edge-triggered on %s: %u callbacks for 3 writes\n",
+         loop.iou != NULL ? "io_uring" : "epoll",
+         edge_callbacks);
+
+  uv_poll_stop(&handle);
+  close(fd);
+
+  return edge_callbacks != 3;
+}
+
+static void run(uv_loop_t* loop, unsigned int active, unsigned int rounds) {
+  uint64_t one;
+  uint64_t start;
+  uint64_t elapsed;
+  unsigned int stride;
+  unsigned int r;
+  unsigned int i;
+
+  one = 1;
+  stride = NFDS / active;
+  callbacks = 0;
+  start = now_ns();
+
+  for (r = 0; r < rounds; r++) {
+    /* Spread the ready fds over the whole table. */
+    for (i = 0; i < active; i++) {
+      if (write(fds[(i * stride + r) % NFDS], &one, sizeof(one)) != sizeof(one)) {
+        abort();
+      }
+    }
+
+    pending = active;
+    while (pending > 0) {
+      uv_run(loop, UV_RUN_ONCE);
+    }
+  }
+
+  elapsed = now_ns() - start;
+
+  printf("%5u of %u fds ready: %.0f callbacks/s, %.1f us/round\n",
+         active,
+         NFDS,
+         callbacks / (elapsed / 1e9),
+         elapsed / 1e3 / rounds);
+}
+
+int main(int argc, char** argv) {
+  struct rlimit limit;
+  uv_loop_t loop;
+  unsigned int rounds;
+  unsigned int i;
+  int err;
+
+  rounds = argc > 1 ? (unsigned int) atoi(argv[1]) : 1000;
+  if (rounds == 0) {
+    return 1;
+  }
+
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < NFDS + 64) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  if (uv_loop_init(&loop)) {
+    abort();
+  }
+
+  for (i = 0; i < NFDS; i++) {
+    fds[i] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fds[i] == -1) {
+      fprintf(stderr, "eventfd: too many open files? (need %d)\n", NFDS);
+      return 1;
+    }
+
+    if (uv_poll_init(&loop, &handles[i], fds[i]) ||
+        uv_poll_start(&handles[i], UV_READABLE, poll_cb)) {
+      abort();
+    }
+  }
+
+  run(&loop, 1, rounds * 10);
+  run(&loop, 100, rounds);
+  run(&loop, 1000, rounds);
+  run(&loop, NFDS, rounds / 10 + 1);
+
+  for (i = 0; i < NFDS; i++) {
+    uv_poll_stop(&handles[i]);
+    close(fds[i]);
+  }
+
+  unsetenv("UV_USE_IO_URING");
+  err = check_edge();
+
+  setenv("UV_USE_IO_URING", "1", 1);
+  err |= check_edge();
+
+  return err;
+}
@@ -0,0 +1,134 @@
+/* epoll_ctl() calls caused by uv_poll_t interest changes.
+ *
+ * 1000 eventfds are watched for UV_READABLE. Every iteration changes 100 of
+ * them, then runs the loop once with UV_RUN_NOWAIT:
+ *
+ *   toggle   UV_WRITABLE on and back off, a write burst that completes
+ *            within the iteration; nothing is left to tell the kernel
+ *   flip     UV_WRITABLE on in one iteration and off in the next
+ *   restart  uv_poll_stop() and uv_poll_start() again, the fd has to leave
+ *            the epoll set on stop because it may be closed right after
+ *
+ * It prints interest changes (uv_poll_start/stop calls) and epoll_ctl()
+ * calls per iteration; epoll_ctl() is counted by wrapping it in this binary.
+ *
+ * Usage: bench_poll_churn [iterations]
+ */
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+#define NFDS 1000
+#define NCHANGED 100
+
+static uv_poll_t handles[NFDS];
+static int fds[NFDS];
+static unsigned long long ctl_calls;
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+  static int (*real)(int, int, int, struct epoll_event*);
+
+  if (real == NULL) {
+    real = (int (*)(int, int, int, struct epoll_event*)) dlsym(RTLD_NEXT, "epoll_ctl");
+  }
+
+  ctl_calls++;
+  return real(epfd, op, fd, event);
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void poll_cb(uv_poll_t* handle, int status, int events) {
+}
+
+static void run(uv_loop_t* loop, const char* name, unsigned int iterations) {
+  unsigned long long changes;
+  uv_poll_t* handle;
+  uint64_t start;
+  uint64_t elapsed;
+  unsigned int i;
+  unsigned int j;
+
+  changes = 0;
+  ctl_calls = 0;
+  start = now_ns();
+
+  for (i = 0; i < iterations; i++) {
+    for (j = 0; j < NCHANGED; j++) {
+      handle = &handles[(i * NCHANGED + j) % NFDS];
+
+      if (name[0] == 't') {
+        uv_poll_start(handle, UV_READABLE | UV_WRITABLE, poll_cb);
+        uv_poll_start(handle, UV_READABLE, poll_cb);
+        changes += 2;
+      } else if (name[0] == 'f') {
+        handle = &handles[j];
+        uv_poll_start(handle, i % 2 ? UV_READABLE : UV_READABLE | UV_WRITABLE, poll_cb);
+        changes += 1;
+      } else {
+        uv_poll_stop(handle);
+        uv_poll_start(handle, UV_READABLE, poll_cb);
+        changes += 2;
+      }
+    }
+
+    uv_run(loop, UV_RUN_NOWAIT);
+  }
+
+  elapsed = now_ns() - start;
+
+  printf("%-8s %.1f changes/iteration, %.2f epoll_ctl/iteration, %.1f us/iteration\n",
+         name,
+         (double) changes / iterations,
+         (double) ctl_calls / iterations,
+         elapsed / 1e3 / iterations);
+}
+
+int main(int argc, char** argv) {
+  unsigned int iterations;
+  uv_loop_t loop;
+  unsigned int i;
+
+  iterations = argc > 1 ? (unsigned int) atoi(argv[1]) : 10000;
+  if (iterations == 0) {
+    return 1;
+  }
+
+  unsetenv("UV_USE_IO_URING");
+  if (uv_loop_init(&loop)) {
+    abort();
+  }
+
+  for (i = 0; i < NFDS; i++) {
+    fds[i] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fds[i] == -1 ||
+        uv_poll_init(&loop, &handles[i], fds[i]) ||
+        uv_poll_start(&handles[i], UV_READABLE, poll_cb)) {
+      abort();
+    }
+  }
+
+  uv_run(&loop, UV_RUN_NOWAIT);
+
+  run(&loop, "toggle", iterations);
+  run(&loop, "flip", iterations);
+  run(&loop, "restart", iterations);
+
+  for (i = 0; i < NFDS; i++) {
+    uv_poll_stop(&handles[i]);
+    close(fds[i]);
+  }
+
+  return 0;
+}
@@ -0,0 +1,163 @@
+/* Reaping children with many others still running.
+ *
+ * The benchmark starts a population of `sleep` children that stay alive,
+ * then:
+ *
+ *   cycle     spawns /bin/true one at a time and waits for its exit_cb;
+ *             spawn-to-exit_cb cycles/s with the population running
+ *   scan      one waitpid(WNOHANG) per running child, what a SIGCHLD costs
+ *             when every child has to be asked
+ *   kill all  uv_process_kill() on the whole population; time until the
+ *             last exit_cb, and exits per SIGCHLD callback
+ *
+ * The first [pidfd limit] children are watched through pidfds, 256 by
+ * default; the rest, and the /bin/true cycles once the population has
+ * taken them all, are reaped on SIGCHLD.
+ *
+ * Usage: bench_reap [children] [cycles] [pidfd limit]
+ */
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <uv.h>
+
+static uv_loop_t loop;
+static uv_process_t* sleepers;
+static uv_process_t process;
+static uv_process_options_t true_options;
+static unsigned int nsleepers;
+static unsigned int sleepers_exited;
+static unsigned int cycles;
+static unsigned int exited;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleeper_exit_cb(uv_process_t* handle,
+                            int64_t exit_status,
+                            int term_signal) {
+  if (term_signal != SIGKILL) {
+    abort();
+  }
+
+  sleepers_exited++;
+}
+
+static void true_exit_cb(uv_process_t* handle,
+                         int64_t exit_status,
+                         int term_signal) {
+  if (exit_status != 0 || term_signal != 0) {
+    abort();
+  }
+
+  if (++exited < cycles) {
+    if (uv_spawn(&loop, &process, &true_options)) {
+      abort();
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  uv_process_options_t sleep_options;
+  char* sleep_args[3];
+  char* true_args[2];
+  uv_signal_stats_t stats;
+  uint64_t callbacks;
+  uint64_t start;
+  unsigned int i;
+  double elapsed;
+  int status;
+
+  nsleepers = argc > 1 ? (unsigned int) atoi(argv[1]) : 10000;
+  cycles = argc > 2 ? (unsigned int) atoi(argv[2]) : 2000;
+  if (cycles == 0) {
+    return 1;
+  }
+
+  sleepers = calloc(nsleepers + 1, sizeof(sleepers[0]));
+  if (sleepers == NULL || uv_loop_init(&loop)) {
+    return 1;
+  }
+
+  if (argc > 3) {
+    uv_loop_configure(&loop, UV_LOOP_PIDFD_LIMIT, (unsigned int) atoi(argv[3]));
+  }
+
+  memset(&sleep_options, 0, sizeof(sleep_options));
+  sleep_args[0] = "sleep";
+  sleep_args[1] = "1000";
+  sleep_args[2] = NULL;
+  sleep_options.file = sleep_args[0];
+  sleep_options.args = sleep_args;
+  sleep_options.exit_cb = sleeper_exit_cb;
+
+  true_args[0] = "/bin/true";
+  true_args[1] = NULL;
+  true_options.file = true_args[0];
+  true_options.args = true_args;
+  true_options.exit_cb = true_exit_cb;
+
+  start = now_ns();
+  for (i = 0; i < nsleepers; i++) {
+    if (uv_spawn(&loop, &sleepers[i], &sleep_options)) {
+      abort();
+    }
+  }
+  printf("started  %u children in %.2f s\n",
+         nsleepers,
+         (now_ns() - start) / 1e9);
+
+  start = now_ns();
+  if (uv_spawn(&loop, &process, &true_options)) {
+    abort();
+  }
+  while (exited < cycles) {
+    uv_run(&loop, UV_RUN_ONCE);
+  }
+  elapsed = (now_ns() - start) / 1e9;
+  printf("cycle    %u spawns with %u running: %.0f cycles/s, %.1f us each\n",
+         cycles,
+         nsleepers,
+         cycles / elapsed,
+         elapsed * 1e6 / cycles);
+
+  start = now_ns();
+  for (i = 0; i < nsleepers; i++) {
+    if (waitpid(sleepers[i].pid, &status, WNOHANG) != 0) {
+      abort();
+    }
+  }
+  printf("scan     %u waitpid calls: %.1f us\n",
+         nsleepers,
+         (now_ns() - start) / 1e3);
+
+  uv_signal_stats(&loop.child_watcher, &stats);
+  callbacks = stats.dispatched;
+
+  start = now_ns();
+  for (i = 0; i < nsleepers; i++) {
+    if (uv_process_kill(&sleepers[i], SIGKILL)) {
+      abort();
+    }
+  }
+  uv_run(&loop, UV_RUN_DEFAULT);
+  elapsed = (now_ns() - start) / 1e9;
+
+  uv_signal_stats(&loop.child_watcher, &stats);
+  callbacks = stats.dispatched - callbacks;
+  printf("kill all %u children: %.1f ms, %.1f exits per SIGCHLD callback\n",
+         sleepers_exited,
+         elapsed * 1e3,
+         callbacks ? (double) sleepers_exited / callbacks : 0.0);
+
+  free(sleepers);
+  return 0;
+}
@@ -0,0 +1,157 @@
+/* Compares the signal handler, signalfd and receiver thread backends.
+ *
+ * The main thread sends SIGUSR1 to the process and waits for the loop thread
+ * to run the callback before sending the next one, so every signal is
+ * delivered (standard signals coalesce in the kernel) and the round trip is
+ * the wakeup latency. All threads but the loop thread block SIGUSR1, in
+ * thread mode the loop thread does too.
+ *
+ * Usage: bench_signal_backend [count]
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+static uint64_t* latencies;
+static unsigned int count;
+static volatile uint64_t sent_ns;
+static volatile unsigned int received;
+static volatile int ready;
+static int use_signalfd;
+static int use_thread;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+
+  return (x > y) - (x < y);
+}
+
+static void signal_cb(uv_signal_t* handle, int signum) {
+  latencies[received] = now_ns() - sent_ns;
+  __atomic_store_n(&received, received + 1, __ATOMIC_RELEASE);
+
+  if (received == count) {
+    uv_signal_stop(handle);
+  }
+}
+
+static void* loop_thread(void* arg) {
+  uv_signal_t handle;
+  uv_loop_t loop;
+  sigset_t mask;
+
+  if (uv_loop_init(&loop)) {
+    abort();
+  }
+
+  if (use_signalfd) {
+    uv_loop_configure(&loop, UV_LOOP_USE_SIGNALFD);
+  } else if (!use_thread) {
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
+  }
+
+  uv_signal_init(&loop, &handle);
+  if (uv_signal_start(&handle, signal_cb, SIGUSR1)) {
+    abort();
+  }
+
+  __atomic_store_n(&ready, 1, __ATOMIC_RELEASE);
+  uv_run(&loop, UV_RUN_DEFAULT);
+
+  return NULL;
+}
+
+static void run(const char* name) {
+  pthread_t thread;
+  uint64_t start;
+  uint64_t elapsed;
+  uint64_t sum;
+  unsigned int i;
+
+  received = 0;
+  ready = 0;
+
+  if (pthread_create(&thread, NULL, loop_thread, NULL)) {
+    abort();
+  }
+
+  while (!__atomic_load_n(&ready, __ATOMIC_ACQUIRE));
+
+  start = now_ns();
+
+  for (i = 0; i < count; i++) {
+    sent_ns = now_ns();
+    kill(getpid(), SIGUSR1);
+    while (__atomic_load_n(&received, __ATOMIC_ACQUIRE) == i);
+  }
+
+  elapsed = now_ns() - start;
+  pthread_join(thread, NULL);
+
+  sum = 0;
+  for (i = 0; i < count; i++) {
+    sum += latencies[i];
+  }
+
+  qsort(latencies, count, sizeof(latencies[0]), compare_u64);
+
+  printf("%-8s %u signals, %.0f signals/s, latency mean %.0f ns p50 %llu ns p99 %llu ns\n",
+         name,
+         count,
+         count / (elapsed / 1e9),
+         (double) sum / count,
+         (unsigned long long) latencies[count / 2],
+         (unsigned long long) latencies[(uint64_t) count * 99 / 100]);
+}
+
+int main(int argc, char** argv) {
+  sigset_t mask;
+
+  count = argc > 1 ? (unsigned int) atoi(argv[1]) : 100000;
+  if (count == 0) {
+    return 1;
+  }
+
+  latencies = malloc(count * sizeof(latencies[0]));
+  if (latencies == NULL) {
+    return 1;
+  }
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+  use_signalfd = 0;
+  run("handler");
+
+  use_signalfd = 1;
+  run("signalfd");
+
+  /* Process-wide and permanent, so it goes last. */
+  use_signalfd = 0;
+  use_thread = 1;
+  if (uv_signal_use_thread()) {
+    abort();
+  }
+  run("thread");
+
+  free(latencies);
+  return 0;
+}
@@ -0,0 +1,222 @@
+/* Throughput and latency of uv_signal_send() / uv_signal_recv_start()
+ * between two processes.
+ *
+ * The parent runs the loop and receives on channel 0, a forked child sends
+ * its CLOCK_MONOTONIC timestamp as the payload of every message. The child
+ * keeps at most {window} messages in flight, using a counter the parent
+ * publishes in shared memory, so the receiver's record ring never overflows.
+ * Sends failing with EAGAIN (kernel queue full) are retried and counted.
+ *
+ * Usage: bench_signal_channel [count] [window]
+ */
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+typedef struct {
+  unsigned int received;
+  unsigned int retries;
+} shared_t;
+
+static shared_t* shared;
+static uint64_t* latencies;
+static unsigned int count;
+static unsigned int window;
+static unsigned int received;
+static unsigned int batches;
+static unsigned int congested;
+static unsigned int out_of_order;
+static uint64_t last_sent;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+
+  return (x > y) - (x < y);
+}
+
+static void recv_cb(uv_signal_t* handle,
+                    const uv_siginfo_t* msgs,
+                    unsigned int nmsgs,
+                    int status) {
+  uint64_t now;
+  uint64_t sent;
+  unsigned int i;
+
+  now = now_ns();
+  batches++;
+  if (status == EAGAIN) {
+    congested++;
+  }
+
+  for (i = 0; i < nmsgs && received < count; i++) {
+    sent = (uint64_t) (uintptr_t) msgs[i].value.sival_ptr;
+    if (sent < last_sent) {
+      out_of_order++;
+    }
+    last_sent = sent;
+    latencies[received++] = now - sent;
+  }
+
+  __atomic_store_n(&shared->received, received, __ATOMIC_RELEASE);
+
+  if (received == count) {
+    uv_signal_stop(handle);
+  }
+}
+
+static void sender(int pid, int use_pidfd) {
+  union sigval value;
+  unsigned int retries;
+  unsigned int i;
+  int pidfd;
+  int err;
+
+  pidfd = -1;
+  if (use_pidfd) {
+    pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd == -1) {
+      _exit(1);
+    }
+  }
+
+  retries = 0;
+
+  for (i = 0; i < count; i++) {
+    while (i - __atomic_load_n(&shared->received, __ATOMIC_ACQUIRE) >= window) {
+      sched_yield();
+    }
+
+    for (;;) {
+      value.sival_ptr = (void*) (uintptr_t) now_ns();
+
+      if (use_pidfd) {
+        err = uv_signal_send_pidfd(pidfd, 0, value);
+      } else {
+        err = uv_signal_send(pid, 0, value);
+      }
+
+      if (err != EAGAIN) {
+        break;
+      }
+
+      retries++;
+      sched_yield();
+    }
+
+    if (err) {
+      _exit(1);
+    }
+  }
+
+  shared->retries = retries;
+  _exit(0);
+}
+
+static void run(const char* name, int use_signalfd, int use_pidfd) {
+  uv_signal_stats_t stats;
+  uv_signal_t handle;
+  uv_loop_t loop;
+  uint64_t start;
+  uint64_t elapsed;
+  int status;
+  pid_t child;
+
+  received = 0;
+  batches = 0;
+  congested = 0;
+  out_of_order = 0;
+  last_sent = 0;
+  memset(shared, 0, sizeof(*shared));
+
+  if (uv_loop_init(&loop)) {
+    abort();
+  }
+
+  if (use_signalfd) {
+    uv_loop_configure(&loop, UV_LOOP_USE_SIGNALFD);
+  }
+
+  uv_signal_init(&loop, &handle);
+  if (uv_signal_recv_start(&handle, recv_cb, 0)) {
+    abort();
+  }
+
+  start = now_ns();
+
+  child = fork();
+  if (child == -1) {
+    abort();
+  }
+
+  if (child == 0) {
+    sender(getppid(), use_pidfd);
+  }
+
+  uv_run(&loop, UV_RUN_DEFAULT);
+  elapsed = now_ns() - start;
+
+  if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status)) {
+    fprintf(stderr, "%s: sender failed\n", name);
+    exit(1);
+  }
+
+  uv_signal_stats(&handle, &stats);
+  qsort(latencies, count, sizeof(latencies[0]), compare_u64);
+
+  printf("%-18s %u msgs, %.0f msgs/s, %.1f msgs/batch, latency p50 %llu ns p99 %llu ns, "
+         "%u EAGAIN retries, %u congested batches, %llu dropped, %u out of order\n",
+         name,
+         count,
+         count / (elapsed / 1e9),
+         (double) count / batches,
+         (unsigned long long) latencies[count / 2],
+         (unsigned long long) latencies[(uint64_t) count * 99 / 100],
+         shared->retries,
+         congested,
+         (unsigned long long) stats.dropped,
+         out_of_order);
+}
+
+int main(int argc, char** argv) {
+  count = argc > 1 ? (unsigned int) atoi(argv[1]) : 1000000;
+  window = argc > 2 ? (unsigned int) atoi(argv[2]) : 1024;
+  if (count == 0 || window == 0) {
+    return 1;
+  }
+
+  latencies = malloc(count * sizeof(latencies[0]));
+  if (latencies == NULL) {
+    return 1;
+  }
+
+  shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    return 1;
+  }
+
+  run("handler/sigqueue", 0, 0);
+  run("signalfd/sigqueue", 1, 0);
+  run("signalfd/pidfd", 1, 1);
+
+  free(latencies);
+  return 0;
+}
@@ -0,0 +1,149 @@
+/* Measures the cost of fanning one signal out to many handles.
+ *
+ * Each configuration starts L loops on their own threads with H SIGUSR1
+ * handles each. The main thread is the only one that doesn't block SIGUSR1,
+ * so raise() runs the signal handler synchronously and its duration is the
+ * handler cost. The round trip lasts until all L * H callbacks have run.
+ *
+ * Usage: bench_signal_fanout [rounds]
+ */
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+typedef struct {
+  pthread_t thread;
+  uv_loop_t loop;
+  uv_signal_t* handles;
+  unsigned int nhandles;
+  unsigned int ncallbacks;
+} bench_loop_t;
+
+static unsigned int rounds;
+static unsigned int ready;
+static unsigned int callbacks;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void signal_cb(uv_signal_t* handle, int signum) {
+  bench_loop_t* l;
+  unsigned int i;
+
+  l = (bench_loop_t*) ((char*) handle->loop - offsetof(bench_loop_t, loop));
+  __atomic_fetch_add(&callbacks, 1, __ATOMIC_RELEASE);
+
+  if (++l->ncallbacks == rounds * l->nhandles) {
+    for (i = 0; i < l->nhandles; i++) {
+      uv_signal_stop(&l->handles[i]);
+    }
+  }
+}
+
+static void* loop_thread(void* arg) {
+  bench_loop_t* l;
+  unsigned int i;
+
+  l = arg;
+
+  for (i = 0; i < l->nhandles; i++) {
+    uv_signal_init(&l->loop, &l->handles[i]);
+    if (uv_signal_start(&l->handles[i], signal_cb, SIGUSR1)) {
+      abort();
+    }
+  }
+
+  __atomic_fetch_add(&ready, 1, __ATOMIC_RELEASE);
+  uv_run(&l->loop, UV_RUN_DEFAULT);
+
+  return NULL;
+}
+
+static void run(unsigned int nloops, unsigned int nhandles) {
+  bench_loop_t* loops;
+  sigset_t mask;
+  uint64_t handler_ns;
+  uint64_t total_ns;
+  uint64_t start;
+  uint64_t t;
+  unsigned int expected;
+  unsigned int i;
+
+  loops = calloc(nloops, sizeof(loops[0]));
+  if (loops == NULL) {
+    abort();
+  }
+
+  ready = 0;
+  callbacks = 0;
+
+  /* The loop threads inherit the blocked mask. */
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+  for (i = 0; i < nloops; i++) {
+    loops[i].nhandles = nhandles;
+    loops[i].handles = calloc(nhandles, sizeof(loops[i].handles[0]));
+    if (loops[i].handles == NULL || uv_loop_init(&loops[i].loop)) {
+      abort();
+    }
+    if (pthread_create(&loops[i].thread, NULL, loop_thread, &loops[i])) {
+      abort();
+    }
+  }
+
+  while (__atomic_load_n(&ready, __ATOMIC_ACQUIRE) != nloops);
+
+  pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
+
+  handler_ns = 0;
+  start = now_ns();
+
+  for (i = 0; i < rounds; i++) {
+    t = now_ns();
+    raise(SIGUSR1);
+    handler_ns += now_ns() - t;
+
+    expected = (i + 1) * nloops * nhandles;
+    while (__atomic_load_n(&callbacks, __ATOMIC_ACQUIRE) != expected);
+  }
+
+  total_ns = now_ns() - start;
+
+  for (i = 0; i < nloops; i++) {
+    pthread_join(loops[i].thread, NULL);
+    free(loops[i].handles);
+  }
+
+  printf("%3u loops x %4u handles: handler %.0f ns/signal, round trip %.0f ns/signal, %.0f callbacks/s\n",
+         nloops,
+         nhandles,
+         (double) handler_ns / rounds,
+         (double) total_ns / rounds,
+         (double) rounds * nloops * nhandles / (total_ns / 1e9));
+
+  free(loops);
+}
+
+int main(int argc, char** argv) {
+  rounds = argc > 1 ? (unsigned int) atoi(argv[1]) : 2000;
+  if (rounds == 0) {
+    return 1;
+  }
+
+  run(1, 1000);
+  run(64, 16);
+
+  return 0;
+}
@@ -0,0 +1,123 @@
+/* Compares starting and stopping handles one by one with the batched
+ * uv_signal_start_many() / uv_signal_stop_many().
+ *
+ * 10k handles are spread over L loops and four signals, the way a worker
+ * bootstrap registers the same few signals on every loop. The loops aren't
+ * run and no signals are sent, so only registration is timed.
+ *
+ * Usage: bench_signal_many [rounds]
+ */
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <uv.h>
+
+#define NHANDLES 10000
+
+static uv_signal_t* handles[NHANDLES];
+static int signums[NHANDLES];
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void signal_cb(uv_signal_t* handle, int signum) {
+}
+
+static void run(unsigned int nloops, unsigned int rounds) {
+  uv_loop_t* loops;
+  uv_signal_t* storage;
+  uint64_t single_start;
+  uint64_t single_stop;
+  uint64_t many_start;
+  uint64_t many_stop;
+  uint64_t t;
+  unsigned int r;
+  unsigned int i;
+  int sigs[4];
+
+  sigs[0] = SIGUSR1;
+  sigs[1] = SIGUSR2;
+  sigs[2] = SIGRTMIN;
+  sigs[3] = SIGRTMIN + 1;
+
+  loops = calloc(nloops, sizeof(loops[0]));
+  storage = calloc(NHANDLES, sizeof(storage[0]));
+  if (loops == NULL || storage == NULL) {
+    abort();
+  }
+
+  for (i = 0; i < nloops; i++) {
+    if (uv_loop_init(&loops[i])) {
+      abort();
+    }
+  }
+
+  for (i = 0; i < NHANDLES; i++) {
+    handles[i] = &storage[i];
+    signums[i] = sigs[(i / nloops) % 4];
+    uv_signal_init(&loops[i % nloops], handles[i]);
+  }
+
+  single_start = 0;
+  single_stop = 0;
+  many_start = 0;
+  many_stop = 0;
+
+  for (r = 0; r < rounds; r++) {
+    t = now_ns();
+    for (i = 0; i < NHANDLES; i++) {
+      if (uv_signal_start(handles[i], signal_cb, signums[i])) {
+        abort();
+      }
+    }
+    single_start += now_ns() - t;
+
+    t = now_ns();
+    for (i = 0; i < NHANDLES; i++) {
+      uv_signal_stop(handles[i]);
+    }
+    single_stop += now_ns() - t;
+
+    t = now_ns();
+    if (uv_signal_start_many(handles, signums, NHANDLES, signal_cb)) {
+      abort();
+    }
+    many_start += now_ns() - t;
+
+    t = now_ns();
+    uv_signal_stop_many(handles, NHANDLES);
+    many_stop += now_ns() - t;
+  }
+
+  printf("%5u loops: start %.0f handles/s, many %.0f handles/s; "
+         "stop %.0f handles/s, many %.0f handles/s\n",
+         nloops,
+         (double) NHANDLES * rounds / (single_start / 1e9),
+         (double) NHANDLES * rounds / (many_start / 1e9),
+         (double) NHANDLES * rounds / (single_stop / 1e9),
+         (double) NHANDLES * rounds / (many_stop / 1e9));
+
+  free(storage);
+  free(loops);
+}
+
+int main(int argc, char** argv) {
+  unsigned int rounds;
+
+  rounds = argc > 1 ? (unsigned int) atoi(argv[1]) : 20;
+  if (rounds == 0) {
+    return 1;
+  }
+
+  run(1, rounds);
+  run(16, rounds);
+  run(256, rounds);
+
+  return 0;
+}
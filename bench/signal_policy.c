@@ -0,0 +1,221 @@
+/* Signal delivery policies over N loops, one thread each, all watching the
+ * same real-time signal with uv_signal_start_policy().
+ *
+ * The main thread queues signals with sigqueue() and waits for the
+ * callbacks to catch up. Every 8th loop is busy: its callback spins for
+ * 1 ms, like a loop stuck in a slow request.
+ *
+ *   broadcast     every loop runs every signal
+ *   round-robin   each signal runs on one loop, in turn
+ *   least-loaded  each signal runs on the loop with the shortest backlog
+ *
+ * It prints callbacks per signal, signals/s, and the fewest and most
+ * signals an idle and a busy loop handled. It fails unless the loops'
+ * callbacks add up to the signals sent, every loop's under broadcast, and
+ * under the other policies no signal was caught by more than one loop.
+ *
+ * Usage: bench_signal_policy [loops] [signals]
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+#define MAX_LOOPS 64
+#define BUSY_NS 1000000
+
+struct policy_loop {
+  uv_loop_t loop;
+  uv_signal_t handle;
+  uv_async_t quit_handle;
+  pthread_t thread;
+  unsigned long count;
+};
+
+static struct policy_loop loops[MAX_LOOPS];
+static unsigned int nloops;
+static unsigned long callbacks;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int is_busy(unsigned int i) {
+  return i % 8 == 7;
+}
+
+static void signal_cb(uv_signal_t* handle, int signum) {
+  struct policy_loop* l;
+  uint64_t start;
+
+  l = (struct policy_loop*) handle->loop;
+  l->count++;
+
+  if (is_busy(l - loops)) {
+    start = now_ns();
+    while (now_ns() - start < BUSY_NS) {
+    }
+  }
+
+  __atomic_fetch_add(&callbacks, 1, __ATOMIC_RELEASE);
+}
+
+static void quit_cb(uv_async_t* handle) {
+  struct policy_loop* l;
+
+  l = (struct policy_loop*) handle->loop;
+  uv_signal_stop(&l->handle);
+  uv_async_stop(&l->quit_handle);
+}
+
+static void* loop_thread(void* arg) {
+  uv_run(arg, UV_RUN_DEFAULT);
+  return NULL;
+}
+
+static int run(const char* name, uv_signal_policy policy, unsigned int nsignals) {
+  uv_signal_stats_t stats;
+  unsigned long idle_min;
+  unsigned long idle_max;
+  unsigned long busy_min;
+  unsigned long busy_max;
+  unsigned long expected;
+  unsigned long total;
+  uint64_t caught;
+  unsigned int per_signal;
+  unsigned int i;
+  union sigval value;
+  uint64_t start;
+  double elapsed;
+  int signum;
+
+  signum = SIGRTMIN + 1;
+  callbacks = 0;
+
+  for (i = 0; i < nloops; i++) {
+    loops[i].count = 0;
+    if (uv_loop_init(&loops[i].loop) ||
+        uv_signal_init(&loops[i].loop, &loops[i].handle) ||
+        uv_signal_start_policy(&loops[i].handle, signal_cb, signum, policy) ||
+        uv_async_init(&loops[i].loop, &loops[i].quit_handle, quit_cb) ||
+        pthread_create(&loops[i].thread, NULL, loop_thread, &loops[i].loop)) {
+      abort();
+    }
+  }
+
+  per_signal = policy == UV_SIGNAL_BROADCAST ? nloops : 1;
+  expected = (unsigned long) nsignals * per_signal;
+  value.sival_int = 0;
+  start = now_ns();
+
+  /* Keep a window in flight, the kernel queue is bounded. */
+  for (i = 0; i < nsignals; i++) {
+    while (sigqueue(getpid(), signum, value)) {
+      if (errno != EAGAIN) {
+        abort();
+      }
+      usleep(100);
+    }
+
+    while (i + 1 - __atomic_load_n(&callbacks, __ATOMIC_ACQUIRE) / per_signal > 256) {
+      usleep(100);
+    }
+  }
+
+  while (__atomic_load_n(&callbacks, __ATOMIC_ACQUIRE) < expected) {
+    usleep(100);
+  }
+
+  elapsed = (now_ns() - start) / 1e9;
+
+  /* Long enough for duplicates to show up. */
+  usleep(20000);
+
+  for (i = 0; i < nloops; i++) {
+    uv_async_send(&loops[i].quit_handle);
+  }
+
+  idle_min = busy_min = (unsigned long) -1;
+  idle_max = busy_max = 0;
+  total = 0;
+  caught = 0;
+
+  for (i = 0; i < nloops; i++) {
+    pthread_join(loops[i].thread, NULL);
+
+    if (uv_loop_signal_stats(&loops[i].loop, &stats)) {
+      abort();
+    }
+
+    if (policy == UV_SIGNAL_BROADCAST && loops[i].count != nsignals) {
+      fprintf(stderr, "%s: loop %u ran %lu of %u signals\n",
+              name, i, loops[i].count, nsignals);
+      return 1;
+    }
+
+    total += loops[i].count;
+    caught += stats.caught;
+
+    if (is_busy(i)) {
+      busy_min = loops[i].count < busy_min ? loops[i].count : busy_min;
+      busy_max = loops[i].count > busy_max ? loops[i].count : busy_max;
+    } else {
+      idle_min = loops[i].count < idle_min ? loops[i].count : idle_min;
+      idle_max = loops[i].count > idle_max ? loops[i].count : idle_max;
+    }
+  }
+
+  if (busy_min > busy_max) {
+    busy_min = 0;
+  }
+
+  printf("%-12s %u loops: %.1f callbacks/signal, %.0f signals/s, "
+         "idle loops %lu-%lu, busy loops %lu-%lu\n",
+         name,
+         nloops,
+         (double) callbacks / nsignals,
+         nsignals / elapsed,
+         idle_min,
+         idle_max,
+         busy_min,
+         busy_max);
+
+  if (total != expected) {
+    fprintf(stderr, "%s: %lu callbacks for %u signals\n", name, total, nsignals);
+    return 1;
+  }
+
+  /* A signal given to more than one loop is counted by each of them. */
+  if (policy != UV_SIGNAL_BROADCAST && caught != nsignals) {
+    fprintf(stderr, "%s: %llu signals caught by the loops, %u sent\n",
+            name, (unsigned long long) caught, nsignals);
+    return 1;
+  }
+
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  unsigned int nsignals;
+  int err;
+
+  nloops = argc > 1 ? (unsigned int) atoi(argv[1]) : MAX_LOOPS;
+  nsignals = argc > 2 ? (unsigned int) atoi(argv[2]) : 20000;
+  if (nloops == 0 || nloops > MAX_LOOPS || nsignals == 0) {
+    return 1;
+  }
+
+  err = run("broadcast", UV_SIGNAL_BROADCAST, nsignals / 10 + 1);
+  err |= run("round-robin", UV_SIGNAL_ROUND_ROBIN, nsignals);
+  err |= run("least-loaded", UV_SIGNAL_LEAST_LOADED, nsignals);
+
+  return err;
+}
@@ -0,0 +1,312 @@
+/* Measures the cost of looking up handles by signal number.
+ *
+ * For each population size N, N handles watch SIGUSR2 and a single handle
+ * watches SIGUSR1. Raising SIGUSR1 runs the signal handler synchronously on
+ * this thread, so its cost is the lookup plus one eventfd write. Start and stop
+ * are timed over the whole population.
+ *
+ *   snapshot  uv_signal_start() and uv_signal_stop(), the lock-free snapshots
+ *   lock      the table the snapshots replaced, rebuilt here: a per-signum
+ *             array that the handler, start and stop walk or change under a
+ *             lock made of a pipe, with all signals blocked around it
+ *
+ * Usage: bench_signal_table [raises] [snapshot|lock]
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+typedef struct {
+  int signum;
+  unsigned int index;
+} lock_handle_t;
+
+typedef struct {
+  lock_handle_t** handles;
+  unsigned int nhandles;
+  unsigned int size;
+} lock_slot_t;
+
+static lock_slot_t lock_table[NSIG];
+static int lock_pipefd[2];
+static int lock_msg_pipefd[2];
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void signal_cb(uv_signal_t* handle, int signum) {
+}
+
+static void drain(uv_loop_t* loop) {
+  char buf[4096];
+
+  /* Stands in for the loop, which isn't running: rearm the wakeup so the
+   * next signal writes to the eventfd again.
+   */
+  while (read(loop->signal_wakeup_fd, buf, sizeof buf) > 0);
+  loop->signal_pending = 0;
+}
+
+static void lock_acquire(void) {
+  char data;
+
+  while (read(lock_pipefd[0], &data, 1) != 1) {
+    if (errno != EINTR) {
+      abort();
+    }
+  }
+}
+
+static void lock_release(void) {
+  char data;
+
+  data = 42;
+  while (write(lock_pipefd[1], &data, 1) != 1) {
+    if (errno != EINTR) {
+      abort();
+    }
+  }
+}
+
+static void lock_block_and_acquire(sigset_t* saved) {
+  sigset_t all;
+
+  sigfillset(&all);
+  if (pthread_sigmask(SIG_SETMASK, &all, saved)) {
+    abort();
+  }
+  lock_acquire();
+}
+
+static void lock_release_and_unblock(sigset_t* saved) {
+  lock_release();
+  if (pthread_sigmask(SIG_SETMASK, saved, NULL)) {
+    abort();
+  }
+}
+
+static void lock_handler(int signum) {
+  lock_slot_t* slot;
+  unsigned int i;
+  int saved_errno;
+
+  saved_errno = errno;
+  lock_acquire();
+
+  /* One message per handle, like the loop pipe of the old table. */
+  slot = &lock_table[signum];
+  for (i = 0; i < slot->nhandles; i++) {
+    if (write(lock_msg_pipefd[1], &slot->handles[i], sizeof(slot->handles[i])) == -1) {
+      abort();
+    }
+  }
+
+  lock_release();
+  errno = saved_errno;
+}
+
+static void lock_set_handler(int signum, void (*handler)(int)) {
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof(sa));
+  sigfillset(&sa.sa_mask);
+  sa.sa_handler = handler;
+  sa.sa_flags = SA_RESTART;
+  if (sigaction(signum, &sa, NULL)) {
+    abort();
+  }
+}
+
+static void lock_start(lock_handle_t* handle, int signum) {
+  lock_slot_t* slot;
+  sigset_t saved;
+
+  lock_block_and_acquire(&saved);
+
+  slot = &lock_table[signum];
+  if (slot->nhandles == 0) {
+    lock_set_handler(signum, lock_handler);
+  }
+
+  if (slot->nhandles == slot->size) {
+    slot->size = slot->size ? 2 * slot->size : 4;
+    slot->handles = realloc(slot->handles, slot->size * sizeof(slot->handles[0]));
+    if (slot->handles == NULL) {
+      abort();
+    }
+  }
+
+  handle->signum = signum;
+  handle->index = slot->nhandles;
+  slot->handles[slot->nhandles++] = handle;
+
+  lock_release_and_unblock(&saved);
+}
+
+static void lock_stop(lock_handle_t* handle) {
+  lock_slot_t* slot;
+  sigset_t saved;
+
+  lock_block_and_acquire(&saved);
+
+  slot = &lock_table[handle->signum];
+  slot->handles[handle->index] = slot->handles[--slot->nhandles];
+  slot->handles[handle->index]->index = handle->index;
+
+  if (slot->nhandles == 0) {
+    lock_set_handler(handle->signum, SIG_DFL);
+  }
+
+  lock_release_and_unblock(&saved);
+}
+
+static void lock_drain(void) {
+  char buf[4096];
+
+  while (read(lock_msg_pipefd[0], buf, sizeof buf) > 0);
+}
+
+static void report(const char* mode,
+                   unsigned int n,
+                   unsigned int raises,
+                   uint64_t start_ns,
+                   uint64_t raise_ns,
+                   uint64_t stop_ns) {
+  printf("%-8s %6u handles: start %.0f ns/handle, dispatch %.0f ns/signal, stop %.0f ns/handle\n",
+         mode,
+         n,
+         (double) start_ns / n,
+         (double) raise_ns / raises,
+         (double) stop_ns / n);
+}
+
+static void run_lock(unsigned int n, unsigned int raises) {
+  lock_handle_t* handles;
+  lock_handle_t target;
+  uint64_t start;
+  uint64_t start_ns;
+  uint64_t raise_ns;
+  uint64_t stop_ns;
+  unsigned int i;
+
+  handles = malloc(n * sizeof(handles[0]));
+  if (handles == NULL) {
+    abort();
+  }
+
+  start = now_ns();
+  for (i = 0; i < n; i++) {
+    lock_start(&handles[i], SIGUSR2);
+  }
+  start_ns = now_ns() - start;
+
+  lock_start(&target, SIGUSR1);
+
+  raise_ns = 0;
+  for (i = 0; i < raises; i++) {
+    start = now_ns();
+    raise(SIGUSR1);
+    raise_ns += now_ns() - start;
+
+    lock_drain();
+  }
+
+  lock_stop(&target);
+
+  start = now_ns();
+  for (i = 0; i < n; i++) {
+    lock_stop(&handles[i]);
+  }
+  stop_ns = now_ns() - start;
+
+  report("lock", n, raises, start_ns, raise_ns, stop_ns);
+  free(handles);
+}
+
+static void run(uv_loop_t* loop, unsigned int n, unsigned int raises) {
+  uv_signal_t* handles;
+  uv_signal_t target;
+  uint64_t start;
+  uint64_t start_ns;
+  uint64_t raise_ns;
+  uint64_t stop_ns;
+  unsigned int i;
+
+  handles = malloc(n * sizeof(handles[0]));
+  if (handles == NULL) {
+    abort();
+  }
+
+  start = now_ns();
+  for (i = 0; i < n; i++) {
+    uv_signal_init(loop, &handles[i]);
+    uv_signal_start(&handles[i], signal_cb, SIGUSR2);
+  }
+  start_ns = now_ns() - start;
+
+  uv_signal_init(loop, &target);
+  uv_signal_start(&target, signal_cb, SIGUSR1);
+
+  raise_ns = 0;
+  for (i = 0; i < raises; i++) {
+    start = now_ns();
+    raise(SIGUSR1);
+    raise_ns += now_ns() - start;
+
+    drain(loop);
+  }
+
+  uv_signal_stop(&target);
+
+  start = now_ns();
+  for (i = 0; i < n; i++) {
+    uv_signal_stop(&handles[i]);
+  }
+  stop_ns = now_ns() - start;
+
+  report("snapshot", n, raises, start_ns, raise_ns, stop_ns);
+  free(handles);
+}
+
+int main(int argc, char** argv) {
+  static const unsigned int sizes[] = { 10, 1000, 100000 };
+  const char* mode;
+  unsigned int raises;
+  unsigned int i;
+  uv_loop_t loop;
+
+  raises = argc > 1 ? (unsigned int) atoi(argv[1]) : 100000;
+  mode = argc > 2 ? argv[2] : NULL;
+  if (raises == 0) {
+    return 1;
+  }
+
+  if (uv_loop_init(&loop) ||
+      uv_pipe(lock_pipefd, 0, 0) ||
+      uv_pipe(lock_msg_pipefd, UV_NONBLOCK_PIPE, UV_NONBLOCK_PIPE)) {
+    abort();
+  }
+  lock_release();
+
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    if (mode == NULL || strcmp(mode, "snapshot") == 0) {
+      run(&loop, sizes[i], raises);
+    }
+    if (mode == NULL || strcmp(mode, "lock") == 0) {
+      run_lock(sizes[i], raises);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,523 @@
+/* Signal throughput, loss and latency suite.
+ *
+ * Every scenario starts L loops on their own threads with H handles each,
+ * lets S senders (threads or child processes) fire C signals each with
+ * kill(), sigqueue() or tgkill(), waits for the loops to go idle and then
+ * raises SIGRTMAX, which every loop watches, to stop them. Sends failing with EAGAIN are retried, so "sent" is what the
+ * kernel accepted and "delivered" is callbacks / (L * H).
+ *
+ * Latency percentiles come from uv_loop_signal_stats() and are the upper
+ * bound of their log2 bucket. Results are printed as one JSON document.
+ *
+ * Usage: bench_signals [handler|signalfd|thread] [count]
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+enum {
+  BACKEND_HANDLER,
+  BACKEND_SIGNALFD,
+  BACKEND_THREAD
+};
+
+enum {
+  SEND_KILL,
+  SEND_SIGQUEUE,
+  SEND_TGKILL
+};
+
+enum {
+  MODE_COUNT,    /* Handles just count callbacks. */
+  MODE_ONESHOT,  /* Two one-shot handles that arm each other. */
+  MODE_CHURN     /* The first handle stops and restarts the others. */
+};
+
+typedef struct {
+  const char* name;
+  int signum;
+  int send;
+  int processes;
+  unsigned int nsenders;
+  unsigned int nloops;
+  unsigned int nhandles;
+  int mode;
+} scenario_t;
+
+typedef struct {
+  pthread_t thread;
+  int tid;
+  uv_loop_t loop;
+  uv_signal_t* handles;
+  uv_signal_t stop_handle;
+  unsigned int nhandles;
+  uint64_t callbacks;
+  uint64_t churn;
+} bench_loop_t;
+
+typedef struct {
+  pthread_t thread;
+  unsigned int index;
+  uint64_t sent;
+} bench_sender_t;
+
+static const scenario_t* scenario;
+static bench_loop_t* loops;
+static uint64_t* child_sent;
+static unsigned int ready;
+static pid_t target;
+static unsigned int count;
+static int backend;
+static int first = 1;
+
+static const char* backend_names[] = { "handler", "signalfd", "thread" };
+static const char* send_names[] = { "kill", "sigqueue", "tgkill" };
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bench_loop_t* container_of_loop(uv_loop_t* loop) {
+  return (bench_loop_t*) ((char*) loop - offsetof(bench_loop_t, loop));
+}
+
+static void count_cb(uv_signal_t* handle, int signum) {
+  container_of_loop(handle->loop)->callbacks++;
+}
+
+static void oneshot_cb(uv_signal_t* handle, int signum) {
+  bench_loop_t* l;
+  uv_signal_t* other;
+
+  /* {handle} is stopped once this returns, so arm the other one. */
+  l = container_of_loop(handle->loop);
+  other = handle == &l->handles[0] ? &l->handles[1] : &l->handles[0];
+
+  l->callbacks++;
+  if (uv_signal_start_oneshot(other, oneshot_cb, signum)) {
+    abort();
+  }
+  l->churn++;
+}
+
+static void churn_cb(uv_signal_t* handle, int signum) {
+  bench_loop_t* l;
+  unsigned int i;
+
+  l = container_of_loop(handle->loop);
+  l->callbacks++;
+
+  /* Toggle every other handle, they count the signals they do see. */
+  for (i = 1; i < l->nhandles; i++) {
+    if (l->handles[i].signum == 0) {
+      uv_signal_start(&l->handles[i], count_cb, signum);
+    } else {
+      uv_signal_stop(&l->handles[i]);
+    }
+    l->churn++;
+  }
+}
+
+static void stop_cb(uv_signal_t* handle, int signum) {
+  bench_loop_t* l;
+  unsigned int i;
+
+  l = container_of_loop(handle->loop);
+  for (i = 0; i < l->nhandles; i++) {
+    uv_signal_stop(&l->handles[i]);
+  }
+  uv_signal_stop(handle);
+}
+
+static void* loop_thread(void* arg) {
+  bench_loop_t* l;
+  sigset_t mask;
+  unsigned int i;
+  int err;
+
+  l = arg;
+  l->tid = syscall(SYS_gettid);
+
+  if (uv_loop_init(&l->loop)) {
+    abort();
+  }
+
+  if (backend == BACKEND_SIGNALFD) {
+    uv_loop_configure(&l->loop, UV_LOOP_USE_SIGNALFD);
+  } else if (backend == BACKEND_HANDLER) {
+    sigemptyset(&mask);
+    sigaddset(&mask, scenario->signum);
+    sigaddset(&mask, SIGRTMAX);
+    pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
+  }
+
+  for (i = 0; i < l->nhandles; i++) {
+    uv_signal_init(&l->loop, &l->handles[i]);
+
+    if (scenario->mode == MODE_ONESHOT) {
+      err = 0;
+      if (i == 0) {
+        err = uv_signal_start_oneshot(&l->handles[i], oneshot_cb, scenario->signum);
+      }
+    } else if (scenario->mode == MODE_CHURN && i == 0) {
+      err = uv_signal_start(&l->handles[i], churn_cb, scenario->signum);
+    } else {
+      err = uv_signal_start(&l->handles[i], count_cb, scenario->signum);
+    }
+
+    if (err) {
+      abort();
+    }
+  }
+
+  uv_signal_init(&l->loop, &l->stop_handle);
+  if (uv_signal_start(&l->stop_handle, stop_cb, SIGRTMAX)) {
+    abort();
+  }
+
+  __atomic_fetch_add(&ready, 1, __ATOMIC_RELEASE);
+  uv_run(&l->loop, UV_RUN_DEFAULT);
+
+  return NULL;
+}
+
+static int send_one(unsigned int index, unsigned int seq) {
+  union sigval value;
+  int r;
+
+  switch (scenario->send) {
+    case SEND_SIGQUEUE:
+      value.sival_int = seq;
+      r = sigqueue(target, scenario->signum, value);
+      break;
+    case SEND_TGKILL:
+      r = syscall(SYS_tgkill,
+                  target,
+                  loops[(index + seq) % scenario->nloops].tid,
+                  scenario->signum);
+      break;
+    default:
+      r = kill(target, scenario->signum);
+      break;
+  }
+
+  return r == -1 ? errno : 0;
+}
+
+static uint64_t send_all(unsigned int index) {
+  uint64_t sent;
+  unsigned int i;
+  int err;
+
+  sent = 0;
+
+  for (i = 0; i < count; i++) {
+    while ((err = send_one(index, i)) == EAGAIN) {
+      sched_yield();
+    }
+
+    if (err) {
+      abort();
+    }
+
+    sent++;
+  }
+
+  return sent;
+}
+
+static void* sender_thread(void* arg) {
+  bench_sender_t* s;
+
+  s = arg;
+  s->sent = send_all(s->index);
+
+  return NULL;
+}
+
+static uint64_t wait_idle(void) {
+  /* Returns when the loops last made progress. */
+  uint64_t last_change;
+  uint64_t last;
+  uint64_t cur;
+  unsigned int idle;
+  unsigned int i;
+
+  last_change = now_ns();
+  last = 0;
+
+  idle = 0;
+  while (idle < 5) {
+    usleep(10000);
+
+    cur = 0;
+    for (i = 0; i < scenario->nloops; i++) {
+      cur += __atomic_load_n(&loops[i].callbacks, __ATOMIC_RELAXED);
+    }
+
+    if (cur != last) {
+      last = cur;
+      last_change = now_ns();
+      idle = 0;
+    } else {
+      idle++;
+    }
+  }
+
+  return last_change;
+}
+
+static uint64_t percentile(const uv_signal_stats_t* stats, double p) {
+  uint64_t total;
+  uint64_t seen;
+  unsigned int i;
+
+  total = 0;
+  for (i = 0; i < UV_SIGNAL_LATENCY_BUCKETS; i++) {
+    total += stats->latency[i];
+  }
+
+  if (total == 0) {
+    return 0;
+  }
+
+  seen = 0;
+  for (i = 0; i < UV_SIGNAL_LATENCY_BUCKETS; i++) {
+    seen += stats->latency[i];
+    if (seen >= total * p) {
+      break;
+    }
+  }
+
+  return (uint64_t) 1 << i;
+}
+
+static void run(const scenario_t* sc) {
+  bench_sender_t* senders;
+  uv_signal_stats_t total;
+  uv_signal_stats_t stats;
+  uint64_t callbacks;
+  uint64_t churn;
+  uint64_t sent;
+  uint64_t start;
+  uint64_t elapsed;
+  double delivered;
+  unsigned int i;
+  unsigned int k;
+  pid_t pid;
+
+  scenario = sc;
+  ready = 0;
+
+  loops = calloc(sc->nloops, sizeof(loops[0]));
+  senders = calloc(sc->nsenders, sizeof(senders[0]));
+  if (loops == NULL || senders == NULL) {
+    abort();
+  }
+
+  for (i = 0; i < sc->nloops; i++) {
+    loops[i].nhandles = sc->nhandles;
+    loops[i].handles = calloc(sc->nhandles, sizeof(uv_signal_t));
+    if (loops[i].handles == NULL) {
+      abort();
+    }
+
+    if (pthread_create(&loops[i].thread, NULL, loop_thread, &loops[i])) {
+      abort();
+    }
+  }
+
+  while (__atomic_load_n(&ready, __ATOMIC_ACQUIRE) < sc->nloops) {
+    sched_yield();
+  }
+
+  start = now_ns();
+
+  for (i = 0; i < sc->nsenders; i++) {
+    senders[i].index = i;
+
+    if (!sc->processes) {
+      if (pthread_create(&senders[i].thread, NULL, sender_thread, &senders[i])) {
+        abort();
+      }
+      continue;
+    }
+
+    pid = fork();
+    if (pid == -1) {
+      abort();
+    }
+
+    if (pid == 0) {
+      child_sent[i] = send_all(i);
+      _exit(0);
+    }
+  }
+
+  sent = 0;
+  for (i = 0; i < sc->nsenders; i++) {
+    if (!sc->processes) {
+      pthread_join(senders[i].thread, NULL);
+      sent += senders[i].sent;
+    } else {
+      if (wait(NULL) == -1) {
+        abort();
+      }
+    }
+  }
+
+  if (sc->processes) {
+    for (i = 0; i < sc->nsenders; i++) {
+      sent += child_sent[i];
+    }
+  }
+
+  elapsed = wait_idle() - start;
+  kill(target, SIGRTMAX);
+
+  callbacks = 0;
+  churn = 0;
+  memset(&total, 0, sizeof(total));
+
+  for (i = 0; i < sc->nloops; i++) {
+    pthread_join(loops[i].thread, NULL);
+    callbacks += loops[i].callbacks;
+    churn += loops[i].churn;
+
+    uv_loop_signal_stats(&loops[i].loop, &stats);
+    total.dropped += stats.dropped;
+    for (k = 0; k < UV_SIGNAL_LATENCY_BUCKETS; k++) {
+      total.latency[k] += stats.latency[k];
+    }
+  }
+
+  /* A churned handle only sees some signals, count the steady one. */
+  if (sc->mode == MODE_COUNT) {
+    delivered = (double) callbacks / ((uint64_t) sc->nloops * sc->nhandles);
+  } else {
+    delivered = callbacks;
+    if (sc->mode == MODE_CHURN) {
+      delivered = 0;
+      for (i = 0; i < sc->nloops; i++) {
+        delivered += loops[i].handles[0].dispatched_signals;
+      }
+      delivered /= sc->nloops;
+    }
+  }
+
+  printf("%s\n    {\"name\": \"%s\", \"send\": \"%s\", \"senders\": %u, "
+         "\"processes\": %s, \"loops\": %u, \"handles\": %u, "
+         "\"sent\": %llu, \"delivered\": %.0f, \"loss\": %.6f, "
+         "\"signals_per_sec\": %.0f, \"callbacks\": %llu, \"churn\": %llu, "
+         "\"dropped\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu}",
+         first ? "" : ",",
+         sc->name,
+         send_names[sc->send],
+         sc->nsenders,
+         sc->processes ? "true" : "false",
+         sc->nloops,
+         sc->nhandles,
+         (unsigned long long) sent,
+         delivered,
+         sent == 0 ? 0 : 1 - delivered / sent,
+         delivered / (elapsed / 1e9),
+         (unsigned long long) callbacks,
+         (unsigned long long) churn,
+         (unsigned long long) total.dropped,
+         (unsigned long long) percentile(&total, 0.5),
+         (unsigned long long) percentile(&total, 0.99),
+         (unsigned long long) percentile(&total, 0.999));
+  fflush(stdout);
+  first = 0;
+
+  for (i = 0; i < sc->nloops; i++) {
+    free(loops[i].handles);
+  }
+  free(loops);
+  free(senders);
+}
+
+int main(int argc, char** argv) {
+  const scenario_t scenarios[] = {
+    { "storm", SIGRTMIN, SEND_KILL, 0, 1, 1, 1, MODE_COUNT },
+    { "storm", SIGRTMIN, SEND_SIGQUEUE, 0, 1, 1, 1, MODE_COUNT },
+    { "storm", SIGRTMIN, SEND_TGKILL, 0, 1, 1, 1, MODE_COUNT },
+    { "storm", SIGRTMIN, SEND_SIGQUEUE, 0, 4, 1, 1, MODE_COUNT },
+    { "storm", SIGRTMIN, SEND_TGKILL, 0, 4, 4, 1, MODE_COUNT },
+    { "storm", SIGRTMIN, SEND_SIGQUEUE, 1, 4, 1, 1, MODE_COUNT },
+    { "storm_std", SIGUSR1, SEND_KILL, 0, 4, 1, 1, MODE_COUNT },
+    { "handles", SIGRTMIN, SEND_SIGQUEUE, 0, 1, 1, 100, MODE_COUNT },
+    { "handles", SIGRTMIN, SEND_SIGQUEUE, 0, 1, 1, 10000, MODE_COUNT },
+    { "loops", SIGRTMIN, SEND_SIGQUEUE, 0, 1, 4, 16, MODE_COUNT },
+    { "loops", SIGRTMIN, SEND_SIGQUEUE, 0, 1, 16, 16, MODE_COUNT },
+    { "oneshot_churn", SIGWINCH, SEND_KILL, 0, 1, 1, 2, MODE_ONESHOT },
+    { "start_stop_churn", SIGRTMIN, SEND_SIGQUEUE, 0, 2, 1, 64, MODE_CHURN },
+  };
+  const char* name;
+  sigset_t mask;
+  unsigned int i;
+
+  target = getpid();
+  name = argc > 1 ? argv[1] : "handler";
+  count = argc > 2 ? (unsigned int) atoi(argv[2]) : 100000;
+
+  for (backend = 0; backend < 3; backend++) {
+    if (strcmp(name, backend_names[backend]) == 0) {
+      break;
+    }
+  }
+
+  if (backend == 3 || count == 0) {
+    fprintf(stderr, "usage: %s [handler|signalfd|thread] [count]\n", argv[0]);
+    return 1;
+  }
+
+  if (backend == BACKEND_THREAD) {
+    if (uv_signal_use_thread()) {
+      abort();
+    }
+  } else {
+    /* Only loop threads take the signals. */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGRTMIN);
+    sigaddset(&mask, SIGRTMAX);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGWINCH);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+  }
+
+  child_sent = mmap(NULL, 64 * sizeof(child_sent[0]), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (child_sent == MAP_FAILED) {
+    return 1;
+  }
+
+  printf("{\n  \"backend\": \"%s\",\n  \"count\": %u,\n  \"results\": [", name, count);
+
+  for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+    /* The receiver thread never sees signals sent to another thread. */
+    if (backend == BACKEND_THREAD && scenarios[i].send == SEND_TGKILL) {
+      continue;
+    }
+    run(&scenarios[i]);
+  }
+
+  printf("\n  ]\n}\n");
+
+  return 0;
+}
@@ -0,0 +1,132 @@
+/* Spawn rate of /bin/true from a parent with a large, touched heap.
+ *
+ *   fork        fork() + execve() + waitpid(), the baseline; fork() copies
+ *               the parent's page tables, so it slows down as the heap grows
+ *   uv_spawn    one child at a time, exit reported by the loop
+ *   exec block  uv_spawn() with an exec block prepared once up front
+ *
+ * It prints spawns/s and the mean time per spawn for each.
+ *
+ * Usage: bench_spawn [heap MB] [spawns]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+extern char** environ;
+
+static uv_loop_t loop;
+static uv_process_t process;
+static uv_process_options_t options;
+static unsigned int total;
+static unsigned int exited;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void report(const char* name, double elapsed) {
+  printf("%-11s %u spawns: %.0f spawns/s, %.1f us each\n",
+         name,
+         total,
+         total / elapsed,
+         elapsed * 1e6 / total);
+}
+
+static void exit_cb(uv_process_t* handle, int64_t exit_status, int term_signal) {
+  if (exit_status != 0 || term_signal != 0) {
+    abort();
+  }
+
+  if (++exited < total) {
+    if (uv_spawn(&loop, &process, &options)) {
+      abort();
+    }
+  }
+}
+
+static double run_fork(char** args) {
+  uint64_t start;
+  unsigned int i;
+  int status;
+  pid_t pid;
+
+  start = now_ns();
+  for (i = 0; i < total; i++) {
+    pid = fork();
+    if (pid == -1) {
+      abort();
+    }
+
+    if (pid == 0) {
+      execve(args[0], args, environ);
+      _exit(127);
+    }
+
+    if (waitpid(pid, &status, 0) != pid || status != 0) {
+      abort();
+    }
+  }
+
+  return (now_ns() - start) / 1e9;
+}
+
+static double run_uv(void) {
+  uint64_t start;
+
+  exited = 0;
+  start = now_ns();
+  if (uv_spawn(&loop, &process, &options)) {
+    abort();
+  }
+  uv_run(&loop, UV_RUN_DEFAULT);
+  return (now_ns() - start) / 1e9;
+}
+
+int main(int argc, char** argv) {
+  uv_exec_block_t block;
+  char* args[2];
+  size_t heap_size;
+  char* heap;
+
+  heap_size = (size_t) (argc > 1 ? atoi(argv[1]) : 1024) << 20;
+  total = argc > 2 ? (unsigned int) atoi(argv[2]) : 500;
+  if (total == 0) {
+    return 1;
+  }
+
+  /* Touch every page so the heap is really mapped. */
+  heap = malloc(heap_size + 1);
+  if (heap == NULL || uv_loop_init(&loop)) {
+    return 1;
+  }
+  memset(heap, 1, heap_size + 1);
+
+  args[0] = "/bin/true";
+  args[1] = NULL;
+  options.file = args[0];
+  options.args = args;
+  options.exit_cb = exit_cb;
+
+  printf("heap %zu MB\n", heap_size >> 20);
+  report("fork", run_fork(args));
+  report("uv_spawn", run_uv());
+
+  if (uv_exec_block_init(&block, args[0], args, NULL)) {
+    abort();
+  }
+  options.exec = &block;
+  report("exec block", run_uv());
+
+  uv_exec_block_free(&block);
+  free(heap);
+  return 0;
+}
@@ -0,0 +1,142 @@
+/* uv_queue_work() throughput and latency.
+ *
+ *   tiny     empty work_cb, 10k requests in flight; requests/s through the
+ *            pool and back to the loop
+ *   latency  one empty request at a time; p50/p99 from uv_queue_work() to
+ *            after_work_cb
+ *   large    requests of about 100 us of CPU, every 16th one 10x longer;
+ *            requests/s and CPU time spent in work_cb over wall time
+ *
+ * The pool size comes from UV_THREADPOOL_SIZE or the CPU count.
+ *
+ * Usage: bench_threadpool [requests]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <uv.h>
+
+#define INFLIGHT 10000
+
+static uv_loop_t loop;
+static uv_work_t* reqs;
+static uint64_t* latencies;
+static unsigned int total;
+static unsigned int submitted;
+static unsigned int completed;
+static uint64_t busy_ns;
+static uint64_t queued_at;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t cpu_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+
+  return (x > y) - (x < y);
+}
+
+static void empty_work(uv_work_t* req) {
+}
+
+static void spin_work(uv_work_t* req) {
+  uint64_t start;
+  uint64_t ns;
+
+  ns = (req - reqs) % 16 == 0 ? 1000000 : 100000;
+  start = cpu_ns();
+  while (cpu_ns() - start < ns) {
+  }
+
+  __atomic_fetch_add(&busy_ns, cpu_ns() - start, __ATOMIC_RELAXED);
+}
+
+static void refill_cb(uv_work_t* req, int status) {
+  completed++;
+
+  if (submitted < total) {
+    uv_queue_work(&loop, req, req->work_cb, refill_cb);
+    submitted++;
+  }
+}
+
+static void latency_cb(uv_work_t* req, int status) {
+  latencies[completed++] = now_ns() - queued_at;
+
+  if (completed < total) {
+    queued_at = now_ns();
+    uv_queue_work(&loop, req, empty_work, latency_cb);
+  }
+}
+
+static double run_batch(unsigned int n, uv_work_cb work_cb) {
+  uint64_t start;
+
+  total = n;
+  submitted = 0;
+  completed = 0;
+  start = now_ns();
+
+  while (submitted < total && submitted < INFLIGHT) {
+    uv_queue_work(&loop, &reqs[submitted], work_cb, refill_cb);
+    submitted++;
+  }
+
+  uv_run(&loop, UV_RUN_DEFAULT);
+  return (now_ns() - start) / 1e9;
+}
+
+int main(int argc, char** argv) {
+  unsigned int n;
+  double elapsed;
+
+  n = argc > 1 ? (unsigned int) atoi(argv[1]) : 1000000;
+  if (n == 0) {
+    return 1;
+  }
+
+  reqs = calloc(INFLIGHT, sizeof(reqs[0]));
+  latencies = malloc(n * sizeof(latencies[0]));
+  if (reqs == NULL || latencies == NULL || uv_loop_init(&loop)) {
+    return 1;
+  }
+
+  elapsed = run_batch(n, empty_work);
+  printf("tiny     %u requests: %.0f requests/s\n", n, n / elapsed);
+
+  total = n / 10 + 1;
+  completed = 0;
+  queued_at = now_ns();
+  uv_queue_work(&loop, &reqs[0], empty_work, latency_cb);
+  uv_run(&loop, UV_RUN_DEFAULT);
+
+  qsort(latencies, total, sizeof(latencies[0]), compare_u64);
+  printf("latency  %u requests: p50 %llu ns p99 %llu ns\n",
+         total,
+         (unsigned long long) latencies[total / 2],
+         (unsigned long long) latencies[(uint64_t) total * 99 / 100]);
+
+  busy_ns = 0;
+  elapsed = run_batch(n / 200 + 1, spin_work);
+  printf("large    %u requests: %.0f requests/s, %.2f CPUs busy in work_cb\n",
+         n / 200 + 1,
+         (n / 200 + 1) / elapsed,
+         busy_ns / 1e9 / elapsed);
+
+  free(latencies);
+  free(reqs);
+  return 0;
+}
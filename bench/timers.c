@@ -0,0 +1,122 @@
+/* Timer insert, cancel and fire throughput with 1M live timers.
+ *
+ * A million long timers (1 s .. 1 h) stay started in the background and are
+ * unref'd so they don't keep the loop alive. On top of that the bench times:
+ *
+ *   insert   uv_timer_start() of a second million timers
+ *   restart  uv_timer_again() of all of them, the timeout-reset pattern
+ *   cancel   uv_timer_stop() of all of them
+ *   fire     a million timers due within 100 ms, run to completion; the rate
+ *            is per CPU second so the time spent waiting isn't counted. The
+ *            ones due past the next multiple of 64 ms are cascaded; all of
+ *            them must run in timeout order and ties in start order
+ *
+ * Usage: bench_timers [count]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <uv.h>
+
+static uv_timer_t* background;
+static uv_timer_t* timers;
+static unsigned int count;
+static unsigned int fired;
+static unsigned int out_of_order;
+static uint64_t last_timeout;
+static uint64_t last_start_id;
+
+static uint64_t now_ns(clockid_t clock_id) {
+  struct timespec ts;
+
+  clock_gettime(clock_id, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void idle_cb(uv_timer_t* handle) {
+}
+
+static void fire_cb(uv_timer_t* handle) {
+  /* Ties run in start order. */
+  if (handle->timeout < last_timeout ||
+      (handle->timeout == last_timeout && handle->start_id < last_start_id)) {
+    out_of_order++;
+  }
+  last_timeout = handle->timeout;
+  last_start_id = handle->start_id;
+  fired++;
+}
+
+static void report(const char* name, uint64_t elapsed) {
+  printf("%-8s %u timers, %.0f timers/s\n", name, count, count / (elapsed / 1e9));
+}
+
+int main(int argc, char** argv) {
+  uv_loop_t loop;
+  uint64_t t;
+  unsigned int i;
+
+  count = argc > 1 ? (unsigned int) atoi(argv[1]) : 1000000;
+  if (count == 0) {
+    return 1;
+  }
+
+  background = calloc(count, sizeof(background[0]));
+  timers = calloc(count, sizeof(timers[0]));
+  if (background == NULL || timers == NULL) {
+    return 1;
+  }
+
+  if (uv_loop_init(&loop)) {
+    abort();
+  }
+
+  srand(1);
+
+  for (i = 0; i < count; i++) {
+    uv_timer_init(&loop, &background[i]);
+    uv_timer_start(&background[i], idle_cb, 1000 + rand() % 3600000, 0);
+    uv_unref((uv_handle_t*) &background[i]);
+  }
+
+  for (i = 0; i < count; i++) {
+    uv_timer_init(&loop, &timers[i]);
+  }
+
+  t = now_ns(CLOCK_MONOTONIC);
+  for (i = 0; i < count; i++) {
+    uv_timer_start(&timers[i], idle_cb, 1000 + rand() % 3600000, 1000 + i % 1000);
+  }
+  report("insert", now_ns(CLOCK_MONOTONIC) - t);
+
+  t = now_ns(CLOCK_MONOTONIC);
+  for (i = 0; i < count; i++) {
+    uv_timer_again(&timers[i]);
+  }
+  report("restart", now_ns(CLOCK_MONOTONIC) - t);
+
+  t = now_ns(CLOCK_MONOTONIC);
+  for (i = 0; i < count; i++) {
+    uv_timer_stop(&timers[i]);
+  }
+  report("cancel", now_ns(CLOCK_MONOTONIC) - t);
+
+  uv_update_time(&loop);
+  for (i = 0; i < count; i++) {
+    uv_timer_start(&timers[i], fire_cb, rand() % 100, 0);
+  }
+
+  t = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+  uv_run(&loop, UV_RUN_DEFAULT);
+  report("fire", now_ns(CLOCK_PROCESS_CPUTIME_ID) - t);
+
+  if (fired != count || out_of_order != 0) {
+    fprintf(stderr, "fired %u of %u timers, %u out of order\n", fired, count, out_of_order);
+    return 1;
+  }
+
+  free(timers);
+  free(background);
+  return 0;
+}
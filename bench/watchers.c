@@ -0,0 +1,163 @@
+/* Watcher table memory and lookup cost for dense and sparse fd numbers.
+ *
+ * 1000 eventfds are watched for UV_READABLE and kept readable, so every loop
+ * iteration looks up all of them:
+ *
+ *   dense    the lowest free fd numbers, as a process normally gets them
+ *   sparse   spread evenly up to the highest fd the limit allows
+ *   high     packed together at the top of that range
+ *
+ * It prints the watcher table size next to what a dense array up to the
+ * highest fd would take, and the time per dispatched callback. The highest fd
+ * is bound by RLIMIT_NOFILE, raise the hard limit to try fds near 1M.
+ *
+ * Usage: bench_watchers [rounds]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include <uv.h>
+
+#define NFDS 1000
+
+static uv_poll_t handles[NFDS];
+static int fds[NFDS];
+static unsigned long long callbacks;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void poll_cb(uv_poll_t* handle, int status, int events) {
+  callbacks++;
+}
+
+static unsigned int next_power_of_two(unsigned int val) {
+  val -= 1;
+  val |= val >> 1;
+  val |= val >> 2;
+  val |= val >> 4;
+  val |= val >> 8;
+  val |= val >> 16;
+  val += 1;
+  return val;
+}
+
+static void run(const char* name, int first, int stride, unsigned int rounds) {
+  uv_loop_t loop;
+  uint64_t one;
+  uint64_t start;
+  uint64_t elapsed;
+  size_t table;
+  size_t dense;
+  unsigned int r;
+  int maxfd;
+  int fd;
+  int i;
+
+  if (uv_loop_init(&loop)) {
+    abort();
+  }
+
+  one = 1;
+  maxfd = 0;
+
+  for (i = 0; i < NFDS; i++) {
+    fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd == -1 || write(fd, &one, sizeof(one)) != sizeof(one)) {
+      abort();
+    }
+
+    if (stride != 0) {
+      if (dup2(fd, first + i * stride) == -1) {
+        abort();
+      }
+      close(fd);
+      fd = first + i * stride;
+    }
+
+    fds[i] = fd;
+    if (fd > maxfd) {
+      maxfd = fd;
+    }
+
+    if (uv_poll_init(&loop, &handles[i], fd) ||
+        uv_poll_start(&handles[i], UV_READABLE, poll_cb)) {
+      abort();
+    }
+  }
+
+  uv_run(&loop, UV_RUN_NOWAIT);
+
+  callbacks = 0;
+  start = now_ns();
+
+  for (r = 0; r < rounds; r++) {
+    uv_run(&loop, UV_RUN_NOWAIT);
+  }
+
+  elapsed = now_ns() - start;
+
+  table = (loop.nwatchers >> UV__WATCHER_PAGE_BITS) * sizeof(loop.watchers[0]) +
+          (size_t) loop.nwatcher_pages * UV__WATCHER_PAGE_SIZE * sizeof(uv__io_t*);
+  /* A single array indexed by fd, with two spare entries, grown to a power
+   * of two.
+   */
+  dense = next_power_of_two(maxfd + 3) * sizeof(uv__io_t*);
+
+  printf("%-6s max fd %7d: table %7zu bytes (%u pages), dense array %8zu bytes, "
+         "%.1f ns/callback\n",
+         name,
+         maxfd,
+         table,
+         loop.nwatcher_pages,
+         dense,
+         (double) elapsed / callbacks);
+
+  for (i = 0; i < NFDS; i++) {
+    uv_poll_stop(&handles[i]);
+    close(fds[i]);
+  }
+}
+
+int main(int argc, char** argv) {
+  struct rlimit limit;
+  unsigned int rounds;
+  int top;
+
+  rounds = argc > 1 ? (unsigned int) atoi(argv[1]) : 2000;
+  if (rounds == 0) {
+    return 1;
+  }
+
+  if (getrlimit(RLIMIT_NOFILE, &limit)) {
+    abort();
+  }
+
+  limit.rlim_cur = limit.rlim_max;
+  if (limit.rlim_cur > 1 << 20) {
+    limit.rlim_cur = 1 << 20;
+  }
+  setrlimit(RLIMIT_NOFILE, &limit);
+  getrlimit(RLIMIT_NOFILE, &limit);
+
+  /* Leave room for the loop's own fds and the eventfd being moved. */
+  top = (int) limit.rlim_cur - 1;
+  if (top < 4 * NFDS) {
+    fprintf(stderr, "need RLIMIT_NOFILE of at least %d\n", 4 * NFDS);
+    return 1;
+  }
+
+  run("dense", 0, 0, rounds);
+  run("sparse", 2 * NFDS, (top - 2 * NFDS) / NFDS, rounds);
+  run("high", top - NFDS + 1, 1, rounds);
+
+  return 0;
+}
@@ -1,9 +1,11 @@
 #ifndef UV_H
 #define UV_H
 
+#include <fcntl.h>
 #include <stdint.h>
 #include <pthread.h>
 #include <signal.h>
+#include <sys/types.h>
 
 #if defined(O_NONBLOCK)
 # define UV_FS_O_NONBLOCK     O_NONBLOCK
@@ -11,6 +13,23 @@
 # define UV_FS_O_NONBLOCK     0
 #endif
 
+#if defined(_NSIG)
+# define UV__NSIG _NSIG
+#else
+# define UV__NSIG 65
+#endif
+
+/* Timer wheel geometry: UV__TIMER_LEVELS levels of UV__TIMER_SLOTS slots,
+ * level n has a granularity of UV__TIMER_SLOTS^n ms.
+ */
+#define UV__TIMER_BITS 6
+#define UV__TIMER_SLOTS (1 << UV__TIMER_BITS)
+#define UV__TIMER_LEVELS 6
+
+/* The watcher table is allocated in pages of UV__WATCHER_PAGE_SIZE fds. */
+#define UV__WATCHER_PAGE_BITS 10
+#define UV__WATCHER_PAGE_SIZE (1 << UV__WATCHER_PAGE_BITS)
+
 typedef int uv_os_fd_t;
 
 /* uv_spawn() options. */
@@ -39,8 +58,11 @@ typedef enum {
 } uv_stdio_flags;
 
 typedef int uv_file;
+typedef uid_t uv_uid_t;
+typedef gid_t uv_gid_t;
 
 typedef void (*uv_thread_cb)(void* arg);
+typedef pthread_t uv_thread_t;
 
 typedef void* (*uv_malloc_func)(size_t size);
 typedef void* (*uv_realloc_func)(void* ptr, size_t size);
@@ -63,10 +85,29 @@ struct uv__io_s {
   uv__io_cb cb;
   struct uv__queue watcher_queue;
   unsigned int pevents; /* Pending event mask i.e. mask at next tick. */
-  unsigned int events;  /* Current event mask. */
+  unsigned int events;  /* Mask registered with the kernel, 0 if none. */
   int fd;
 };
 
+typedef enum {
+  /*
+   * Receive signals watched by this loop through a signalfd registered with
+   * the loop's epoll set instead of the asynchronous handler and its eventfd.
+   * The signals are blocked in the thread that starts the watchers, which
+   * must be the thread that runs the loop.
+   */
+  UV_LOOP_USE_SIGNALFD = 0,
+  /*
+   * Takes an unsigned int: how many running children of this loop may have
+   * a pidfd, 256 by default. Their exits are watched through the pidfd and
+   * uv_process_kill() signals through it. Children past the limit, all of
+   * them with 0, don't hold a descriptor: their exits are reaped on SIGCHLD
+   * through a process-wide pid table, as they are on kernels without
+   * pidfds, or when the descriptors run out.
+   */
+  UV_LOOP_PIDFD_LIMIT
+} uv_loop_option;
+
 typedef enum {
   UV_RUN_DEFAULT = 0,
   UV_RUN_ONCE,
@@ -77,39 +118,334 @@ typedef enum {
 typedef struct uv_loop_s uv_loop_t;
 typedef struct uv_handle_s uv_handle_t;
 typedef struct uv_signal_s uv_signal_t;
+typedef struct uv_timer_s uv_timer_t;
+typedef struct uv_poll_s uv_poll_t;
+typedef struct uv_async_s uv_async_t;
+typedef struct uv_work_s uv_work_t;
+typedef struct uv_loop_group_s uv_loop_group_t;
+typedef struct uv_process_s uv_process_t;
+typedef struct uv_process_options_s uv_process_options_t;
+typedef struct uv_stdio_container_s uv_stdio_container_t;
+typedef struct uv_exec_block_s uv_exec_block_t;
 
+typedef void (*uv_timer_cb)(uv_timer_t* handle);
+typedef void (*uv_poll_cb)(uv_poll_t* handle, int status, int events);
+typedef void (*uv_async_cb)(uv_async_t* handle);
+typedef void (*uv_work_cb)(uv_work_t* req);
+typedef void (*uv_after_work_cb)(uv_work_t* req, int status);
+typedef void (*uv_loop_group_cb)(uv_loop_group_t* group, unsigned int index);
+typedef void (*uv_loop_group_msg_cb)(uv_loop_group_t* group, unsigned int index, void* msg);
+typedef void (*uv_loop_group_signal_cb)(uv_loop_group_t* group, unsigned int index, int signum);
+typedef void (*uv_exit_cb)(uv_process_t* process, int64_t exit_status, int term_signal);
 typedef void (*uv_signal_cb)(uv_signal_t* handle, int signum);
+typedef void (*uv_signal_coalesce_cb)(uv_signal_t* handle, int signum, unsigned int count);
+
+/* What the kernel knows about a delivered signal. For signals sent with
+ * sigqueue() value carries the sender's payload.
+ */
+typedef struct {
+  int signo;
+  int code;
+  int pid;
+  unsigned int uid;
+  union sigval value;
+} uv_siginfo_t;
+
+typedef void (*uv_signal_info_cb)(uv_signal_t* handle, const uv_siginfo_t* info);
+
+/* Messages received on a uv_signal_recv_start() channel, in the order they
+ * were sent. {status} is EAGAIN when the receiver is falling behind, senders
+ * should back off: the loop's record ring is half full (or holds half of
+ * RLIMIT_SIGPENDING, if that's less), or as much waited in its signalfd, or
+ * it's throttled and new messages wait in the kernel queue. It is 0
+ * otherwise.
+ */
+typedef void (*uv_signal_recv_cb)(uv_signal_t* handle,
+                                  const uv_siginfo_t* msgs,
+                                  unsigned int nmsgs,
+                                  int status);
+
+#define UV_SIGNAL_LATENCY_BUCKETS 32
+
+/* Signal delivery counters, see uv_signal_stats() and uv_loop_signal_stats().
+ *
+ *   caught      signals seen by the loop for the handle(s)
+ *   dispatched  signals handed to a callback
+ *   dropped     siginfo records lost because the loop's ring was full,
+ *               counted for every uv_signal_start_info() and
+ *               uv_signal_recv_start() handle watching the signal
+ *   coalesced   signals merged into an earlier uv_signal_start_coalesced()
+ *               callback
+ *
+ * Signals a handle was stopped before it got to, by its own callback or a
+ * one-shot, are caught but neither dispatched nor dropped.
+ *
+ * latency[i] counts deliveries that took [2^(i-1), 2^i) ns from the signal
+ * arriving (handler entry, signalfd read or sigwaitinfo return) to the loop
+ * running callbacks for it, latency[0] those under 1 ns and the last bucket
+ * everything slower. It is only kept per loop, with one sample per siginfo
+ * record and one per batch of counted signals, taken from the oldest.
+ */
+typedef struct {
+  uint64_t caught;
+  uint64_t dispatched;
+  uint64_t dropped;
+  uint64_t coalesced;
+  uint64_t latency[UV_SIGNAL_LATENCY_BUCKETS];
+} uv_signal_stats_t;
 
 struct uv_signal_s {
   uv_loop_t* loop;
   unsigned int flags;
   
   uv_signal_cb signal_cb;
+  uv_signal_coalesce_cb coalesce_cb;
+  uv_signal_info_cb info_cb;
+  uv_signal_recv_cb recv_cb;
   int signum;
-  /* RB_ENTRY(uv_signal_s) tree_entry; */                                     
-  struct {                                                                    
-    struct uv_signal_s* rbe_left;                                             
-    struct uv_signal_s* rbe_right;                                            
-    struct uv_signal_s* rbe_parent;                                           
-    int rbe_color;                                                            
-  } tree_entry;                                                               
-  /* Use two counters here so we don have to fiddle with atomics. */          
+  /* Position in loop->signal_slots[signum].handles. */
+  unsigned int slot_index;
+  /* Both counters are only touched by the loop thread, the signal handler
+   * counts per loop in loop->signal_slots[signum].caught.
+   */
   unsigned int caught_signals;                                                
   unsigned int dispatched_signals;
+  unsigned int dropped_signals;
+  unsigned int coalesced_signals;
+};
+
+struct uv_timer_s {
+  uv_loop_t* loop;
+  unsigned int flags;
+
+  uv_timer_cb timer_cb;
+  struct uv__queue node;
+  uint64_t timeout;
+  uint64_t repeat;
+  uint64_t start_id;
+  /* Index in loop->timer_wheel of the slot the timer was last put in. */
+  unsigned int slot;
 };
 
+struct uv_async_s {
+  uv_loop_t* loop;
+  unsigned int flags;
+
+  uv_async_cb async_cb;
+  struct uv__queue queue;
+  /* Set by uv_async_send(), cleared by the loop before the callback. */
+  int pending;
+};
+
+struct uv_work_s {
+  void* data;
+  uv_loop_t* loop;
+
+  uv_work_cb work_cb;
+  uv_after_work_cb after_work_cb;
+  /* In a worker's deque while queued. */
+  struct uv__queue wq;
+  /* In loop->work_done once work_cb has returned. */
+  uv_work_t* done_next;
+};
+
+struct uv_stdio_container_s {
+  uv_stdio_flags flags;
+  union {
+    /* The fd to inherit with UV_INHERIT_FD. With UV_CREATE_PIPE,
+     * uv_spawn() stores the parent's end of the pipe here, non-blocking.
+     */
+    int fd;
+  } data;
+};
+
+enum uv_process_flags {
+  /* Set the child's user id, or group id, to options.uid or options.gid. */
+  UV_PROCESS_SETUID = (1 << 0),
+  UV_PROCESS_SETGID = (1 << 1),
+  /* Start the child in its own session, so it's not killed with the
+   * parent's process group.
+   */
+  UV_PROCESS_DETACHED = (1 << 3)
+};
+
+/* A program's PATH candidates and copies of its arguments and environment
+ * in one allocation, made by uv_exec_block_init() and reused by any number
+ * of uv_spawn() calls from any thread.
+ */
+struct uv_exec_block_s {
+  char** paths;
+  char** args;
+  char** env;  /* NULL for the parent's environment at spawn time. */
+};
+
+struct uv_process_options_s {
+  uv_exit_cb exit_cb;
+  const char* file;  /* Looked up in PATH like execvp(). */
+  char** args;       /* NULL-terminated, args[0] is the program name. */
+  char** env;        /* NULL to inherit the parent's environment. */
+  const char* cwd;
+  unsigned int flags;
+  int stdio_count;
+  uv_stdio_container_t* stdio;
+  uv_uid_t uid;
+  uv_gid_t gid;
+  /* Used instead of file, args and env when set. */
+  const uv_exec_block_t* exec;
+};
+
+struct uv_process_s {
+  uv_loop_t* loop;
+  unsigned int flags;
+
+  uv_exit_cb exit_cb;
+  int pid;
+  /* Watches the child's pidfd, which becomes readable when it exits. Its fd
+   * is -1 for children reaped on SIGCHLD, see UV_LOOP_PIDFD_LIMIT.
+   */
+  uv__io_t io_watcher;
+  struct uv__queue queue;
+  int status;
+};
+
+struct uv__group_slot;
+
+struct uv_loop_group_s {
+  void* data;
+  unsigned int nloops;
+  unsigned int mailbox_size;
+  /* Per loop: its CPU and thread, and the loop itself while started. */
+  struct uv__group_slot* slots;
+  uv_loop_group_msg_cb msg_cb;
+  uv_loop_group_signal_cb signal_cb;
+  uv_loop_group_cb start_cb;
+  /* Signals uv_loop_group_signal_start() asked for, broadcast from loop 0. */
+  sigset_t signals;
+  int started;
+  /* Set once uv_loop_group_stop() begins, senders still in the mailboxes. */
+  int stopping;
+  unsigned int senders;
+};
+
+enum uv_poll_event {
+  UV_READABLE = 1,
+  UV_WRITABLE = 2,
+  UV_DISCONNECT = 4,
+  UV_PRIORITIZED = 8,
+  /* Modes for uv_poll_start(), never reported to the callback. */
+  UV_EDGE_TRIGGERED = 16,
+  UV_EXCLUSIVE = 32
+};
+
+struct uv_poll_s {
+  uv_loop_t* loop;
+  unsigned int flags;
+
+  uv_poll_cb poll_cb;
+  uv__io_t io_watcher;
+};
+
+/* Internal type, do not use. */
+struct uv__signal_slot {
+  struct uv_signal_s** handles;
+  unsigned int nhandles;
+  unsigned int nholes;
+  unsigned int size;
+  int unsorted;             /* An append broke the order, see signal.c. */
+  unsigned int ninfo;       /* Handles that consume siginfo records. */
+  unsigned int caught;      /* Incremented by the signal handler. */
+  unsigned int dispatched;  /* Read by the handler for UV_SIGNAL_LEAST_LOADED. */
+  uint64_t caught_ns;       /* When the oldest undispatched signal arrived. */
+  unsigned int lost;        /* Records the ring had no room for. */
+};
+
+struct uv__signal_ring;
+struct uv__iou;
+
 struct uv_loop_s {
   /* Loop reference counting. */
   unsigned int active_handles;
   unsigned long flags;                                                      
   int backend_fd;
+  /* The io_uring backend, NULL when the loop uses epoll. */
+  struct uv__iou* iou;
   struct uv__queue watcher_queue;
-  uv__io_t** watchers;
+  /* Watchers by fd: a directory of pages, a page is allocated when the first
+   * fd in it is watched. nwatchers is the number of fds the directory covers.
+   */
+  uv__io_t*** watchers;
   unsigned int nwatchers;
+  unsigned int nwatcher_pages;
+  /* The events uv__io_poll() is dispatching, see
+   * uv__platform_invalidate_fd().
+   */
+  void* watcher_events;
+  unsigned int watcher_nevents;
   unsigned int nfds;
-  int signal_pipefd[2];
+  int signal_wakeup_fd;
   uv__io_t signal_io_watcher;
+  int signal_fd;
+  sigset_t signal_fd_mask;
+  unsigned int signal_fd_refs[UV__NSIG];
+  uv__io_t signal_fd_watcher;
+  /* Handles per signal number, and whether a signal was caught since the
+   * loop last looked at the slots.
+   */
+  struct uv__signal_slot signal_slots[UV__NSIG];
+  int signal_pending;
+  int signal_dispatching;
+  /* siginfo records for uv_signal_start_info() and uv_signal_recv_start()
+   * handles, in arrival order.
+   */
+  struct uv__signal_ring* signal_ring;
+  /* Set while the signalfd is not read because a ring is throttled, see
+   * uv__signal_nthrottled in signal.c. signal_held_gen is the last
+   * generation of handler-blocked signals this thread unblocked.
+   */
+  int signal_fd_stalled;
+  struct uv__queue signal_stalled_queue;
+  unsigned int signal_held_gen;
+  /* Records read from the signalfd since it was last found empty. */
+  unsigned int signal_fd_backlog;
+  uv_signal_stats_t signal_stats;
   uv_signal_t child_watcher;
+  /* Children of this loop reaped on any loop's SIGCHLD, whose exit_cb has
+   * not run yet. Guarded by the process table lock in process.c.
+   */
+  struct uv__queue process_exited;
+  /* Running children with a pidfd, and how many may have one. */
+  unsigned int process_pidfds;
+  unsigned int process_pidfd_limit;
+  /* Checks the children without a pidfd while an exited child that isn't
+   * the loop's hides them from SIGCHLD, see process.c.
+   */
+  uv_timer_t process_timer;
+  /* Active uv_async_t handles, and the eventfd uv_async_send() writes to.
+   * async_pending is set while a wakeup is in flight, so a burst of sends
+   * from any number of threads writes to the eventfd once.
+   */
+  struct uv__queue async_handles;
+  int async_wakeup_fd;
+  uv__io_t async_io_watcher;
+  int async_pending;
+  /* uv_queue_work() requests not completed yet. Workers push finished ones
+   * on work_done, a lock-free stack the loop takes as a whole from
+   * work_async's callback.
+   */
+  unsigned int active_reqs;
+  uv_work_t* work_done;
+  uv_async_t work_async;
+  /* Cached loop time in ms, see uv_update_time(). */
+  uint64_t time;
+  /* Hierarchical timing wheel. A timer is kept at the level of the highest
+   * bit its expiry differs from timer_clock in, the last entry holds timers
+   * beyond the top level. Slots are cascaded one level down when
+   * timer_clock reaches their start; timer_bits marks the non-empty ones.
+   */
+  struct uv__queue timer_wheel[UV__TIMER_LEVELS * UV__TIMER_SLOTS + 1];
+  uint64_t timer_bits[UV__TIMER_LEVELS];
+  uint64_t timer_clock;
+  uint64_t timer_counter;
 };
 
 /* The abstract base class of all handles. */
@@ -121,11 +457,206 @@ struct uv_handle_s {
 int uv_signal_init(uv_loop_t* loop, uv_signal_t* handle);
 int uv_signal_start(uv_signal_t* handle, uv_signal_cb signal_cb, int signum);
 int uv_signal_start_oneshot(uv_signal_t* handle, uv_signal_cb signal_cb, int signum);
+int uv_signal_start_coalesced(uv_signal_t* handle, uv_signal_coalesce_cb coalesce_cb, int signum);
 int uv_signal_stop(uv_signal_t* handle);
 
+/* Like uv_signal_start() but info_cb gets every signal with its siginfo, in
+ * arrival order. When the loop falls behind and its record ring fills up,
+ * real-time signals are left queued in the kernel until it catches up: the
+ * thread that caught one keeps it blocked, the receiver thread stops
+ * waiting for it and signalfd loops stop reading. A thread that does not
+ * run a loop with signal watchers keeps such a signal blocked for good, so
+ * the others get it. Standard signals are not queued by the kernel and may
+ * still merge.
+ */
+int uv_signal_start_info(uv_signal_t* handle, uv_signal_info_cb info_cb, int signum);
+
+/* Which of the loops watching a signal get it. UV_SIGNAL_BROADCAST, what
+ * uv_signal_start() does, wakes up every loop. The others pick exactly one
+ * loop per signal, in turn or the one with the fewest signals not yet
+ * dispatched, whose handles for the signal all run. Every handle watching
+ * {signum}, in any loop, must use the same policy: starting one with
+ * another policy returns EBUSY.
+ */
+typedef enum {
+  UV_SIGNAL_BROADCAST = 0,
+  UV_SIGNAL_ROUND_ROBIN,
+  UV_SIGNAL_LEAST_LOADED
+} uv_signal_policy;
+
+int uv_signal_start_policy(uv_signal_t* handle,
+                           uv_signal_cb signal_cb,
+                           int signum,
+                           uv_signal_policy policy);
+
+/* Start handles[i] on signums[i] with a single trip through the signal lock
+ * and at most one sigaction() per distinct signal. Handles already watching
+ * their signal with uv_signal_start() only get the new callback. On error no
+ * handle changes: EINVAL if a signal is invalid or a handle is listed twice,
+ * EBUSY if a signal is watched with another policy. uv_signal_stop_many() is
+ * the converse; it returns EINVAL and stops nothing if a handle is listed
+ * twice.
+ */
+int uv_signal_start_many(uv_signal_t** handles,
+                         const int* signums,
+                         unsigned int nhandles,
+                         uv_signal_cb signal_cb);
+int uv_signal_stop_many(uv_signal_t** handles, unsigned int nhandles);
+int uv_signal_stats(const uv_signal_t* handle, uv_signal_stats_t* stats);
+int uv_loop_signal_stats(const uv_loop_t* loop, uv_signal_stats_t* stats);
+
+/* Opt in to receiving signals on an internal thread with sigwaitinfo()
+ * instead of in signal handlers. All asynchronous signals are blocked in the
+ * calling thread, so call it from the main thread before any other thread is
+ * created and before any signal watcher is started (EBUSY otherwise).
+ * Signals nobody watches are re-raised on the receiver thread and get their
+ * usual disposition. Takes precedence over UV_LOOP_USE_SIGNALFD.
+ */
+int uv_signal_use_thread(void);
+
+/* Message channels over the real-time signals: channel n is SIGRTMIN + n.
+ * uv_signal_send() and uv_signal_send_pidfd() return EAGAIN when the
+ * receiver's kernel queue is full.
+ */
+int uv_signal_send(int pid, int channel, union sigval value);
+int uv_signal_send_pidfd(int pidfd, int channel, union sigval value);
+int uv_signal_recv_start(uv_signal_t* handle, uv_signal_recv_cb recv_cb, int channel);
+
+/* Start a child process. exit_cb runs on the loop once it exits, with its
+ * exit status or the signal that killed it. If the program can't be run, the
+ * error is returned and no callback runs. The handle keeps the loop alive
+ * until then. The child shares the parent's memory until it calls execve(),
+ * so the cost doesn't grow with the parent's size.
+ *
+ * Each exit is picked up through the child's pidfd, or past the loop's
+ * UV_LOOP_PIDFD_LIMIT on SIGCHLD, on whichever loop sees it first, and
+ * passed to the owning loop. Children not started by uv_spawn() are never
+ * reaped; while one of them is left unreaped, exits on the SIGCHLD path
+ * whose signal was merged with another are seen up to 100 ms late.
+ *
+ * If something else in the process reaps a child first, waitpid(-1) say,
+ * its exit status is lost: exit_cb gets an exit_status of -1 and a
+ * term_signal of 0.
+ */
+int uv_spawn(uv_loop_t* loop,
+             uv_process_t* process,
+             const uv_process_options_t* options);
+int uv_process_kill(uv_process_t* process, int signum);
+int uv_exec_block_init(uv_exec_block_t* block,
+                       const char* file,
+                       char** args,
+                       char** env);
+void uv_exec_block_free(uv_exec_block_t* block);
+int uv_kill(int pid, int signum);
+
+int uv_timer_init(uv_loop_t* loop, uv_timer_t* handle);
+int uv_timer_start(uv_timer_t* handle, uv_timer_cb cb, uint64_t timeout, uint64_t repeat);
+int uv_timer_stop(uv_timer_t* handle);
+int uv_timer_again(uv_timer_t* handle);
+void uv_timer_set_repeat(uv_timer_t* handle, uint64_t repeat);
+uint64_t uv_timer_get_repeat(const uv_timer_t* handle);
+uint64_t uv_timer_get_due_in(const uv_timer_t* handle);
+
+/* Watch a socket or pipe for readiness. The fd is put in non-blocking mode
+ * and must not be closed before the handle is stopped. {status} is EBADF
+ * when epoll reports an error on the fd, the handle is stopped then.
+ *
+ * With UV_EDGE_TRIGGERED the callback runs only when the fd becomes ready
+ * again, it must read or write until EAGAIN. With UV_EXCLUSIVE, when several
+ * loops watch the same file, an event wakes only one of them (or a few);
+ * it can't be combined with UV_DISCONNECT or UV_PRIORITIZED.
+ */
+int uv_poll_init(uv_loop_t* loop, uv_poll_t* handle, int fd);
+int uv_poll_start(uv_poll_t* handle, int events, uv_poll_cb poll_cb);
+int uv_poll_stop(uv_poll_t* handle);
+
+/* Wake the loop from another thread. uv_async_send() is async-signal-safe
+ * and lock-free; sends made before the callback runs are coalesced into one
+ * call. The handle is active from uv_async_init() until uv_async_stop(),
+ * which must not race with uv_async_send() on the same handle.
+ */
+int uv_async_init(uv_loop_t* loop, uv_async_t* handle, uv_async_cb async_cb);
+int uv_async_send(uv_async_t* handle);
+int uv_async_stop(uv_async_t* handle);
+
+/* Run {work_cb} on the thread pool, then {after_work_cb} on the loop thread
+ * with status 0. The loop stays alive until after_work_cb has run. The pool
+ * is shared by all loops and started on first use with one thread per CPU,
+ * or UV_THREADPOOL_SIZE threads if that's set. Its threads block all
+ * signals.
+ */
+int uv_queue_work(uv_loop_t* loop,
+                  uv_work_t* req,
+                  uv_work_cb work_cb,
+                  uv_after_work_cb after_work_cb);
+
+int uv_thread_create(uv_thread_t* tid, uv_thread_cb entry, void* arg);
+int uv_thread_join(uv_thread_t* tid);
+
+/* A group of {nloops} loops, one per CPU if 0, each run by its own thread
+ * pinned to one of the CPUs the process may run on. A loop and its mailbox
+ * are allocated and set up by its thread after pinning, on that CPU's NUMA
+ * node.
+ *
+ * uv_loop_group_send() queues {msg} in the bounded mailbox of loop {index}
+ * and returns EAGAIN when it's full. It may be called from any thread; the
+ * loop drains its mailbox in batches and runs msg_cb for each message in
+ * the order they were queued. uv_loop_group_broadcast() sends to every loop
+ * and returns EAGAIN if any mailbox was full; the other loops still get it.
+ * Once uv_loop_group_stop() has begun both return ECANCELED and queue
+ * nothing; what was queued before is still passed to msg_cb.
+ *
+ * uv_loop_group_signal_start(), called before uv_loop_group_start(), makes
+ * every loop of the group run {signal_cb} once for each {signum} caught. Only
+ * loop 0 watches the signal and forwards the count to the others.
+ *
+ * uv_loop_group_start() runs {start_cb} on each loop's thread before its
+ * loop runs, and returns when all of them are running. uv_loop_group_stop()
+ * makes the loops return, has each thread close its loop and free what it
+ * allocated, and joins the threads; it must not be called from one of them.
+ * Handles started on the loops must be stopped by then, signal watchers
+ * excepted, and their uv_queue_work() requests and children finished. A
+ * stopped group can be started again, with new loops.
+ *
+ * uv_loop_group_close() frees what uv_loop_group_init() allocated. It returns
+ * EBUSY while the group is started.
+ */
+int uv_loop_group_init(uv_loop_group_t* group,
+                       unsigned int nloops,
+                       unsigned int mailbox_size,
+                       uv_loop_group_msg_cb msg_cb);
+int uv_loop_group_signal_start(uv_loop_group_t* group,
+                               uv_loop_group_signal_cb signal_cb,
+                               int signum);
+int uv_loop_group_start(uv_loop_group_t* group, uv_loop_group_cb start_cb);
+int uv_loop_group_stop(uv_loop_group_t* group);
+int uv_loop_group_close(uv_loop_group_t* group);
+uv_loop_t* uv_loop_group_loop(const uv_loop_group_t* group, unsigned int index);
+int uv_loop_group_cpu(const uv_loop_group_t* group, unsigned int index);
+int uv_loop_group_send(uv_loop_group_t* group, unsigned int index, void* msg);
+int uv_loop_group_broadcast(uv_loop_group_t* group, void* msg);
+
 int uv_loop_init(uv_loop_t* loop);
+int uv_loop_configure(uv_loop_t* loop, uv_loop_option option, ...);
+/* UV_RUN_DEFAULT runs until no active handles are left, UV_RUN_ONCE polls
+ * once and blocks if nothing is ready, UV_RUN_NOWAIT polls once without
+ * blocking. Returns non-zero while the loop still has active handles.
+ */
 int uv_run(uv_loop_t*, uv_run_mode mode);
 
+/* For embedding the loop in another event loop: wait for uv_backend_fd() to
+ * become readable, for at most uv_backend_timeout() ms (-1 means no limit),
+ * then call uv_run(loop, UV_RUN_NOWAIT).
+ */
+int uv_backend_fd(const uv_loop_t* loop);
+int uv_backend_timeout(const uv_loop_t* loop);
+
+/* The loop time is read from a coarse monotonic clock once per iteration,
+ * timers are relative to it. uv_update_time() refreshes it.
+ */
+uint64_t uv_now(const uv_loop_t* loop);
+void uv_update_time(uv_loop_t* loop);
+
 void uv_unref(uv_handle_t*);
 
 int uv_pipe(uv_file fds[2], int read_flags, int write_flags);
@@ -0,0 +1,134 @@
+#include "uv.h"
+#include "internal.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+
+static void uv__async_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  struct uv__queue queue;
+  struct uv__queue* q;
+  uv_async_t* handle;
+
+  /* The eventfd is watched edge-triggered, every write is an edge whatever
+   * the counter says, so it is never read. Clear the wakeup before looking
+   * at the handles: a send that comes after this writes again.
+   */
+  __atomic_store_n(&loop->async_pending, 0, __ATOMIC_SEQ_CST);
+
+  /* Callbacks may stop any handle, walk a detached copy of the list. */
+  uv__queue_move(&loop->async_handles, &queue);
+  while (!uv__queue_empty(&queue)) {
+    q = uv__queue_head(&queue);
+    handle = uv__queue_data(q, uv_async_t, queue);
+
+    uv__queue_remove(q);
+    uv__queue_insert_tail(&loop->async_handles, q);
+
+    if (__atomic_exchange_n(&handle->pending, 0, __ATOMIC_SEQ_CST) == 0) {
+      continue;
+    }
+
+    handle->async_cb(handle);
+  }
+}
+
+
+static int uv__async_loop_once_init(uv_loop_t* loop) {
+  if (loop->async_wakeup_fd != -1) {
+    return 0;
+  }
+
+  loop->async_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (loop->async_wakeup_fd == -1) {
+    return errno;
+  }
+
+  uv__io_init(&loop->async_io_watcher, uv__async_io, loop->async_wakeup_fd);
+  uv__io_start(loop, &loop->async_io_watcher, POLLIN | UV__POLLET);
+
+  return 0;
+}
+
+
+int uv_async_init(uv_loop_t* loop, uv_async_t* handle, uv_async_cb async_cb) {
+  int err;
+
+  if (async_cb == NULL) {
+    return EINVAL;
+  }
+
+  err = uv__async_loop_once_init(loop);
+  if (err) {
+    return err;
+  }
+
+  handle->loop = loop;
+  handle->flags = UV_HANDLE_REF | UV_HANDLE_ACTIVE;
+  handle->async_cb = async_cb;
+  handle->pending = 0;
+  uv__queue_insert_tail(&loop->async_handles, &handle->queue);
+  loop->active_handles++;
+
+  return 0;
+}
+
+
+int uv_async_send(uv_async_t* handle) {
+  uv_loop_t* loop;
+  uint64_t one;
+  int r;
+
+  /* Already pending, the callback hasn't run yet. Only the first send needs
+   * the read-modify-write.
+   */
+  if (__atomic_load_n(&handle->pending, __ATOMIC_RELAXED) != 0) {
+    return 0;
+  }
+
+  if (__atomic_exchange_n(&handle->pending, 1, __ATOMIC_SEQ_CST) != 0) {
+    return 0;
+  }
+
+  /* Only one write per loop iteration, whichever handle it is for. */
+  loop = handle->loop;
+  if (__atomic_exchange_n(&loop->async_pending, 1, __ATOMIC_SEQ_CST) != 0) {
+    return 0;
+  }
+
+  one = 1;
+  do {
+    r = write(loop->async_wakeup_fd, &one, sizeof(one));
+  } while (r == -1 && errno == EINTR);
+
+  if (r == sizeof(one)) {
+    return 0;
+  }
+
+  /* EAGAIN means the counter is saturated, it's still readable. */
+  if (errno == EAGAIN) {
+    return 0;
+  }
+
+  abort();
+}
+
+
+int uv_async_stop(uv_async_t* handle) {
+  if ((handle->flags & UV_HANDLE_ACTIVE) == 0) {
+    return 0;
+  }
+
+  uv__queue_remove(&handle->queue);
+  uv__queue_init(&handle->queue);
+
+  handle->flags &= ~UV_HANDLE_ACTIVE;
+  if ((handle->flags & UV_HANDLE_REF) != 0) {
+    handle->loop->active_handles--;
+  }
+
+  return 0;
+}
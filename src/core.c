@@ -5,22 +5,72 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
 
 static int uv__loop_alive(const uv_loop_t* loop) {
-  return loop->active_handles > 0;
+  return loop->active_handles > 0 || loop->active_reqs > 0;
+}
+
+int uv_backend_fd(const uv_loop_t* loop) {
+  return loop->backend_fd;
+}
+
+int uv_backend_timeout(const uv_loop_t* loop) {
+  if (!uv__loop_alive(loop)) {
+    return 0;
+  }
+
+  /* Watchers started since the last poll aren't in the epoll set yet, a host
+   * reactor waiting on uv_backend_fd() wouldn't see their events.
+   */
+  if (!uv__queue_empty(&loop->watcher_queue)) {
+    return 0;
+  }
+
+  return uv__next_timeout(loop);
+}
+
+uint64_t uv_now(const uv_loop_t* loop) {
+  return loop->time;
+}
+
+void uv_update_time(uv_loop_t* loop) {
+  uv__update_time(loop);
 }
 
 int uv_run(uv_loop_t* loop, uv_run_mode mode) {
+  int timeout;
   int r;
 
   r = uv__loop_alive(loop);
+  uv__update_time(loop);
 
-  while (r) {
-    uv__io_poll(loop, -1);
+  /* Timers that are already due run before the first poll in the default
+   * mode, otherwise once per iteration after polling.
+   */
+  if (mode == UV_RUN_DEFAULT && r != 0) {
+    uv__run_timers(loop);
     r = uv__loop_alive(loop);
   }
 
-  return 0;
+  while (r != 0) {
+    timeout = 0;
+    if (mode != UV_RUN_NOWAIT) {
+      timeout = uv_backend_timeout(loop);
+    }
+
+    uv__io_poll(loop, timeout);
+
+    /* uv__io_poll() updates the loop time after waiting. */
+    uv__run_timers(loop);
+    r = uv__loop_alive(loop);
+
+    if (mode == UV_RUN_ONCE || mode == UV_RUN_NOWAIT) {
+      break;
+    }
+  }
+
+  return r;
 }
 
 static unsigned int next_power_of_two(unsigned int val) {
@@ -34,40 +84,64 @@ static unsigned int next_power_of_two(unsigned int val) {
   return val;
 }
 
-static void maybe_resize(uv_loop_t* loop, unsigned int len) {
-  uv__io_t** watchers;
-  void* fake_watcher_list;
-  void* fake_watcher_count;
-  unsigned int nwatchers;
+/* Returns the watcher table entry for {fd}, allocating its page and growing
+ * the page directory as needed. Only pages with watched fds are allocated, a
+ * single high fd costs one page and a directory slot per page below it.
+ */
+static uv__io_t** uv__watcher_slot(uv_loop_t* loop, int fd) {
+  uv__io_t*** watchers;
+  uv__io_t** page;
+  unsigned int npages;
+  unsigned int len;
+  unsigned int n;
   unsigned int i;
 
-  if (len <= loop->nwatchers) {
-    return;
-  }
+  n = (unsigned) fd >> UV__WATCHER_PAGE_BITS;
+  npages = loop->nwatchers >> UV__WATCHER_PAGE_BITS;
+
+  if (n >= npages) {
+    len = next_power_of_two(n + 1);
+    watchers = uv__reallocf(loop->watchers, len * sizeof(loop->watchers[0]));
+    if (watchers == NULL) {
+      abort();
+    }
 
-  /* Preserve fake watcher list and count at the end of the watchers */
-  if (loop->watchers != NULL) {
-    fake_watcher_list = loop->watchers[loop->nwatchers];
-    fake_watcher_count = loop->watchers[loop->nwatchers + 1];
-  } else {
-    fake_watcher_list = NULL;
-    fake_watcher_count = NULL;
+    for (i = npages; i < len; i++) {
+      watchers[i] = NULL;
+    }
+
+    loop->watchers = watchers;
+    loop->nwatchers = len << UV__WATCHER_PAGE_BITS;
   }
 
-  nwatchers = next_power_of_two(len + 2) - 2;
-  watchers = uv__reallocf(loop->watchers, (nwatchers + 2) * sizeof(loop->watchers[0]));
+  page = loop->watchers[n];
+  if (page == NULL) {
+    page = uv__calloc(UV__WATCHER_PAGE_SIZE, sizeof(page[0]));
+    if (page == NULL) {
+      abort();
+    }
 
-  if (watchers == NULL) {
-    abort();
+    loop->watchers[n] = page;
+    loop->nwatcher_pages++;
   }
-  for (i = loop->nwatchers; i < nwatchers; i++) {
-    watchers[i] = NULL;
+
+  return &page[fd & (UV__WATCHER_PAGE_SIZE - 1)];
+}
+
+/* Queue {w} for the next poll if what the kernel has (events) differs from
+ * what's wanted (pevents), or take it off the queue when a change was undone.
+ * Any number of changes between two polls cost at most one syscall.
+ */
+static void uv__io_dirty(uv_loop_t* loop, uv__io_t* w) {
+  if (w->events == w->pevents) {
+    uv__queue_remove(&w->watcher_queue);
+    uv__queue_init(&w->watcher_queue);
+    return;
   }
-  watchers[nwatchers] = fake_watcher_list;
-  watchers[nwatchers + 1] = fake_watcher_count;
 
-  loop->watchers = watchers;
-  loop->nwatchers = nwatchers;
+  if (uv__queue_empty(&w->watcher_queue)) {
+    uv__queue_insert_tail(&loop->watcher_queue, &w->watcher_queue);
+  }
 }
 
 void uv__io_init(uv__io_t* w, uv__io_cb cb, int fd) {
@@ -81,26 +155,86 @@ void uv__io_init(uv__io_t* w, uv__io_cb cb, int fd) {
 }
 
 void uv__io_start(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
-  assert(0 == (events & ~(POLLIN | POLLOUT | UV__POLLRDHUP | UV__POLLPRI)));
-  assert(0 != events);
+  uv__io_t** slot;
+
+  assert(0 == (events & ~(POLLIN | POLLOUT | UV__POLLRDHUP | UV__POLLPRI |
+                          UV__POLLMODES)));
+  assert(0 != (events & ~UV__POLLMODES));
+  /* The mode is fixed while the watcher is active. */
+  assert(w->pevents == 0 ||
+         (w->pevents & UV__POLLMODES) == (events & UV__POLLMODES));
   assert(w->fd >= 0);
   assert(w->fd < INT_MAX);
 
   w->pevents |= events;
-  maybe_resize(loop, w->fd + 1);
+  slot = uv__watcher_slot(loop, w->fd);
 
-  if (w->events == w->pevents) {
+  if (*slot == NULL) {
+    *slot = w;
+    loop->nfds++;
+  }
+
+  uv__io_dirty(loop, w);
+}
+
+void uv__io_stop(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  assert(0 == (events & ~(POLLIN | POLLOUT | UV__POLLRDHUP | UV__POLLPRI)));
+  assert(0 != events);
+
+  if (w->fd == -1) {
     return;
   }
 
-  if (uv__queue_empty(&w->watcher_queue)) {
-    uv__queue_insert_tail(&loop->watcher_queue, &w->watcher_queue);
+  assert(w->fd >= 0);
+
+  w->pevents &= ~events;
+
+  /* The mode goes with the last event. */
+  if ((w->pevents & ~UV__POLLMODES) == 0) {
+    w->pevents = 0;
   }
 
-  if (loop->watchers[w->fd] == NULL) {
-    loop->watchers[w->fd] = w;
-    loop->nfds++;
+  /* Not registered when uv__io_stop() is called on a handle that was never
+   * started. The page stays allocated, the fd is likely to be reused.
+   */
+  if (w->pevents == 0 && w == uv__watcher(loop, w->fd)) {
+    assert(loop->nfds > 0);
+    loop->watchers[w->fd >> UV__WATCHER_PAGE_BITS]
+                  [w->fd & (UV__WATCHER_PAGE_SIZE - 1)] = NULL;
+    loop->nfds--;
   }
+
+  /* The fd stays in the epoll set until the next poll, so stopping and
+   * starting again in the same iteration costs nothing.
+   */
+  uv__io_dirty(loop, w);
+}
+
+void uv__io_close(uv_loop_t* loop, uv__io_t* w) {
+  uv__io_stop(loop, w, POLLIN | POLLOUT | UV__POLLRDHUP | UV__POLLPRI);
+  uv__queue_remove(&w->watcher_queue);
+  uv__queue_init(&w->watcher_queue);
+
+  /* Remove it from the kernel now, the fd may be closed next. */
+  if (w->fd != -1 && w->events != 0) {
+    uv__platform_invalidate_fd(loop, w->fd);
+  }
+
+  w->events = 0;
+}
+
+int uv__nonblock(int fd, int set) {
+  int r;
+
+  do {
+    r = ioctl(fd, FIONBIO, &set);
+  } while (r == -1 && errno == EINTR);
+
+  if (r) {
+    return errno;
+  }
+
+  return 0;
 }
 
 int uv__close(int fd) {
@@ -31,16 +31,69 @@
 # define UV__POLLPRI 0
 #endif
 
+/* Watcher modes, passed to uv__io_start() along with the events. The values
+ * are EPOLLET and EPOLLEXCLUSIVE.
+ */
+#define UV__POLLET (1u << 31)
+#define UV__POLLEXCLUSIVE (1u << 28)
+#define UV__POLLMODES (UV__POLLET | UV__POLLEXCLUSIVE)
+
+typedef enum {
+  UV_CLOCK_PRECISE = 0,  /* Use the highest resolution clock available. */
+  UV_CLOCK_FAST = 1      /* Use the fastest clock with <= 1ms granularity. */
+} uv_clocktype_t;
+
 void uv__io_poll(uv_loop_t* loop, int timeout);
+int uv__io_check_fd(uv_loop_t* loop, int fd);
+void uv__platform_invalidate_fd(uv_loop_t* loop, int fd);
+
+uint64_t uv__hrtime(uv_clocktype_t type);
+
+void uv__timers_init(uv_loop_t* loop);
+void uv__run_timers(uv_loop_t* loop);
+int uv__next_timeout(const uv_loop_t* loop);
 
 int uv__platform_loop_init(uv_loop_t* loop);
+void uv__platform_loop_delete(uv_loop_t* loop);
+
+/* Releases what {loop} owns, for loops that are done running. Its signal
+ * watchers are stopped; other handles must be stopped already, and no
+ * uv_queue_work() request or child process of the loop may be pending.
+ */
+void uv__loop_close(uv_loop_t* loop);
 
 int uv__close(int fd);
 
-int uv__make_pipe(int fds[2], int flags);
+int uv__nonblock(int fd, int set);
 
-void uv__signal_global_once_init(void);
+int uv__make_pipe(int fds[2], int flags);
 
 int uv__process_init(uv_loop_t* loop);
 
+/* For backends that watch the signal eventfd without reading it. */
+void uv__signal_run_pending(uv_loop_t* loop);
+void uv__signal_loop_cleanup(uv_loop_t* loop);
+
+/* The watcher for {fd}, NULL if there is none. */
+UV_UNUSED(static uv__io_t* uv__watcher(const uv_loop_t* loop, int fd)) {
+  uv__io_t** page;
+
+  if ((unsigned) fd >= loop->nwatchers) {
+    return NULL;
+  }
+
+  page = loop->watchers[fd >> UV__WATCHER_PAGE_BITS];
+  if (page == NULL) {
+    return NULL;
+  }
+
+  return page[fd & (UV__WATCHER_PAGE_SIZE - 1)];
+}
+
+UV_UNUSED(static void uv__update_time(uv_loop_t* loop)) {
+  /* Use a fast time source if available.  We only need millisecond precision.
+   */
+  loop->time = uv__hrtime(UV_CLOCK_FAST) / 1000000;
+}
+
 #endif
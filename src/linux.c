@@ -2,97 +2,854 @@
 #include "internal.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <errno.h>
 #include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
-void uv__io_poll(uv_loop_t* loop, int timeout) {
+/* The io_uring backend. Enabled per loop with UV_USE_IO_URING=1 in the
+ * environment at uv_loop_init() time, epoll is used when it isn't set or the
+ * kernel lacks what's needed (5.13+ for multishot poll and update).
+ *
+ * Interest changes and re-arms are queued as SQEs and submitted by the same
+ * io_uring_enter() that waits for completions, so there is no syscall per
+ * fd. Watchers are level-triggered like with epoll: each gets a one-shot
+ * poll that is re-armed after it fires. Edge-triggered watchers and the
+ * signal wakeup eventfd have a multishot poll instead, it posts a completion
+ * per wakeup; the eventfd never needs to be read. The signalfd is watched
+ * like any other fd and read by its watcher, as with epoll: a read queued
+ * in the ring would take signals out of the kernel's queue while the loop
+ * has stopped reading it, see uv__signal_fd_event().
+ */
+#define UV__IOU_ENTRIES 256
+#define UV__IOU_CQ_ENTRIES 4096
+
+/* user_data is kind << 56 | generation << 32 | fd. The generation tells
+ * completions of an fd's current poll from those of a poll it replaced.
+ */
+enum {
+  UV__IOU_IGNORE = 0,
+  UV__IOU_POLL,
+  UV__IOU_WAKEUP
+};
+
+#define UV__IOU_DATA(kind, gen, fd)                                           \
+  ((uint64_t) (kind) << 56 |                                                  \
+   (uint64_t) ((gen) & 0xffffff) << 32 |                                      \
+   (uint32_t) (fd))
+
+struct uv__iou_fd {
+  uint32_t events;  /* Mask of the armed poll, 0 if none. */
+  uint32_t gen;
+};
+
+struct uv__iou {
+  int ringfd;
+  uint32_t* sqhead;
+  uint32_t* sqtail;
+  uint32_t* sqflags;
+  uint32_t sqmask;
+  uint32_t sqentries;
+  uint32_t* cqhead;
+  uint32_t* cqtail;
+  uint32_t cqmask;
+  struct io_uring_cqe* cqes;
+  struct io_uring_sqe* sqes;
+  void* sq;
+  size_t maxlen;
+  size_t sqelen;
+  struct uv__iou_fd* fds;
+  unsigned int nfds;
+};
+
+static int uv__io_dispatch(uv_loop_t* loop, struct epoll_event* events, int nfds);
+
+
+static int uv__io_uring_setup(int entries, struct io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+
+static int uv__io_uring_enter(int fd,
+                              unsigned int to_submit,
+                              unsigned int min_complete,
+                              unsigned int flags,
+                              void* arg,
+                              size_t argsz) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+
+static void uv__epoll_poll(uv_loop_t* loop, int timeout) {
   struct epoll_event events[1024];
-  struct epoll_event* pe;
   struct epoll_event e;
   struct uv__queue* q;
   uv__io_t* w;
+  uint64_t base;
+  int real_timeout;
+  int saved_errno;
   int epollfd;
+  int count;
   int nfds;
   int fd;
   int op;
-  int i;
-
-  assert(timeout >= -1);
 
   epollfd = loop->backend_fd;
 
   memset(&e, 0, sizeof(e));
 
+  /* Only the final state of each watcher changed since the last poll is
+   * pushed to the kernel, see uv__io_dirty().
+   */
   while (!uv__queue_empty(&loop->watcher_queue)) {
     q = uv__queue_head(&loop->watcher_queue);
     w = uv__queue_data(q, uv__io_t, watcher_queue);
     uv__queue_remove(q);
     uv__queue_init(q);
 
-    op = EPOLL_CTL_MOD;
-    if (w->events == 0) {
+    if (w->events == w->pevents) {
+      continue;
+    }
+
+    fd = w->fd;
+    e.events = w->pevents;
+    e.data.fd = fd;
+
+    if (w->pevents == 0) {
+      op = EPOLL_CTL_DEL;
+    } else if (w->events == 0) {
+      op = EPOLL_CTL_ADD;
+    } else {
+      op = EPOLL_CTL_MOD;
+    }
+
+    /* EPOLLEXCLUSIVE can only be set with EPOLL_CTL_ADD, and an exclusive
+     * registration can't be modified; replace it.
+     */
+    if (op == EPOLL_CTL_MOD && ((w->events | w->pevents) & UV__POLLEXCLUSIVE)) {
+      epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, &e);
       op = EPOLL_CTL_ADD;
     }
 
     w->events = w->pevents;
-    e.events = w->pevents;
-    e.data.fd = w->fd;
-    fd = w->fd;
 
     if (!epoll_ctl(epollfd, op, fd, &e)) {
       continue;
     }
 
+    /* The fd may have been closed after it was stopped. */
+    if (op == EPOLL_CTL_DEL) {
+      continue;
+    }
+
+    /* Still in the set from a watcher that was stopped without being
+     * closed and not yet removed.
+     */
     assert(op == EPOLL_CTL_ADD);
     assert(errno == EEXIST);
 
-    if (epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &e)) {
+    if (w->pevents & UV__POLLEXCLUSIVE) {
+      epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, &e);
+      op = EPOLL_CTL_ADD;
+    } else {
+      op = EPOLL_CTL_MOD;
+    }
+
+    if (epoll_ctl(epollfd, op, fd, &e)) {
       abort();
     }
   }
 
+  base = loop->time;
+  real_timeout = timeout;
+  /* Don't keep draining a full event buffer forever. */
+  count = 48;
+
   for (;;) {
     nfds = epoll_wait(epollfd, events, ARRAY_SIZE(events), timeout);
 
-    if (nfds == -1) {
-      assert(errno == EINTR);
-    } else if (nfds == 0) {
+    /* Update loop->time unconditionally. It's tempting to skip the update when
+     * timeout == 0 (i.e. non-blocking poll) but there is no guarantee that the
+     * operating system didn't reschedule our process while in the syscall.
+     */
+    saved_errno = errno;
+    uv__update_time(loop);
+    errno = saved_errno;
+
+    if (nfds == 0) {
       assert(timeout != -1);
+      return;
     }
 
     if (nfds == -1) {
+      assert(errno == EINTR);
+
+      if (timeout == -1) {
+        continue;
+      }
+
+      if (timeout == 0) {
+        return;
+      }
+
+      /* Interrupted by a signal. Update timeout and poll again. */
+      if (loop->time - base >= (uint64_t) real_timeout) {
+        return;
+      }
+
+      timeout = real_timeout - (int) (loop->time - base);
       continue;
     }
 
-    if (nfds == 0) {
-      return;
+    if (uv__io_dispatch(loop, events, nfds)) {
+      loop->signal_io_watcher.cb(loop, &loop->signal_io_watcher, POLLIN);
     }
 
-    for (i = 0; i < nfds; i++) {
-      pe = events + i;
-      fd = pe->data.fd;
+    if (nfds == ARRAY_SIZE(events) && --count != 0) {
+      /* Poll for more events but don't block this time. */
+      timeout = 0;
+      continue;
+    }
+
+    return;
+  }
+}
+
+
+static int uv__io_dispatch(uv_loop_t* loop, struct epoll_event* events, int nfds) {
+  struct epoll_event* pe;
+  uv__io_t* w;
+  int have_signals;
+  int fd;
+  int i;
+
+  have_signals = 0;
+
+  /* Let uv__platform_invalidate_fd() find the events that are still to be
+   * dispatched when a callback stops watching an fd.
+   */
+  assert(loop->watchers != NULL);
+  loop->watcher_events = events;
+  loop->watcher_nevents = nfds;
+
+  for (i = 0; i < nfds; i++) {
+    pe = events + i;
+    fd = pe->data.fd;
+
+    /* Skip invalidated events, see uv__platform_invalidate_fd. */
+    if (fd == -1) {
+      continue;
+    }
+
+    assert(fd >= 0);
+    assert((unsigned) fd < loop->nwatchers);
+
+    w = uv__watcher(loop, fd);
+
+    /* Stopped since the wait, it's removed from the kernel on the next poll. */
+    if (w == NULL) {
+      continue;
+    }
+
+    /* Give users only events they're interested in. Prevents spurious
+     * callbacks when previous callback invocation in this loop has stopped
+     * the current watcher. Also, filters out events that users has not
+     * requested us to watch.
+     */
+    pe->events &= w->pevents | POLLERR | POLLHUP;
+
+    /* Work around an epoll quirk where it sometimes reports just the
+     * EPOLLERR or EPOLLHUP event. In order to force the event loop to
+     * move forward, we merge in the read/write events that the watcher
+     * is interested in; uv__read() and uv__write() will then deal with
+     * the error or hangup in the usual fashion.
+     */
+    if (pe->events == POLLERR || pe->events == POLLHUP) {
+      pe->events |= w->pevents & (POLLIN | POLLOUT | UV__POLLRDHUP | UV__POLLPRI);
+    }
+
+    if (pe->events == 0) {
+      continue;
+    }
+
+    /* Run signal watchers last. This also affects child process watchers
+     * because those are implemented in terms of signal watchers.
+     */
+    if (w == &loop->signal_io_watcher) {
+      have_signals = 1;
+    } else {
+      w->cb(loop, w, pe->events);
+    }
+  }
+
+  loop->watcher_events = NULL;
+  loop->watcher_nevents = 0;
+
+  return have_signals;
+}
+
+
+static struct uv__iou_fd* uv__iou_fd(struct uv__iou* iou, int fd) {
+  struct uv__iou_fd* fds;
+  unsigned int nfds;
+
+  if ((unsigned) fd >= iou->nfds) {
+    nfds = iou->nfds ? iou->nfds : 64;
+    while (nfds <= (unsigned) fd) {
+      nfds *= 2;
+    }
+
+    fds = uv__reallocf(iou->fds, nfds * sizeof(fds[0]));
+    if (fds == NULL) {
+      abort();
+    }
+
+    memset(fds + iou->nfds, 0, (nfds - iou->nfds) * sizeof(fds[0]));
+    iou->fds = fds;
+    iou->nfds = nfds;
+  }
+
+  return &iou->fds[fd];
+}
+
+
+static void uv__iou_submit(struct uv__iou* iou) {
+  uint32_t pending;
+  int rc;
+
+  pending = *iou->sqtail - __atomic_load_n(iou->sqhead, __ATOMIC_ACQUIRE);
+  if (pending == 0) {
+    return;
+  }
+
+  do {
+    rc = uv__io_uring_enter(iou->ringfd, pending, 0, 0, NULL, 0);
+  } while (rc == -1 && errno == EINTR);
+
+  if (rc == -1 && errno != EBUSY && errno != EAGAIN) {
+    abort();
+  }
+}
+
+
+static struct io_uring_sqe* uv__iou_get_sqe(struct uv__iou* iou) {
+  struct io_uring_sqe* sqe;
+  uint32_t head;
+  uint32_t tail;
+
+  tail = *iou->sqtail;
+  head = __atomic_load_n(iou->sqhead, __ATOMIC_ACQUIRE);
+
+  /* Only more than UV__IOU_ENTRIES changes in one iteration get here. */
+  if (tail - head >= iou->sqentries) {
+    uv__iou_submit(iou);
+    head = __atomic_load_n(iou->sqhead, __ATOMIC_ACQUIRE);
+    if (tail - head >= iou->sqentries) {
+      abort();
+    }
+  }
+
+  sqe = &iou->sqes[tail & iou->sqmask];
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+
+static void uv__iou_queue(struct uv__iou* iou) {
+  __atomic_store_n(iou->sqtail, *iou->sqtail + 1, __ATOMIC_RELEASE);
+}
+
+
+static void uv__iou_poll_add(struct uv__iou* iou,
+                             int fd,
+                             unsigned int events,
+                             int kind,
+                             int multishot) {
+  struct io_uring_sqe* sqe;
+  struct uv__iou_fd* f;
+
+  f = uv__iou_fd(iou, fd);
+  f->gen++;
+  f->events = events;
+
+  sqe = uv__iou_get_sqe(iou);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = events & ~UV__POLLET;
+  sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+  sqe->user_data = UV__IOU_DATA(kind, f->gen, fd);
+  uv__iou_queue(iou);
+}
+
+
+static void uv__iou_poll_remove(struct uv__iou* iou, int fd, unsigned int events) {
+  struct io_uring_sqe* sqe;
+  struct uv__iou_fd* f;
+
+  f = uv__iou_fd(iou, fd);
+  if (f->events == 0) {
+    return;
+  }
+
+  sqe = uv__iou_get_sqe(iou);
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->addr = UV__IOU_DATA(UV__IOU_POLL, f->gen, fd);
+  sqe->user_data = UV__IOU_DATA(UV__IOU_IGNORE, 0, fd);
+
+  if (events != 0) {
+    /* Change the mask of the armed poll in place. */
+    sqe->len = IORING_POLL_UPDATE_EVENTS;
+    sqe->poll32_events = events & ~UV__POLLMODES;
+    f->events = events;
+  } else {
+    f->events = 0;
+  }
+
+  uv__iou_queue(iou);
+}
+
+
+static void uv__iou_flush(uv_loop_t* loop, struct uv__iou* iou) {
+  struct uv__iou_fd* f;
+  struct uv__queue* q;
+  uv__io_t* w;
+
+  while (!uv__queue_empty(&loop->watcher_queue)) {
+    q = uv__queue_head(&loop->watcher_queue);
+    w = uv__queue_data(q, uv__io_t, watcher_queue);
+    uv__queue_remove(q);
+    uv__queue_init(q);
+
+    if (w->pevents == 0) {
+      uv__iou_poll_remove(iou, w->fd, 0);
+      w->events = 0;
+      continue;
+    }
+
+    w->events = w->pevents;
+    f = uv__iou_fd(iou, w->fd);
 
-      if (fd == -1) {
+    if (w == &loop->signal_io_watcher) {
+      if (f->events == 0) {
+        uv__iou_poll_add(iou, w->fd, POLLIN, UV__IOU_WAKEUP, 1);
+      }
+      continue;
+    }
+
+    /* The mode of an armed poll can't be updated, replace it. */
+    if (f->events != 0 && ((f->events ^ w->pevents) & UV__POLLMODES)) {
+      uv__iou_poll_remove(iou, w->fd, 0);
+    }
+
+    if (f->events == 0) {
+      uv__iou_poll_add(iou,
+                       w->fd,
+                       w->pevents,
+                       UV__IOU_POLL,
+                       w->pevents & UV__POLLET);
+    } else if (f->events != w->pevents) {
+      uv__iou_poll_remove(iou, w->fd, w->pevents);
+    }
+  }
+}
+
+
+static void uv__iou_requeue(uv_loop_t* loop, int fd) {
+  uv__io_t* w;
+
+  /* The kernel has nothing armed for it anymore. */
+  w = uv__watcher(loop, fd);
+  if (w != NULL) {
+    w->events = 0;
+    if (uv__queue_empty(&w->watcher_queue)) {
+      uv__queue_insert_tail(&loop->watcher_queue, &w->watcher_queue);
+    }
+  }
+}
+
+
+static int uv__iou_reap(uv_loop_t* loop,
+                        struct uv__iou* iou,
+                        struct epoll_event* events,
+                        int maxevents,
+                        int* have_signals) {
+  struct io_uring_cqe* cqe;
+  struct uv__iou_fd* f;
+  uint32_t head;
+  uint32_t tail;
+  int kind;
+  int nfds;
+  int fd;
+
+  nfds = 0;
+  head = *iou->cqhead;
+  tail = __atomic_load_n(iou->cqtail, __ATOMIC_ACQUIRE);
+
+  for (; head != tail && nfds < maxevents; head++) {
+    cqe = &iou->cqes[head & iou->cqmask];
+    kind = cqe->user_data >> 56;
+    fd = (int) (uint32_t) cqe->user_data;
+
+    switch (kind) {
+      case UV__IOU_POLL:
+      case UV__IOU_WAKEUP:
+        f = uv__iou_fd(iou, fd);
+        if (((cqe->user_data >> 32) & 0xffffff) != (f->gen & 0xffffff)) {
+          break;  /* From a poll that was removed or replaced. */
+        }
+
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+          /* The poll is done, arm a new one if the fd is still watched. */
+          f->events = 0;
+          uv__iou_requeue(loop, fd);
+        }
+
+        if (kind == UV__IOU_WAKEUP) {
+          *have_signals = 1;
+          break;
+        }
+
+        if (cqe->res == -ECANCELED) {
+          break;
+        }
+
+        events[nfds].events = cqe->res < 0 ? POLLERR : (uint32_t) cqe->res;
+        events[nfds].data.fd = fd;
+        nfds++;
+        break;
+    }
+  }
+
+  __atomic_store_n(iou->cqhead, head, __ATOMIC_RELEASE);
+
+  return nfds;
+}
+
+
+static void uv__iou_poll(uv_loop_t* loop, int timeout) {
+  struct io_uring_getevents_arg arg;
+  struct epoll_event events[1024];
+  struct __kernel_timespec ts;
+  struct uv__iou* iou;
+  unsigned int flags;
+  uint32_t pending;
+  uint64_t base;
+  int have_signals;
+  int real_timeout;
+  int saved_errno;
+  int count;
+  int nfds;
+  int rc;
+
+  iou = loop->iou;
+
+  base = loop->time;
+  real_timeout = timeout;
+  count = 48;
+
+  for (;;) {
+    uv__iou_flush(loop, iou);
+
+    pending = *iou->sqtail - __atomic_load_n(iou->sqhead, __ATOMIC_ACQUIRE);
+    flags = 0;
+    memset(&arg, 0, sizeof(arg));
+
+    if (timeout != 0) {
+      flags |= IORING_ENTER_GETEVENTS;
+    }
+
+    if (timeout > 0) {
+      ts.tv_sec = timeout / 1000;
+      ts.tv_nsec = (timeout % 1000) * 1000000;
+      arg.ts = (uintptr_t) &ts;
+      flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    /* Completions the kernel couldn't post yet are flushed by an enter. */
+    if (__atomic_load_n(iou->sqflags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW) {
+      flags |= IORING_ENTER_GETEVENTS;
+    }
+
+    /* A non-blocking poll with nothing to submit doesn't need a syscall. */
+    rc = 0;
+    if (pending != 0 || flags != 0) {
+      rc = uv__io_uring_enter(iou->ringfd,
+                              pending,
+                              timeout != 0 ? 1 : 0,
+                              flags,
+                              (flags & IORING_ENTER_EXT_ARG) ? &arg : NULL,
+                              (flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : 0);
+    }
+
+    saved_errno = errno;
+    uv__update_time(loop);
+    errno = saved_errno;
+
+    if (rc == -1 && errno != ETIME && errno != EBUSY) {
+      assert(errno == EINTR);
+    }
+
+    have_signals = 0;
+    nfds = 0;
+    if (rc != -1 || errno != EINTR) {
+      nfds = uv__iou_reap(loop, iou, events, ARRAY_SIZE(events), &have_signals);
+    }
+
+    if (nfds == 0 && !have_signals) {
+      /* Interrupted, timed out, or only completions nobody waits for. */
+      if (timeout == 0 || (rc == -1 && errno == ETIME)) {
+        return;
+      }
+
+      if (timeout == -1) {
         continue;
       }
 
-      assert(fd >= 0);
-      assert((unsigned) fd < loop->nwatchers);
+      if (loop->time - base >= (uint64_t) real_timeout) {
+        return;
+      }
+
+      timeout = real_timeout - (int) (loop->time - base);
+      continue;
+    }
+
+    if (nfds != 0) {
+      have_signals |= uv__io_dispatch(loop, events, nfds);
+    }
+
+    if (have_signals) {
+      uv__signal_run_pending(loop);
+    }
+
+    if (nfds == ARRAY_SIZE(events) && --count != 0) {
+      /* Reap more completions but don't block this time. */
+      timeout = 0;
+      continue;
+    }
+
+    return;
+  }
+}
+
+
+static int uv__iou_init(uv_loop_t* loop) {
+  struct io_uring_params params;
+  struct uv__iou* iou;
+  uint32_t features;
+  size_t sqlen;
+  size_t cqlen;
+  uint32_t i;
+  char* sq;
+  int ringfd;
+
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = UV__IOU_CQ_ENTRIES;
+
+  ringfd = uv__io_uring_setup(UV__IOU_ENTRIES, &params);
+  if (ringfd == -1) {
+    return errno;
+  }
+
+  /* IORING_FEAT_RSRC_TAGS was added in 5.13, with multishot poll and
+   * IORING_POLL_UPDATE_EVENTS.
+   */
+  features = IORING_FEAT_SINGLE_MMAP |
+             IORING_FEAT_NODROP |
+             IORING_FEAT_EXT_ARG |
+             IORING_FEAT_RSRC_TAGS;
+
+  if ((params.features & features) != features) {
+    uv__close(ringfd);
+    return ENOSYS;
+  }
+
+  sqlen = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  cqlen = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+  iou = uv__malloc(sizeof(*iou));
+  if (iou == NULL) {
+    abort();
+  }
+
+  memset(iou, 0, sizeof(*iou));
+  iou->maxlen = sqlen < cqlen ? cqlen : sqlen;
+  iou->sqelen = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  sq = mmap(NULL, iou->maxlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ringfd, IORING_OFF_SQ_RING);
+  iou->sqes = mmap(NULL, iou->sqelen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringfd, IORING_OFF_SQES);
+
+  if (sq == MAP_FAILED || iou->sqes == MAP_FAILED) {
+    if (sq != MAP_FAILED) {
+      munmap(sq, iou->maxlen);
+    }
+    if (iou->sqes != MAP_FAILED) {
+      munmap(iou->sqes, iou->sqelen);
+    }
+    uv__free(iou);
+    uv__close(ringfd);
+    return ENOMEM;
+  }
+
+  iou->ringfd = ringfd;
+  iou->sq = sq;
+  iou->sqhead = (uint32_t*) (sq + params.sq_off.head);
+  iou->sqtail = (uint32_t*) (sq + params.sq_off.tail);
+  iou->sqflags = (uint32_t*) (sq + params.sq_off.flags);
+  iou->sqmask = *(uint32_t*) (sq + params.sq_off.ring_mask);
+  iou->sqentries = *(uint32_t*) (sq + params.sq_off.ring_entries);
+  iou->cqhead = (uint32_t*) (sq + params.cq_off.head);
+  iou->cqtail = (uint32_t*) (sq + params.cq_off.tail);
+  iou->cqmask = *(uint32_t*) (sq + params.cq_off.ring_mask);
+  iou->cqes = (struct io_uring_cqe*) (sq + params.cq_off.cqes);
+
+  /* SQ index i always refers to SQE i. */
+  for (i = 0; i <= iou->sqmask; i++) {
+    ((uint32_t*) (sq + params.sq_off.array))[i] = i;
+  }
+
+  loop->iou = iou;
+  loop->backend_fd = ringfd;
+  return 0;
+}
+
+
+void uv__io_poll(uv_loop_t* loop, int timeout) {
+  assert(timeout >= -1);
+
+  if (loop->iou != NULL) {
+    uv__iou_poll(loop, timeout);
+  } else {
+    uv__epoll_poll(loop, timeout);
+  }
+}
+
+
+void uv__platform_invalidate_fd(uv_loop_t* loop, int fd) {
+  struct epoll_event* events;
+  struct epoll_event dummy;
+  unsigned int i;
+  unsigned int nfds;
+
+  assert(loop->watchers != NULL);
+  assert(fd >= 0);
+
+  events = loop->watcher_events;
+  nfds = loop->watcher_nevents;
+
+  if (events != NULL) {
+    /* Invalidate events with same file descriptor */
+    for (i = 0; i < nfds; i++) {
+      if (events[i].data.fd == fd) {
+        events[i].data.fd = -1;
+      }
+    }
+  }
+
+  if (loop->iou != NULL) {
+    uv__iou_poll_remove(loop->iou, fd, 0);
+    return;
+  }
+
+  /* Remove the file descriptor from the epoll set. This avoids a problem
+   * where the same file description remains open in another process, causing
+   * repeated junk epoll events.
+   *
+   * We pass in a dummy epoll_event, to work around a bug in old kernels.
+   */
+  memset(&dummy, 0, sizeof(dummy));
+  epoll_ctl(loop->backend_fd, EPOLL_CTL_DEL, fd, &dummy);
+}
+
+int uv__io_check_fd(uv_loop_t* loop, int fd) {
+  struct epoll_event e;
+  struct stat st;
+  int rc;
+
+  /* Same answer as epoll without touching the ring. */
+  if (loop->iou != NULL) {
+    if (fstat(fd, &st)) {
+      return errno;
+    }
+
+    if (S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)) {
+      return EPERM;
+    }
 
-      w = loop->watchers[fd];
+    return 0;
+  }
+
+  memset(&e, 0, sizeof(e));
+  e.events = POLLIN;
+  e.data.fd = -1;
 
-      assert(w == &loop->signal_io_watcher);
+  rc = 0;
+  if (epoll_ctl(loop->backend_fd, EPOLL_CTL_ADD, fd, &e)) {
+    if (errno != EEXIST) {
+      rc = errno;
+    }
+  }
+
+  if (rc == 0) {
+    if (epoll_ctl(loop->backend_fd, EPOLL_CTL_DEL, fd, &e)) {
+      abort();
     }
+  }
+
+  return rc;
+}
 
-    loop->signal_io_watcher.cb(loop, &loop->signal_io_watcher, POLLIN);
+uint64_t uv__hrtime(uv_clocktype_t type) {
+  static clockid_t fast_clock_id = -1;
+  struct timespec t;
+  clockid_t clock_id;
 
-    break;
+  /* Prefer CLOCK_MONOTONIC_COARSE if available but only when it has
+   * millisecond granularity or better.  CLOCK_MONOTONIC_COARSE is
+   * serviced entirely from the vDSO, whereas CLOCK_MONOTONIC may
+   * decide to make a costly system call.
+   */
+  clock_id = CLOCK_MONOTONIC;
+  if (type == UV_CLOCK_FAST) {
+    clock_id = __atomic_load_n(&fast_clock_id, __ATOMIC_RELAXED);
+    if (clock_id == -1) {
+      clock_id = CLOCK_MONOTONIC;
+      if (clock_getres(CLOCK_MONOTONIC_COARSE, &t) == 0 &&
+          t.tv_sec == 0 &&
+          t.tv_nsec <= 1 * 1000 * 1000) {
+        clock_id = CLOCK_MONOTONIC_COARSE;
+      }
+      __atomic_store_n(&fast_clock_id, clock_id, __ATOMIC_RELAXED);
+    }
   }
+
+  if (clock_gettime(clock_id, &t)) {
+    return 0;  /* Not really possible. */
+  }
+
+  return t.tv_sec * (uint64_t) 1e9 + t.tv_nsec;
 }
 
 int uv__platform_loop_init(uv_loop_t* loop) {
+  const char* val;
+
+  loop->iou = NULL;
+
+  /* Fall back to epoll quietly when the kernel can't do it. */
+  val = getenv("UV_USE_IO_URING");
+  if (val != NULL && atoi(val) > 0 && uv__iou_init(loop) == 0) {
+    return 0;
+  }
+
   loop->backend_fd = epoll_create(1);
 
   if (loop->backend_fd == -1) {
@@ -101,3 +858,21 @@ int uv__platform_loop_init(uv_loop_t* loop) {
 
   return 0;
 }
+
+void uv__platform_loop_delete(uv_loop_t* loop) {
+  struct uv__iou* iou;
+
+  iou = loop->iou;
+  if (iou != NULL) {
+    munmap(iou->sq, iou->maxlen);
+    munmap(iou->sqes, iou->sqelen);
+    uv__free(iou->fds);
+    uv__free(iou);
+    loop->iou = NULL;
+  }
+
+  if (loop->backend_fd != -1) {
+    uv__close(loop->backend_fd);
+    loop->backend_fd = -1;
+  }
+}
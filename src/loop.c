@@ -1,25 +1,65 @@
 #include "uv.h"
 #include "internal.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+
+static void uv__watchers_free(uv_loop_t* loop) {
+  unsigned int i;
+
+  for (i = 0; i < loop->nwatchers >> UV__WATCHER_PAGE_BITS; i++) {
+    uv__free(loop->watchers[i]);
+  }
+
+  uv__free(loop->watchers);
+  loop->watchers = NULL;
+  loop->nwatchers = 0;
+  loop->nwatcher_pages = 0;
+}
 
 int uv_loop_init(uv_loop_t* loop) {
   int err;
 
   loop->active_handles = 0;
+  loop->flags = 0;
   loop->nfds = 0;
   loop->watchers = NULL;
   loop->nwatchers = 0;
+  loop->nwatcher_pages = 0;
+  loop->watcher_events = NULL;
+  loop->watcher_nevents = 0;
   uv__queue_init(&loop->watcher_queue);
 
-  loop->signal_pipefd[0] = -1;
-  loop->signal_pipefd[1] = -1;
+  uv__queue_init(&loop->async_handles);
+  loop->async_wakeup_fd = -1;
+  loop->async_pending = 0;
+  loop->active_reqs = 0;
+  loop->work_done = NULL;
+  loop->work_async.loop = NULL;
+
+  loop->signal_wakeup_fd = -1;
+  loop->signal_fd = -1;
+  sigemptyset(&loop->signal_fd_mask);
+  memset(loop->signal_fd_refs, 0, sizeof(loop->signal_fd_refs));
+  memset(loop->signal_slots, 0, sizeof(loop->signal_slots));
+  loop->signal_pending = 0;
+  loop->signal_dispatching = 0;
+  loop->signal_ring = NULL;
+  loop->signal_fd_stalled = 0;
+  loop->signal_fd_backlog = 0;
+  uv__queue_init(&loop->signal_stalled_queue);
+  loop->signal_held_gen = 0;
+  memset(&loop->signal_stats, 0, sizeof(loop->signal_stats));
   loop->backend_fd = -1;
 
+  uv__update_time(loop);
+  uv__timers_init(loop);
+
   err = uv__platform_loop_init(loop);
   if (err) {
     goto fail_platform_init;
   }
 
-  uv__signal_global_once_init();
   err = uv__process_init(loop);
   if (err) {
     goto fail_signal_init;
@@ -29,7 +69,36 @@ int uv_loop_init(uv_loop_t* loop) {
 
 fail_signal_init:
 fail_platform_init:
-  uv__free(loop->watchers);
-  loop->nwatchers = 0;
+  uv__watchers_free(loop);
   return err;
 }
+
+void uv__loop_close(uv_loop_t* loop) {
+  uv__signal_loop_cleanup(loop);
+
+  if (loop->async_wakeup_fd != -1) {
+    uv__close(loop->async_wakeup_fd);
+    loop->async_wakeup_fd = -1;
+  }
+
+  uv__platform_loop_delete(loop);
+  uv__watchers_free(loop);
+}
+
+int uv_loop_configure(uv_loop_t* loop, uv_loop_option option, ...) {
+  va_list ap;
+
+  switch (option) {
+    case UV_LOOP_USE_SIGNALFD:
+      loop->flags |= UV_LOOP_SIGNALFD;
+      return 0;
+
+    case UV_LOOP_PIDFD_LIMIT:
+      va_start(ap, option);
+      loop->process_pidfd_limit = va_arg(ap, unsigned int);
+      va_end(ap);
+      return 0;
+  }
+
+  return EINVAL;
+}
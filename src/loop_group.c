@@ -0,0 +1,646 @@
+#include "uv.h"
+#include "internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <string.h>
+
+/* Messages a loop takes from its mailbox per wakeup before it lets other
+ * events in; the rest wait for the next iteration.
+ */
+#define UV__GROUP_BATCH 256
+#define UV__GROUP_MAILBOX_SIZE 1024
+
+/* A mailbox is a bounded ring any number of threads can put messages in and
+ * only its loop takes them out of. Each cell's sequence number tells whose
+ * turn it is: pos when free for the producer that claimed position pos,
+ * pos + 1 once the message is in.
+ */
+struct uv__mailbox_cell {
+  unsigned long seq;
+  void* msg;
+};
+
+/* What a loop's thread allocates and first touches, after pinning. */
+struct uv__group_member {
+  uv_loop_t loop;
+  uv_async_t async;
+  uv_loop_group_t* group;
+  unsigned int index;
+  int stopping;
+  struct uv__mailbox_cell* cells;
+  unsigned long tail;  /* Only touched by the loop. */
+  /* Signal counts forwarded by loop 0, and how many were dispatched. */
+  int signal_pending;
+  unsigned int signal_caught[UV__NSIG];
+  unsigned int signal_seen[UV__NSIG];
+  /* Loop 0 only, the handles that watch the group's signals. */
+  uv_signal_t* signal_handles[UV__NSIG];
+  /* Claimed by producers, apart from what the loop touches. */
+  unsigned long head __attribute__((aligned(64)));
+} __attribute__((aligned(64)));
+
+struct uv__group_slot {
+  struct uv__group_member* member;  /* Set by the thread once it's ready. */
+  uv_loop_group_t* group;
+  unsigned int index;
+  int cpu;
+  int err;
+  int running;
+  uv_thread_t thread;
+  /* Posted by the thread when its loop is running, and again when it has
+   * left it. {release} is posted by uv_loop_group_stop() when it is done
+   * waking the loops up, the thread closes the loop after that.
+   */
+  sem_t* ready;
+  sem_t* release;
+};
+
+
+static int uv__mailbox_put(uv_loop_group_t* group,
+                           struct uv__group_member* m,
+                           void* msg) {
+  struct uv__mailbox_cell* cell;
+  unsigned long pos;
+  unsigned long seq;
+  long diff;
+
+  pos = __atomic_load_n(&m->head, __ATOMIC_RELAXED);
+
+  for (;;) {
+    cell = &m->cells[pos & (group->mailbox_size - 1)];
+    seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    diff = (long) (seq - pos);
+
+    if (diff < 0) {
+      return EAGAIN;  /* The loop hasn't taken the message a lap ago yet. */
+    }
+
+    if (diff > 0) {
+      pos = __atomic_load_n(&m->head, __ATOMIC_RELAXED);
+      continue;
+    }
+
+    if (__atomic_compare_exchange_n(&m->head, &pos, pos + 1, 1,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+
+  cell->msg = msg;
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+
+static int uv__mailbox_take(uv_loop_group_t* group,
+                            struct uv__group_member* m,
+                            void** msg) {
+  struct uv__mailbox_cell* cell;
+
+  cell = &m->cells[m->tail & (group->mailbox_size - 1)];
+  if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != m->tail + 1) {
+    return 0;
+  }
+
+  *msg = cell->msg;
+  __atomic_store_n(&cell->seq, m->tail + group->mailbox_size, __ATOMIC_RELEASE);
+  m->tail++;
+
+  return 1;
+}
+
+
+static void uv__group_signals_run(uv_loop_group_t* group,
+                                  struct uv__group_member* m) {
+  unsigned int caught;
+  unsigned int count;
+  int signum;
+
+  if (__atomic_exchange_n(&m->signal_pending, 0, __ATOMIC_SEQ_CST) == 0) {
+    return;
+  }
+
+  for (signum = 1; signum < UV__NSIG; signum++) {
+    if (!sigismember(&group->signals, signum)) {
+      continue;
+    }
+
+    caught = __atomic_load_n(&m->signal_caught[signum], __ATOMIC_ACQUIRE);
+    count = caught - m->signal_seen[signum];
+    m->signal_seen[signum] = caught;
+
+    while (count-- > 0) {
+      group->signal_cb(group, m->index, signum);
+    }
+  }
+}
+
+
+static void uv__group_async(uv_async_t* handle) {
+  struct uv__group_member* m;
+  uv_loop_group_t* group;
+  unsigned int n;
+  void* msg;
+
+  m = uv__queue_data(handle, struct uv__group_member, async);
+  group = m->group;
+
+  uv__group_signals_run(group, m);
+
+  for (n = 0; n < UV__GROUP_BATCH; n++) {
+    if (!uv__mailbox_take(group, m, &msg)) {
+      return;
+    }
+
+    group->msg_cb(group, m->index, msg);
+  }
+
+  /* More may be queued, come back after the other events. */
+  uv_async_send(handle);
+}
+
+
+static void uv__group_signal(uv_signal_t* handle, int signum, unsigned int count) {
+  struct uv__group_member* leader;
+  struct uv__group_member* m;
+  uv_loop_group_t* group;
+  unsigned int i;
+
+  leader = uv__queue_data(handle->loop, struct uv__group_member, loop);
+  group = leader->group;
+
+  /* Loops that aren't running yet miss it. */
+  for (i = 0; i < group->nloops; i++) {
+    m = __atomic_load_n(&group->slots[i].member, __ATOMIC_ACQUIRE);
+    if (m == NULL) {
+      continue;
+    }
+
+    __atomic_fetch_add(&m->signal_caught[signum], count, __ATOMIC_RELEASE);
+    __atomic_store_n(&m->signal_pending, 1, __ATOMIC_SEQ_CST);
+    uv_async_send(&m->async);
+  }
+}
+
+
+static int uv__group_signals_start(uv_loop_group_t* group,
+                                   struct uv__group_member* m) {
+  uv_signal_t* handle;
+  int signum;
+  int err;
+
+  for (signum = 1; signum < UV__NSIG; signum++) {
+    if (!sigismember(&group->signals, signum)) {
+      continue;
+    }
+
+    handle = uv__malloc(sizeof(*handle));
+    if (handle == NULL) {
+      return ENOMEM;
+    }
+
+    m->signal_handles[signum] = handle;
+    uv_signal_init(&m->loop, handle);
+
+    err = uv_signal_start_coalesced(handle, uv__group_signal, signum);
+    if (err) {
+      return err;
+    }
+  }
+
+  return 0;
+}
+
+
+static void uv__group_signals_stop(struct uv__group_member* m) {
+  int signum;
+
+  for (signum = 1; signum < UV__NSIG; signum++) {
+    if (m->signal_handles[signum] != NULL) {
+      uv_signal_stop(m->signal_handles[signum]);
+      uv__free(m->signal_handles[signum]);
+      m->signal_handles[signum] = NULL;
+    }
+  }
+}
+
+
+static int uv__group_member_init(uv_loop_group_t* group,
+                                 struct uv__group_slot* slot) {
+  struct uv__group_member* m;
+  cpu_set_t set;
+  unsigned long i;
+  int err;
+
+  CPU_ZERO(&set);
+  CPU_SET(slot->cpu, &set);
+  err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (err) {
+    return err;
+  }
+
+  /* First touched from the pinned thread, so it's on the loop's node. */
+  m = uv__malloc_aligned(64, sizeof(*m));
+  if (m == NULL) {
+    return ENOMEM;
+  }
+
+  memset(m, 0, sizeof(*m));
+  m->group = group;
+  m->index = slot->index;
+
+  err = uv_loop_init(&m->loop);
+  if (err) {
+    goto fail_loop;
+  }
+
+  m->cells = uv__malloc(group->mailbox_size * sizeof(m->cells[0]));
+  if (m->cells == NULL) {
+    err = ENOMEM;
+    goto fail_cells;
+  }
+
+  for (i = 0; i < group->mailbox_size; i++) {
+    m->cells[i].seq = i;
+    m->cells[i].msg = NULL;
+  }
+
+  err = uv_async_init(&m->loop, &m->async, uv__group_async);
+  if (err) {
+    goto fail_async;
+  }
+
+  if (m->index == 0) {
+    err = uv__group_signals_start(group, m);
+    if (err) {
+      uv__group_signals_stop(m);
+      uv_async_stop(&m->async);
+      goto fail_async;
+    }
+  }
+
+  __atomic_store_n(&slot->member, m, __ATOMIC_RELEASE);
+  return 0;
+
+fail_async:
+  uv__free(m->cells);
+fail_cells:
+  uv__loop_close(&m->loop);
+fail_loop:
+  uv__free_aligned(m);
+  return err;
+}
+
+
+static void uv__group_member_close(struct uv__group_slot* slot) {
+  struct uv__group_member* m;
+
+  m = slot->member;
+  slot->member = NULL;
+
+  uv_async_stop(&m->async);
+  uv__group_signals_stop(m);
+  uv__loop_close(&m->loop);
+  uv__free(m->cells);
+  uv__free_aligned(m);
+}
+
+
+static void uv__group_thread(void* arg) {
+  struct uv__group_member* m;
+  struct uv__group_slot* slot;
+  uv_loop_group_t* group;
+  void* msg;
+
+  slot = arg;
+  group = slot->group;
+
+  slot->err = uv__group_member_init(group, slot);
+  if (slot->err == 0 && group->start_cb != NULL) {
+    group->start_cb(group, slot->index);
+  }
+
+  /* Read by uv_loop_group_start() once it's been posted. */
+  sem_post(slot->ready);
+
+  if (slot->err) {
+    return;
+  }
+
+  m = slot->member;
+  while (!__atomic_load_n(&m->stopping, __ATOMIC_ACQUIRE)) {
+    uv_run(&m->loop, UV_RUN_ONCE);
+  }
+
+  /* No sender is left, what they queued is still delivered. */
+  while (group->msg_cb != NULL && uv__mailbox_take(group, m, &msg)) {
+    group->msg_cb(group, m->index, msg);
+  }
+
+  /* Loop 0 forwards signals to the others and uv_loop_group_stop() writes
+   * to every eventfd, nothing is closed until all of that is over.
+   */
+  sem_post(slot->ready);
+  while (sem_wait(slot->release) && errno == EINTR) {
+  }
+
+  uv__group_member_close(slot);
+}
+
+
+int uv_loop_group_init(uv_loop_group_t* group,
+                       unsigned int nloops,
+                       unsigned int mailbox_size,
+                       uv_loop_group_msg_cb msg_cb) {
+  cpu_set_t set;
+  unsigned int ncpus;
+  unsigned int i;
+  int cpu;
+
+  if (sched_getaffinity(0, sizeof(set), &set)) {
+    return errno;
+  }
+
+  ncpus = CPU_COUNT(&set);
+  if (nloops == 0) {
+    nloops = ncpus;
+  }
+
+  if (mailbox_size == 0) {
+    mailbox_size = UV__GROUP_MAILBOX_SIZE;
+  }
+
+  if (mailbox_size > 1u << 30) {
+    return EINVAL;
+  }
+
+  /* A power of two, the positions wrap around the ring with a mask. */
+  while (mailbox_size & (mailbox_size - 1)) {
+    mailbox_size += mailbox_size & -mailbox_size;
+  }
+
+  group->slots = uv__calloc(nloops, sizeof(group->slots[0]));
+  if (group->slots == NULL) {
+    return ENOMEM;
+  }
+
+  /* Loops go round-robin over the CPUs the process may use. */
+  cpu = -1;
+  for (i = 0; i < nloops; i++) {
+    do {
+      cpu = (cpu + 1) % CPU_SETSIZE;
+    } while (!CPU_ISSET(cpu, &set));
+
+    group->slots[i].group = group;
+    group->slots[i].index = i;
+    group->slots[i].cpu = cpu;
+  }
+
+  group->nloops = nloops;
+  group->mailbox_size = mailbox_size;
+  group->msg_cb = msg_cb;
+  group->signal_cb = NULL;
+  group->start_cb = NULL;
+  sigemptyset(&group->signals);
+  group->started = 0;
+  group->stopping = 0;
+  group->senders = 0;
+
+  return 0;
+}
+
+
+int uv_loop_group_signal_start(uv_loop_group_t* group,
+                               uv_loop_group_signal_cb signal_cb,
+                               int signum) {
+  if (signal_cb == NULL || signum <= 0 || signum >= UV__NSIG) {
+    return EINVAL;
+  }
+
+  if (group->started) {
+    return EBUSY;
+  }
+
+  if (group->signal_cb != NULL && group->signal_cb != signal_cb) {
+    return EINVAL;
+  }
+
+  group->signal_cb = signal_cb;
+  sigaddset(&group->signals, signum);
+
+  return 0;
+}
+
+
+int uv_loop_group_start(uv_loop_group_t* group, uv_loop_group_cb start_cb) {
+  struct uv__group_slot* slot;
+  sem_t ready;
+  unsigned int i;
+  int err;
+
+  if (group->started) {
+    return EBUSY;
+  }
+
+  if (sem_init(&ready, 0, 0)) {
+    return errno;
+  }
+
+  group->start_cb = start_cb;
+  group->stopping = 0;
+  err = 0;
+
+  for (i = 0; i < group->nloops; i++) {
+    slot = &group->slots[i];
+    slot->err = 0;
+    slot->running = 0;
+    slot->ready = &ready;
+  }
+
+  for (i = 0; i < group->nloops; i++) {
+    slot = &group->slots[i];
+
+    err = uv_thread_create(&slot->thread, uv__group_thread, slot);
+    if (err) {
+      break;
+    }
+
+    slot->running = 1;
+  }
+
+  /* Wait for every thread that started to have its loop set up. */
+  for (i = 0; i < group->nloops && group->slots[i].running; i++) {
+    while (sem_wait(&ready) && errno == EINTR) {
+    }
+  }
+
+  sem_destroy(&ready);
+
+  for (i = 0; i < group->nloops && err == 0; i++) {
+    err = group->slots[i].err;
+  }
+
+  group->started = 1;
+
+  if (err) {
+    uv_loop_group_stop(group);
+  }
+
+  return err;
+}
+
+
+int uv_loop_group_stop(uv_loop_group_t* group) {
+  struct uv__group_member* m;
+  struct uv__group_slot* slot;
+  unsigned int nrunning;
+  sem_t release;
+  sem_t left;
+  unsigned int i;
+
+  if (!group->started) {
+    return EINVAL;
+  }
+
+  if (sem_init(&left, 0, 0)) {
+    return errno;
+  }
+
+  if (sem_init(&release, 0, 0)) {
+    sem_destroy(&left);
+    return errno;
+  }
+
+  /* Senders that got in before this finish before the loops go away, the
+   * ones after it see {stopping} and back out.
+   */
+  __atomic_store_n(&group->stopping, 1, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&group->senders, __ATOMIC_SEQ_CST) != 0) {
+    sched_yield();
+  }
+
+  /* Threads whose setup failed have returned already. */
+  nrunning = 0;
+  for (i = 0; i < group->nloops; i++) {
+    slot = &group->slots[i];
+    if (!slot->running || slot->err) {
+      continue;
+    }
+
+    slot->ready = &left;
+    slot->release = &release;
+    m = slot->member;
+    __atomic_store_n(&m->stopping, 1, __ATOMIC_RELEASE);
+    uv_async_send(&m->async);
+    nrunning++;
+  }
+
+  for (i = 0; i < nrunning; i++) {
+    while (sem_wait(&left) && errno == EINTR) {
+    }
+  }
+
+  for (i = 0; i < nrunning; i++) {
+    sem_post(&release);
+  }
+
+  for (i = 0; i < group->nloops; i++) {
+    slot = &group->slots[i];
+    if (slot->running) {
+      uv_thread_join(&slot->thread);
+      slot->running = 0;
+    }
+  }
+
+  sem_destroy(&release);
+  sem_destroy(&left);
+  group->started = 0;
+
+  return 0;
+}
+
+
+int uv_loop_group_close(uv_loop_group_t* group) {
+  if (group->started) {
+    return EBUSY;
+  }
+
+  uv__free(group->slots);
+  group->slots = NULL;
+  group->nloops = 0;
+
+  return 0;
+}
+
+
+uv_loop_t* uv_loop_group_loop(const uv_loop_group_t* group, unsigned int index) {
+  struct uv__group_member* m;
+
+  if (index >= group->nloops) {
+    return NULL;
+  }
+
+  m = __atomic_load_n(&group->slots[index].member, __ATOMIC_ACQUIRE);
+  if (m == NULL) {
+    return NULL;
+  }
+
+  return &m->loop;
+}
+
+
+int uv_loop_group_cpu(const uv_loop_group_t* group, unsigned int index) {
+  if (index >= group->nloops) {
+    return -1;
+  }
+
+  return group->slots[index].cpu;
+}
+
+
+int uv_loop_group_send(uv_loop_group_t* group, unsigned int index, void* msg) {
+  struct uv__group_member* m;
+  int err;
+
+  if (!group->started || group->msg_cb == NULL || index >= group->nloops) {
+    return EINVAL;
+  }
+
+  /* Counted in before looking at {stopping}, see uv_loop_group_stop(). */
+  __atomic_fetch_add(&group->senders, 1, __ATOMIC_SEQ_CST);
+
+  m = __atomic_load_n(&group->slots[index].member, __ATOMIC_ACQUIRE);
+  if (__atomic_load_n(&group->stopping, __ATOMIC_SEQ_CST) || m == NULL) {
+    err = ECANCELED;
+  } else {
+    err = uv__mailbox_put(group, m, msg);
+    if (err == 0) {
+      uv_async_send(&m->async);
+    }
+  }
+
+  __atomic_fetch_sub(&group->senders, 1, __ATOMIC_RELEASE);
+  return err;
+}
+
+
+int uv_loop_group_broadcast(uv_loop_group_t* group, void* msg) {
+  unsigned int i;
+  int err;
+  int r;
+
+  err = 0;
+  for (i = 0; i < group->nloops; i++) {
+    r = uv_loop_group_send(group, i, msg);
+    if (r) {
+      err = r;
+    }
+  }
+
+  return err;
+}
@@ -0,0 +1,149 @@
+#include "uv.h"
+#include "internal.h"
+
+#include <assert.h>
+#include <errno.h>
+
+
+static void uv__poll_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  uv_poll_t* handle;
+  int pevents;
+
+  handle = uv__queue_data(w, uv_poll_t, io_watcher);
+
+  if ((events & POLLERR) && !(events & UV__POLLPRI)) {
+    uv_poll_stop(handle);
+    handle->poll_cb(handle, EBADF, 0);
+    return;
+  }
+
+  pevents = 0;
+  if (events & POLLIN) {
+    pevents |= UV_READABLE;
+  }
+  if (events & UV__POLLPRI) {
+    pevents |= UV_PRIORITIZED;
+  }
+  if (events & POLLOUT) {
+    pevents |= UV_WRITABLE;
+  }
+  if (events & UV__POLLRDHUP) {
+    pevents |= UV_DISCONNECT;
+  }
+
+  handle->poll_cb(handle, 0, pevents);
+}
+
+
+int uv_poll_init(uv_loop_t* loop, uv_poll_t* handle, int fd) {
+  int err;
+
+  if (fd < 0) {
+    return EBADF;
+  }
+
+  if (uv__watcher(loop, fd) != NULL) {
+    return EEXIST;
+  }
+
+  /* Fails with EPERM for regular files and the like. */
+  err = uv__io_check_fd(loop, fd);
+  if (err) {
+    return err;
+  }
+
+  err = uv__nonblock(fd, 1);
+  if (err) {
+    return err;
+  }
+
+  handle->loop = loop;
+  handle->flags = UV_HANDLE_REF;  /* Ref the loop when active. */
+  handle->poll_cb = NULL;
+  uv__io_init(&handle->io_watcher, uv__poll_io, fd);
+  return 0;
+}
+
+
+int uv_poll_start(uv_poll_t* handle, int pevents, uv_poll_cb poll_cb) {
+  unsigned int events;
+
+  assert((pevents & ~(UV_READABLE | UV_WRITABLE | UV_DISCONNECT |
+                      UV_PRIORITIZED | UV_EDGE_TRIGGERED | UV_EXCLUSIVE)) == 0);
+
+  if (poll_cb == NULL) {
+    return EINVAL;
+  }
+
+  /* epoll only allows EPOLLIN and EPOLLOUT with EPOLLEXCLUSIVE. */
+  if ((pevents & UV_EXCLUSIVE) && (pevents & (UV_DISCONNECT | UV_PRIORITIZED))) {
+    return EINVAL;
+  }
+
+  /* A mode without events. */
+  if (pevents != 0 && (pevents & ~(UV_EDGE_TRIGGERED | UV_EXCLUSIVE)) == 0) {
+    return EINVAL;
+  }
+
+  /* Only the interest set changes, the next poll pushes the difference to
+   * the kernel, if any.
+   */
+  uv__io_stop(handle->loop, &handle->io_watcher,
+              POLLIN | POLLOUT | UV__POLLRDHUP | UV__POLLPRI);
+
+  if (pevents == 0) {
+    uv_poll_stop(handle);
+    return 0;
+  }
+
+  events = 0;
+  if (pevents & UV_READABLE) {
+    events |= POLLIN;
+  }
+  if (pevents & UV_PRIORITIZED) {
+    events |= UV__POLLPRI;
+  }
+  if (pevents & UV_WRITABLE) {
+    events |= POLLOUT;
+  }
+  if (pevents & UV_DISCONNECT) {
+    events |= UV__POLLRDHUP;
+  }
+  if (pevents & UV_EDGE_TRIGGERED) {
+    events |= UV__POLLET;
+  }
+  if (pevents & UV_EXCLUSIVE) {
+    events |= UV__POLLEXCLUSIVE;
+  }
+
+  uv__io_start(handle->loop, &handle->io_watcher, events);
+  handle->poll_cb = poll_cb;
+
+  if ((handle->flags & UV_HANDLE_ACTIVE) != 0) {
+    return 0;
+  }
+  handle->flags |= UV_HANDLE_ACTIVE;
+  if ((handle->flags & UV_HANDLE_REF) != 0) {
+    handle->loop->active_handles++;
+  }
+
+  return 0;
+}
+
+
+int uv_poll_stop(uv_poll_t* handle) {
+  /* Drop the fd from the epoll set and from the events of the current
+   * iteration, so it can be closed right after this returns.
+   */
+  uv__io_close(handle->loop, &handle->io_watcher);
+
+  if ((handle->flags & UV_HANDLE_ACTIVE) == 0) {
+    return 0;
+  }
+  handle->flags &= ~UV_HANDLE_ACTIVE;
+  if ((handle->flags & UV_HANDLE_REF) != 0) {
+    handle->loop->active_handles--;
+  }
+
+  return 0;
+}
@@ -1,9 +1,264 @@
 #include "uv.h"
 #include "internal.h"
 
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef CLONE_PIDFD
+# define CLONE_PIDFD 0x00001000
+#endif
+
+/* The child only runs until execve(), on a stack of its own. */
+#define UV__SPAWN_STACK_SIZE (64 * 1024)
+
+extern char** environ;
+
+/* Children past a loop's pidfd limit, see UV_LOOP_PIDFD_LIMIT. */
+#define UV__PROCESS_PIDFD_LIMIT 256
+
+/* How often a loop checks its children without a pidfd while an exited
+ * child not in the table hides them, see uv__wait_children().
+ */
+#define UV__PROCESS_POLL_MS 100
+
+static pthread_once_t uv__pidfd_once = PTHREAD_ONCE_INIT;
+static int uv__pidfd_supported;
+
+/* Every running child of every loop, by pid. It's open addressing with
+ * linear probing, at most half full. SIGCHLD on a loop with children
+ * without a pidfd reaps whatever has exited and uses it to find the
+ * owner, so the cost of a SIGCHLD doesn't depend on how many children are
+ * still running.
+ */
+struct uv__process_slot {
+  int pid;  /* 0 if the slot is empty. */
+  uv_process_t* process;
+};
+
+static pthread_mutex_t uv__process_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct uv__process_slot* uv__process_slots;
+static unsigned int uv__process_mask;
+/* Children in the table plus slots reserved by spawns in progress. */
+static unsigned int uv__process_count;
+/* The exited child not in the table that the last scan of every child
+ * passed over, see uv__process_collect().
+ */
+static int uv__process_foreign;
+
+
+static void uv__pidfd_probe(void) {
+  int fd;
+
+  fd = syscall(SYS_pidfd_open, getpid(), 0);
+  if (fd != -1) {
+    uv__close(fd);
+    uv__pidfd_supported = 1;
+  }
+}
+
+
+static void uv__process_lock(void) {
+  if (pthread_mutex_lock(&uv__process_mutex)) {
+    abort();
+  }
+}
+
+
+static void uv__process_unlock(void) {
+  if (pthread_mutex_unlock(&uv__process_mutex)) {
+    abort();
+  }
+}
+
+
+static unsigned int uv__process_hash(int pid) {
+  return ((unsigned int) pid * 2654435761u) & uv__process_mask;
+}
+
+
+static void uv__process_insert(uv_process_t* process) {
+  unsigned int i;
+
+  i = uv__process_hash(process->pid);
+  while (uv__process_slots[i].pid != 0) {
+    i = (i + 1) & uv__process_mask;
+  }
+
+  uv__process_slots[i].pid = process->pid;
+  uv__process_slots[i].process = process;
+}
+
+
+static int uv__process_find(int pid) {
+  unsigned int i;
+
+  i = uv__process_hash(pid);
+  while (uv__process_slots[i].pid != pid) {
+    if (uv__process_slots[i].pid == 0) {
+      return -1;
+    }
+    i = (i + 1) & uv__process_mask;
+  }
+
+  return i;
+}
+
+
+/* Empties slot i, moving back the entries after it that would no longer
+ * be found across the hole.
+ */
+static void uv__process_remove(unsigned int i) {
+  unsigned int home;
+  unsigned int j;
+
+  j = i;
+  for (;;) {
+    uv__process_slots[i].pid = 0;
+
+    for (;;) {
+      j = (j + 1) & uv__process_mask;
+      if (uv__process_slots[j].pid == 0) {
+        uv__process_count--;
+        return;
+      }
+
+      home = uv__process_hash(uv__process_slots[j].pid);
+      if (((j - home) & uv__process_mask) >= ((j - i) & uv__process_mask)) {
+        break;
+      }
+    }
+
+    uv__process_slots[i] = uv__process_slots[j];
+    i = j;
+  }
+}
+
+
+/* Makes room for one more child before it's started, so recording it
+ * can't fail once it runs.
+ */
+static int uv__process_reserve(void) {
+  struct uv__process_slot* slots;
+  struct uv__process_slot* old;
+  unsigned int old_mask;
+  unsigned int size;
+  unsigned int i;
+
+  uv__process_lock();
+
+  if ((uv__process_count + 1) * 2 > uv__process_mask + 1 ||
+      uv__process_slots == NULL) {
+    size = uv__process_slots == NULL ? 64 : (uv__process_mask + 1) * 2;
+    slots = uv__calloc(size, sizeof(slots[0]));
+    if (slots == NULL) {
+      uv__process_unlock();
+      return ENOMEM;
+    }
+
+    old = uv__process_slots;
+    old_mask = uv__process_mask;
+    uv__process_slots = slots;
+    uv__process_mask = size - 1;
+
+    if (old != NULL) {
+      for (i = 0; i <= old_mask; i++) {
+        if (old[i].pid != 0) {
+          uv__process_insert(old[i].process);
+        }
+      }
+      uv__free(old);
+    }
+  }
+
+  uv__process_count++;
+  uv__process_unlock();
+  return 0;
+}
+
+
+/* Reaps the child in slot i if it has exited, and hands it to its loop.
+ * Called with the lock held.
+ */
+static int uv__process_reap(unsigned int i) {
+  uv_process_t* process;
+  int status;
+  int pid;
+
+  process = uv__process_slots[i].process;
+
+  do {
+    pid = waitpid(process->pid, &status, WNOHANG);
+  } while (pid == -1 && errno == EINTR);
+
+  if (pid == 0) {
+    return 0;
+  }
+
+  /* ECHILD: somebody else reaped it, the exit status is lost. */
+  if (pid == -1) {
+    if (errno != ECHILD) {
+      abort();
+    }
+    process->flags |= UV_PROCESS_STATUS_LOST;
+    status = 0;
+  }
+
+  process->status = status;
+  uv__process_remove(i);
+  uv__queue_insert_tail(&process->loop->process_exited, &process->queue);
+  return 1;
+}
+
+
+/* Reaps every exited child in the table, or with {loop} set those of its
+ * children without a pidfd. Returns how many of those are still running.
+ * Called with the lock held.
+ */
+static unsigned int uv__process_reap_all(uv_loop_t* loop) {
+  uv_process_t* process;
+  unsigned int running;
+  unsigned int i;
+
+  /* A removal can move a later entry into slot i, look at it again. */
+  running = 0;
+  i = 0;
+  while (i <= uv__process_mask) {
+    process = uv__process_slots[i].process;
+
+    if (uv__process_slots[i].pid == 0 ||
+        (loop != NULL &&
+         (process->loop != loop || process->io_watcher.fd != -1))) {
+      i++;
+    } else if (!uv__process_reap(i)) {
+      running++;
+      i++;
+    }
+  }
+
+  return running;
+}
+
+
 int uv__process_init(uv_loop_t* loop) {
   int err;
 
+  uv__queue_init(&loop->process_exited);
+  loop->process_pidfds = 0;
+  loop->process_pidfd_limit = UV__PROCESS_PIDFD_LIMIT;
+
+  uv_timer_init(loop, &loop->process_timer);
+  uv_unref((uv_handle_t*) &loop->process_timer);
+  loop->process_timer.flags |= UV_HANDLE_INTERNAL;
+
   err = uv_signal_init(loop, &loop->child_watcher);
   if (err) {
     return err;
@@ -24,3 +279,779 @@ int uv__process_init(uv_loop_t* loop) {
   loop->child_watcher.flags |= UV_HANDLE_INTERNAL;
   return 0;
 }
+
+
+static void uv__process_exit(uv_process_t* process) {
+  int64_t exit_status;
+  int term_signal;
+  int status;
+
+  status = process->status;
+  exit_status = 0;
+  term_signal = 0;
+
+  if (process->flags & UV_PROCESS_STATUS_LOST) {
+    exit_status = -1;
+  } else if (WIFEXITED(status)) {
+    exit_status = WEXITSTATUS(status);
+  } else if (WIFSIGNALED(status)) {
+    term_signal = WTERMSIG(status);
+  }
+
+  if (process->io_watcher.fd != -1) {
+    uv__io_close(process->loop, &process->io_watcher);
+    uv__close(process->io_watcher.fd);
+    process->io_watcher.fd = -1;
+    process->loop->process_pidfds--;
+  }
+
+  process->flags &= ~UV_HANDLE_ACTIVE;
+  if ((process->flags & UV_HANDLE_REF) != 0) {
+    process->loop->active_handles--;
+  }
+
+  if (process->exit_cb != NULL) {
+    process->exit_cb(process, exit_status, term_signal);
+  }
+}
+
+
+/* Runs the exit_cb of every child of the loop that has been reaped. Called
+ * with the lock held, which it drops: no exit_cb runs with it held, it may
+ * spawn.
+ */
+static void uv__process_run_exited(uv_loop_t* loop) {
+  struct uv__queue exited;
+  struct uv__queue* q;
+
+  uv__queue_move(&loop->process_exited, &exited);
+  uv__process_unlock();
+
+  while (!uv__queue_empty(&exited)) {
+    q = uv__queue_head(&exited);
+    uv__queue_remove(q);
+    uv__queue_init(q);
+
+    uv__process_exit(uv__queue_data(q, uv_process_t, queue));
+  }
+}
+
+
+static void uv__process_pidfd_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  uv_process_t* process;
+  int slot;
+
+  process = uv__queue_data(w, uv_process_t, io_watcher);
+
+  uv__process_lock();
+
+  /* Not in the table any more if a SIGCHLD scan of some loop got to it
+   * first, it's in process_exited then. Its pid may be another child's by
+   * now.
+   */
+  slot = uv__process_find(process->pid);
+  if (slot != -1 &&
+      uv__process_slots[slot].process == process &&
+      !uv__process_reap(slot)) {
+    uv__process_unlock();
+    return;
+  }
+
+  uv__process_run_exited(loop);
+}
+
+
+/* Reaps the exited children in the table in the order the kernel has
+ * them. Returns 1 if an exited child that isn't in the table is in front.
+ * Called with the lock held.
+ */
+static int uv__process_collect(void) {
+  siginfo_t info;
+  int slot;
+  int r;
+
+  /* WNOWAIT looks at the next exited child without reaping it, children
+   * the process started some other way are left to their owner.
+   */
+  for (;;) {
+    info.si_pid = 0;
+    r = waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT);
+    if (r == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (r == -1) {
+      if (errno != ECHILD) {
+        abort();
+      }
+      return 0;
+    }
+
+    if (info.si_pid == 0) {
+      return 0;
+    }
+
+    slot = uv__process_find(info.si_pid);
+    if (slot == -1) {
+      break;
+    }
+
+    uv__process_reap(slot);
+  }
+
+  /* It stays in front of any of ours that exited after it until its owner
+   * reaps it. Check each of our children once for every such child.
+   */
+  if (info.si_pid != uv__process_foreign) {
+    uv__process_foreign = info.si_pid;
+    uv__process_reap_all(NULL);
+  }
+
+  return 1;
+}
+
+
+static void uv__process_poll(uv_timer_t* timer) {
+  uv__process_lock();
+
+  if (!uv__process_collect() || uv__process_reap_all(timer->loop) == 0) {
+    uv_timer_stop(timer);
+  }
+
+  uv__process_run_exited(timer->loop);
+}
+
+
+static void uv__wait_children(uv_signal_t* handle, const uv_siginfo_t* sig) {
+  uv_loop_t* loop;
+  int slot;
+
+  loop = handle->loop;
+
+  uv__process_lock();
+
+  /* The child the SIGCHLD came from, if it's one of ours, and the loop whose
+   * SIGCHLD runs first reaps it for all loops.
+   */
+  slot = uv__process_find(sig->pid);
+  if (slot != -1) {
+    uv__process_reap(slot);
+  }
+
+  /* A SIGCHLD sent while another is pending is merged with it, so one may
+   * stand for many children. Those behind a child that isn't ours are only
+   * found by asking each one, the loop does that for its own every
+   * UV__PROCESS_POLL_MS until the way is clear.
+   */
+  if (uv__process_collect() &&
+      (loop->process_timer.flags & UV_HANDLE_ACTIVE) == 0) {
+    uv_timer_start(&loop->process_timer,
+                   uv__process_poll,
+                   UV__PROCESS_POLL_MS,
+                   UV__PROCESS_POLL_MS);
+  }
+
+  /* Other loops may have reaped this loop's children before it got here,
+   * take them all.
+   */
+  uv__process_run_exited(loop);
+}
+
+
+static int uv__process_init_stdio(uv_stdio_container_t* container, int fds[2]) {
+  int mask;
+  int err;
+  int fd;
+
+  mask = UV_IGNORE | UV_CREATE_PIPE | UV_INHERIT_FD | UV_INHERIT_STREAM;
+
+  switch (container->flags & mask) {
+    case UV_IGNORE:
+      return 0;
+
+    case UV_CREATE_PIPE:
+      /* fds[0] is the parent's end, fds[1] the child's. */
+      if ((container->flags & (UV_READABLE_PIPE | UV_WRITABLE_PIPE)) ==
+          (UV_READABLE_PIPE | UV_WRITABLE_PIPE)) {
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds)) {
+          return errno;
+        }
+
+        if (container->flags & UV_NONBLOCK_PIPE) {
+          return uv__nonblock(fds[1], 1);
+        }
+
+        return 0;
+      }
+
+      if (container->flags & UV_READABLE_PIPE) {
+        err = uv__make_pipe(fds, container->flags);
+        if (err) {
+          return err;
+        }
+
+        /* The child reads. */
+        fd = fds[0];
+        fds[0] = fds[1];
+        fds[1] = fd;
+        return 0;
+      }
+
+      if (container->flags & UV_WRITABLE_PIPE) {
+        return uv__make_pipe(fds, container->flags);
+      }
+
+      return EINVAL;
+
+    case UV_INHERIT_FD:
+      if (container->data.fd < 0) {
+        return EBADF;
+      }
+
+      fds[1] = container->data.fd;
+      return 0;
+
+    default:
+      /* There are no streams to inherit. */
+      return EINVAL;
+  }
+}
+
+
+/* What the child needs, in the parent's memory. The child may only write
+ * {fds}, a scratch copy of the child's stdio ends, and {err}.
+ */
+struct uv__spawn_child {
+  const uv_process_options_t* options;
+  const uv_exec_block_t* exec;
+  char** env;
+  int stdio_count;
+  int* fds;
+  int err;
+};
+
+
+static void uv__spawn_child_fail(struct uv__spawn_child* child) {
+  child->err = errno;
+  _exit(127);
+}
+
+
+static int uv__spawn_child_init(void* arg) {
+  /* Runs on its own stack in the parent's address space until the execve(),
+   * with the parent thread suspended: no allocations, no locks, nothing
+   * that changes the parent's memory, no signal handlers.
+   */
+  const uv_process_options_t* options;
+  struct uv__spawn_child* child;
+  char* const* path;
+  sigset_t set;
+  int use_fd;
+  int err;
+  int fd;
+  int n;
+
+  child = arg;
+  options = child->options;
+
+  /* The signals stay blocked until no handler of the parent's can run. */
+  for (n = 1; n < UV__NSIG; n++) {
+    if (n == SIGKILL || n == SIGSTOP) {
+      continue;
+    }
+    signal(n, SIG_DFL);
+  }
+
+  if (options->flags & UV_PROCESS_DETACHED) {
+    setsid();
+  }
+
+  /* Move the fds that would be overwritten by an earlier dup2() out of the
+   * way first, or swapping stdout and stderr would send both to one fd.
+   */
+  for (fd = 0; fd < child->stdio_count; fd++) {
+    use_fd = child->fds[fd];
+    if (use_fd < 0 || use_fd >= fd) {
+      continue;
+    }
+
+    child->fds[fd] = fcntl(use_fd, F_DUPFD_CLOEXEC, child->stdio_count);
+    if (child->fds[fd] == -1) {
+      uv__spawn_child_fail(child);
+    }
+  }
+
+  for (fd = 0; fd < child->stdio_count; fd++) {
+    use_fd = child->fds[fd];
+
+    if (use_fd < 0) {
+      if (fd >= 3) {
+        continue;
+      }
+
+      /* Ignored stdio gets /dev/null, a closed fd 0-2 would be reused. */
+      use_fd = open("/dev/null", (fd == 0 ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+      if (use_fd == -1) {
+        uv__spawn_child_fail(child);
+      }
+    }
+
+    if (use_fd == fd) {
+      n = fcntl(fd, F_SETFD, 0);
+    } else {
+      n = dup2(use_fd, fd);
+    }
+
+    if (n == -1) {
+      uv__spawn_child_fail(child);
+    }
+  }
+
+  if (options->cwd != NULL && chdir(options->cwd)) {
+    uv__spawn_child_fail(child);
+  }
+
+  /* The raw system calls change this task only. The libc wrappers would
+   * signal every thread of the parent to change theirs as well.
+   */
+  if (options->flags & (UV_PROCESS_SETUID | UV_PROCESS_SETGID)) {
+    /* Drop the supplementary groups, the child shouldn't keep the parent's.
+     * Fails without CAP_SETGID, which setgid() and setuid() need anyway.
+     */
+    syscall(SYS_setgroups, 0, NULL);
+  }
+
+  if ((options->flags & UV_PROCESS_SETGID) && syscall(SYS_setgid, options->gid)) {
+    uv__spawn_child_fail(child);
+  }
+
+  if ((options->flags & UV_PROCESS_SETUID) && syscall(SYS_setuid, options->uid)) {
+    uv__spawn_child_fail(child);
+  }
+
+  sigemptyset(&set);
+  if (sigprocmask(SIG_SETMASK, &set, NULL)) {
+    uv__spawn_child_fail(child);
+  }
+
+  /* Like execvp(): a candidate that isn't there, or can't be run, moves on
+   * to the next one. EACCES is reported if nothing else went wrong.
+   */
+  err = ENOENT;
+  for (path = child->exec->paths; *path != NULL; path++) {
+    execve(*path, child->exec->args, child->env);
+
+    if (errno == EACCES) {
+      err = EACCES;
+    } else if (errno != ENOENT && errno != ENOTDIR) {
+      err = errno;
+      break;
+    }
+  }
+
+  /* Only now, the parent takes anything but 0 for a failed exec. */
+  child->err = err;
+  _exit(127);
+}
+
+
+int uv_exec_block_init(uv_exec_block_t* block,
+                       const char* file,
+                       char** args,
+                       char** env) {
+  const char* path;
+  const char* end;
+  const char* p;
+  unsigned int npaths;
+  unsigned int nargs;
+  unsigned int nenv;
+  unsigned int i;
+  size_t file_len;
+  size_t size;
+  size_t len;
+  char** ptrs;
+  char* s;
+
+  if (file == NULL || *file == '\0' || args == NULL) {
+    return EINVAL;
+  }
+
+  file_len = strlen(file);
+
+  /* Every PATH entry is a candidate, in order, like execvp() tries them. */
+  path = NULL;
+  npaths = 1;
+  size = file_len + 1;
+
+  if (strchr(file, '/') == NULL) {
+    path = getenv("PATH");
+    if (path == NULL) {
+      path = "/bin:/usr/bin";
+    }
+
+    for (p = path; *p != '\0'; p++) {
+      npaths += *p == ':';
+    }
+
+    size = strlen(path) + npaths * (file_len + 2);
+  }
+
+  for (nargs = 0; args[nargs] != NULL; nargs++) {
+    size += strlen(args[nargs]) + 1;
+  }
+
+  nenv = 0;
+  for (; env != NULL && env[nenv] != NULL; nenv++) {
+    size += strlen(env[nenv]) + 1;
+  }
+
+  ptrs = uv__malloc((npaths + nargs + nenv + 3) * sizeof(ptrs[0]) + size);
+  if (ptrs == NULL) {
+    return ENOMEM;
+  }
+
+  s = (char*) (ptrs + npaths + nargs + nenv + 3);
+
+  block->paths = ptrs;
+  if (path == NULL) {
+    block->paths[0] = s;
+    memcpy(s, file, file_len + 1);
+    s += file_len + 1;
+  } else {
+    for (i = 0, p = path;; i++, p = end + 1) {
+      end = strchr(p, ':');
+      if (end == NULL) {
+        end = p + strlen(p);
+      }
+
+      /* An empty entry is the current directory. */
+      block->paths[i] = s;
+      len = end - p;
+      if (len > 0) {
+        memcpy(s, p, len);
+        s += len;
+        *s++ = '/';
+      }
+      memcpy(s, file, file_len + 1);
+      s += file_len + 1;
+
+      if (*end == '\0') {
+        break;
+      }
+    }
+  }
+  block->paths[npaths] = NULL;
+
+  block->args = block->paths + npaths + 1;
+  for (i = 0; i < nargs; i++) {
+    len = strlen(args[i]) + 1;
+    block->args[i] = memcpy(s, args[i], len);
+    s += len;
+  }
+  block->args[nargs] = NULL;
+
+  block->env = NULL;
+  if (env != NULL) {
+    block->env = block->args + nargs + 1;
+    for (i = 0; i < nenv; i++) {
+      len = strlen(env[i]) + 1;
+      block->env[i] = memcpy(s, env[i], len);
+      s += len;
+    }
+    block->env[nenv] = NULL;
+  }
+
+  return 0;
+}
+
+
+void uv_exec_block_free(uv_exec_block_t* block) {
+  uv__free(block->paths);
+  block->paths = NULL;
+  block->args = NULL;
+  block->env = NULL;
+}
+
+
+/* Returns the pid of the child, or a negated error code if it could not be
+ * started. With {pidfd} non-NULL the child's pidfd is stored there.
+ */
+static int uv__spawn_clone(struct uv__spawn_child* child, int* pidfd) {
+  sigset_t saved;
+  sigset_t all;
+  void* stack;
+  int flags;
+  int pid;
+  int err;
+
+  /* The child shares the parent's memory and gets its own small stack; the
+   * parent sleeps until the child has called execve() or exited, so nothing
+   * is copied however big the parent is.
+   */
+  stack = mmap(NULL,
+               UV__SPAWN_STACK_SIZE,
+               PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,
+               -1,
+               0);
+  if (stack == MAP_FAILED) {
+    return -errno;
+  }
+
+  flags = CLONE_VM | CLONE_VFORK | SIGCHLD;
+  if (pidfd != NULL) {
+    flags |= CLONE_PIDFD;
+  }
+
+  /* A handler of the parent's running in the child would change the
+   * parent's memory. The child unblocks once they're all reset.
+   */
+  sigfillset(&all);
+  if (pthread_sigmask(SIG_SETMASK, &all, &saved)) {
+    abort();
+  }
+
+  child->err = 0;
+  pid = clone(uv__spawn_child_init,
+              (char*) stack + UV__SPAWN_STACK_SIZE,
+              flags,
+              child,
+              pidfd);
+  err = errno;
+
+  if (pthread_sigmask(SIG_SETMASK, &saved, NULL)) {
+    abort();
+  }
+
+  munmap(stack, UV__SPAWN_STACK_SIZE);
+
+  if (pid == -1) {
+    return -err;
+  }
+
+  if (child->err == 0) {
+    return pid;
+  }
+
+  /* The child has exited already, don't leave a zombie behind. */
+  do {
+    err = waitpid(pid, NULL, 0);
+  } while (err == -1 && errno == EINTR);
+
+  if (pidfd != NULL) {
+    uv__close(*pidfd);
+  }
+
+  return -child->err;
+}
+
+
+int uv_spawn(uv_loop_t* loop,
+             uv_process_t* process,
+             const uv_process_options_t* options) {
+  struct uv__spawn_child child;
+  uv_exec_block_t exec;
+  int pipes_storage[8][2];
+  int fds_storage[8];
+  int (*pipes)[2];
+  int stdio_count;
+  int use_pidfd;
+  int pidfd;
+  int pid;
+  int err;
+  int i;
+
+  assert(options->exec != NULL || options->file != NULL);
+  assert(!(options->flags & ~(UV_PROCESS_SETUID |
+                              UV_PROCESS_SETGID |
+                              UV_PROCESS_DETACHED)));
+
+  if (options->stdio_count < 0) {
+    return EINVAL;
+  }
+
+  pthread_once(&uv__pidfd_once, uv__pidfd_probe);
+
+  /* Past the loop's pidfd limit the exit comes as SIGCHLD, watch it before
+   * the child can send it.
+   */
+  use_pidfd = uv__pidfd_supported &&
+              loop->process_pidfds < loop->process_pidfd_limit;
+  if (!use_pidfd) {
+    err = uv_signal_start_info(&loop->child_watcher, uv__wait_children, SIGCHLD);
+    if (err) {
+      return err;
+    }
+  }
+
+  child.exec = options->exec;
+  if (child.exec == NULL) {
+    err = uv_exec_block_init(&exec, options->file, options->args, options->env);
+    if (err) {
+      return err;
+    }
+    child.exec = &exec;
+  }
+
+  stdio_count = options->stdio_count;
+  if (stdio_count < 3) {
+    stdio_count = 3;
+  }
+
+  pipes = pipes_storage;
+  child.fds = fds_storage;
+  if (stdio_count > (int) ARRAY_SIZE(pipes_storage)) {
+    pipes = uv__malloc(stdio_count * (sizeof(pipes[0]) + sizeof(child.fds[0])));
+    if (pipes == NULL) {
+      err = ENOMEM;
+      goto error_exec;
+    }
+    child.fds = (int*) (pipes + stdio_count);
+  }
+
+  for (i = 0; i < stdio_count; i++) {
+    pipes[i][0] = -1;
+    pipes[i][1] = -1;
+  }
+
+  for (i = 0; i < options->stdio_count; i++) {
+    err = uv__process_init_stdio(&options->stdio[i], pipes[i]);
+    if (err) {
+      goto error;
+    }
+  }
+
+  for (i = 0; i < stdio_count; i++) {
+    child.fds[i] = pipes[i][1];
+  }
+
+  child.options = options;
+  child.env = child.exec->env != NULL ? child.exec->env : environ;
+  child.stdio_count = stdio_count;
+
+  err = uv__process_reserve();
+  if (err) {
+    goto error;
+  }
+
+  pidfd = -1;
+  pid = uv__spawn_clone(&child, use_pidfd ? &pidfd : NULL);
+
+  /* Out of descriptors for the pidfd, fall back to SIGCHLD. */
+  if (use_pidfd && (pid == -EMFILE || pid == -ENFILE)) {
+    use_pidfd = 0;
+    err = uv_signal_start_info(&loop->child_watcher, uv__wait_children, SIGCHLD);
+    pid = err ? -err : uv__spawn_clone(&child, NULL);
+  }
+
+  if (pid < 0) {
+    uv__process_lock();
+    uv__process_count--;
+    uv__process_unlock();
+    err = -pid;
+    goto error;
+  }
+
+  for (i = 0; i < options->stdio_count; i++) {
+    if (options->stdio[i].flags & UV_CREATE_PIPE) {
+      uv__close(pipes[i][1]);
+      uv__nonblock(pipes[i][0], 1);
+      options->stdio[i].data.fd = pipes[i][0];
+    }
+  }
+
+  if (pipes != pipes_storage) {
+    uv__free(pipes);
+  }
+
+  if (child.exec == &exec) {
+    uv_exec_block_free(&exec);
+  }
+
+  process->loop = loop;
+  process->flags = UV_HANDLE_REF | UV_HANDLE_ACTIVE;
+  process->exit_cb = options->exit_cb;
+  process->pid = pid;
+  process->status = 0;
+  loop->active_handles++;
+  uv__queue_init(&process->queue);
+
+  uv__io_init(&process->io_watcher, uv__process_pidfd_io, pidfd);
+  if (use_pidfd) {
+    loop->process_pidfds++;
+  }
+
+  /* If another loop's SIGCHLD runs first and passes over the child, it's
+   * still a zombie when this loop's SIGCHLD or pidfd comes round and finds
+   * it here.
+   */
+  uv__process_lock();
+  uv__process_insert(process);
+  uv__process_unlock();
+
+  if (use_pidfd) {
+    uv__io_start(loop, &process->io_watcher, POLLIN);
+  }
+
+  return 0;
+
+error:
+  for (i = 0; i < options->stdio_count; i++) {
+    if ((options->stdio[i].flags & UV_CREATE_PIPE) && pipes[i][0] != -1) {
+      uv__close(pipes[i][0]);
+      uv__close(pipes[i][1]);
+    }
+  }
+
+  if (pipes != pipes_storage) {
+    uv__free(pipes);
+  }
+
+error_exec:
+  if (child.exec == &exec) {
+    uv_exec_block_free(&exec);
+  }
+
+  return err;
+}
+
+
+int uv_process_kill(uv_process_t* process, int signum) {
+  int slot;
+  int err;
+
+  if ((process->flags & UV_HANDLE_ACTIVE) == 0) {
+    return ESRCH;
+  }
+
+  /* The pidfd can't hit a process that reused the pid. */
+  if (process->io_watcher.fd != -1) {
+    if (syscall(SYS_pidfd_send_signal, process->io_watcher.fd, signum, NULL, 0)) {
+      return errno;
+    }
+    return 0;
+  }
+
+  /* Any loop may have reaped the child already and freed its pid for reuse.
+   * Holding the lock keeps it in the table, and unreaped, while it's sent.
+   */
+  uv__process_lock();
+  slot = uv__process_find(process->pid);
+  if (slot == -1 || uv__process_slots[slot].process != process) {
+    err = ESRCH;
+  } else {
+    err = uv_kill(process->pid, signum);
+  }
+  uv__process_unlock();
+
+  return err;
+}
+
+
+int uv_kill(int pid, int signum) {
+  if (kill(pid, signum)) {
+    return errno;
+  }
+
+  return 0;
+}
@@ -19,6 +19,32 @@ static inline struct uv__queue* uv__queue_head(const struct uv__queue* q) {
   return q->next;
 }
 
+static inline void uv__queue_add(struct uv__queue* h, struct uv__queue* n) {
+  h->prev->next = n->next;
+  n->next->prev = h->prev;
+  h->prev = n->prev;
+  h->prev->next = h;
+}
+
+static inline void uv__queue_split(struct uv__queue* h,
+                                   struct uv__queue* q,
+                                   struct uv__queue* n) {
+  n->prev = h->prev;
+  n->prev->next = n;
+  n->next = q;
+  h->prev = q->prev;
+  h->prev->next = h;
+  q->prev = n;
+}
+
+static inline void uv__queue_move(struct uv__queue* h, struct uv__queue* n) {
+  if (uv__queue_empty(h)) {
+    uv__queue_init(n);
+  } else {
+    uv__queue_split(h, h->next, n);
+  }
+}
+
 static inline void uv__queue_insert_tail(struct uv__queue* h, struct uv__queue* q) {
   q->next = h;
   q->prev = h->prev;
@@ -4,896 +4,2383 @@
 #include <assert.h>
 #include <errno.h>
 #include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
 
 #ifndef SA_RESTART
 # define SA_RESTART 0
 #endif
 
-#define RB_BLACK 0
-#define RB_RED   1
-
+#define UV__SIGNAL_CHUNK_SIZE 64
+#define UV__SIGNAL_RING_SIZE 4096
+/* Past this fill a ring is throttled, the rest is left with the kernel. */
+#define UV__SIGNAL_RING_HIGH (UV__SIGNAL_RING_SIZE - UV__SIGNAL_RING_SIZE / 4)
+#define UV__SIGNAL_BATCH 64
+
+/* Handles that consume siginfo records rather than counts. */
+#define UV__SIGNAL_RECORDS (UV_SIGNAL_INFO | UV_SIGNAL_RECV)
+
+/* Handles that want a signal delivered to one loop only. */
+#define UV__SIGNAL_POLICY (UV_SIGNAL_ROTATE | UV_SIGNAL_BALANCE)
+
+/* The loops watching one signal are published to the signal handler as an
+ * immutable snapshot: a list of chunks of entries, sorted by loop. The
+ * handler notifies each loop once and the loop fans the signal out to its
+ * own handles in loop->signal_slots. Writers never modify a published
+ * snapshot, they copy the one chunk they change plus the chunk list, swap
+ * the pointer in uv__signal_table and free the old copies once no reader
+ * can see them.
+ */
 typedef struct {
-  uv_signal_t* handle;
-  int signum;
-} uv__signal_msg_t;
+  uv_loop_t* loop;
+} uv__signal_entry_t;
 
+typedef struct {
+  unsigned int nentries;
+  uv__signal_entry_t entries[UV__SIGNAL_CHUNK_SIZE];
+} uv__signal_chunk_t;
 
-struct uv__signal_tree_s {
-  struct uv_signal_s *rbh_root; /* root of the tree */
+typedef struct {
+  unsigned int nentries;  /* Over all chunks. */
+  unsigned int nchunks;
+  uv__signal_chunk_t* chunks[1];
+} uv__signal_set_t;
+
+/* Bounded multi-producer, single-consumer queue of siginfo records. A cell
+ * is free for the producer that claims position p when its seq is p, and
+ * holds a record for the consumer when its seq is p + 1. Producers claim
+ * positions with a CAS on tail, so pushing never blocks and is safe in a
+ * signal handler.
+ */
+typedef struct {
+  unsigned int seq;
+  uv_siginfo_t info;
+  uint64_t ns;
+} uv__signal_cell_t;
+
+struct uv__signal_ring {
+  unsigned int head;
+  unsigned int tail;
+  int throttled;
+  /* The fill from which receivers are told to back off, see
+   * uv__signal_congested().
+   */
+  unsigned int backoff;
+  uv__signal_cell_t cells[UV__SIGNAL_RING_SIZE];
 };
 
 
-static int uv__signal_unlock(void);
-static int uv__signal_start(uv_signal_t* handle, uv_signal_cb signal_cb, int signum, int oneshot);
+static int uv__signal_start(uv_signal_t* handle, uv_signal_cb signal_cb, int signum, unsigned int flags);
 static void uv__signal_event(uv_loop_t* loop, uv__io_t* w, unsigned int events);
-static int uv__signal_compare(uv_signal_t* w1, uv_signal_t* w2);
+static void uv__signal_fd_event(uv_loop_t* loop, uv__io_t* w, unsigned int events);
 static void uv__signal_stop(uv_signal_t* handle);
 static void uv__signal_unregister_handler(int signum);
 
-static struct uv__signal_tree_s uv__signal_tree = { NULL };
-static int uv__signal_lock_pipefd[2] = { -1, -1 };
-
-
-static void uv__signal_tree_s_RB_INSERT_COLOR(
-  struct uv__signal_tree_s* head, 
-  struct uv_signal_s* elm
-) {
-  struct uv_signal_s *parent, *gparent, *tmp;
-  
-  while ((parent = elm->tree_entry.rbe_parent) != NULL && parent->tree_entry.rbe_color == RB_RED) {
-    gparent = parent->tree_entry.rbe_parent;
-    if (parent == gparent->tree_entry.rbe_left) {
-      tmp = gparent->tree_entry.rbe_right;
-      if (tmp && tmp->tree_entry.rbe_color == RB_RED) {
-        tmp->tree_entry.rbe_color = RB_BLACK;
-        parent->tree_entry.rbe_color = RB_BLACK;
-        gparent->tree_entry.rbe_color = RB_RED;
-        elm = gparent;
-        
-        continue;
-      }
-      if (parent->tree_entry.rbe_right == elm) {
-        tmp = parent->tree_entry.rbe_right;
-        if ((parent->tree_entry.rbe_right = tmp->tree_entry.rbe_left) != NULL) {
-          tmp->tree_entry.rbe_left->tree_entry.rbe_parent = parent;
-        }
-
-        if ((tmp->tree_entry.rbe_parent = parent->tree_entry.rbe_parent) != NULL) {
-          if (parent == parent->tree_entry.rbe_parent->tree_entry.rbe_left) {
-            parent->tree_entry.rbe_parent->tree_entry.rbe_left = tmp;
-          } else {
-            parent->tree_entry.rbe_parent->tree_entry.rbe_right = tmp;
-          }
-        } else {
-          head->rbh_root = tmp;
-        }
-        tmp->tree_entry.rbe_left = parent;
-        parent->tree_entry.rbe_parent = tmp;
-        tmp = parent;
-        parent = elm;
-        elm = tmp;
-      }
+static uv__signal_set_t* uv__signal_table[UV__NSIG];
+static pthread_mutex_t uv__signal_lock_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Started handles per signal number across all loops, and how many of them
+ * aren't one-shot. Protected by the signal lock.
+ */
+static unsigned int uv__signal_nhandles[UV__NSIG];
+static unsigned int uv__signal_nregular[UV__NSIG];
+
+/* The policy bits all handles of a signal share, written with the signal
+ * lock held and read by the handler, and the count it picks loops in turn
+ * with.
+ */
+static unsigned int uv__signal_policy[UV__NSIG];
+static unsigned int uv__signal_rotor[UV__NSIG];
+
+/* Set when the handler for a signal is registered for one-shot watchers
+ * only, and once such a signal was caught, after which the kernel (or the
+ * receiver thread) restored its default disposition. A one-shot watcher
+ * started after that has to register the handler again.
+ */
+static int uv__signal_resethand[UV__NSIG];
+static int uv__signal_disarmed[UV__NSIG];
+
+/* Rings filled past UV__SIGNAL_RING_HIGH. While there are any, a producer
+ * that filled one takes no more of that signal from the kernel, which
+ * queues real-time signals in order: the handler blocks it in the thread it
+ * interrupted, the receiver thread leaves it out of its wait and signalfd
+ * loops stop reading. The rest of the ring is the slack for records that
+ * were already taken. uv__signal_held_gen changes whenever the handler
+ * blocks a signal, loop threads unblock the ones in uv__signal_held once
+ * nothing is throttled. Stalled signalfd loops wait in uv__signal_stalled,
+ * protected by the signal lock.
+ */
+static unsigned int uv__signal_nthrottled;
+static int uv__signal_held[UV__NSIG];
+static unsigned int uv__signal_held_gen;
+static struct uv__queue uv__signal_stalled = {
+  &uv__signal_stalled,
+  &uv__signal_stalled
+};
 
-      parent->tree_entry.rbe_color = RB_BLACK;
-      gparent->tree_entry.rbe_color = RB_RED;
-      
-      tmp = gparent->tree_entry.rbe_left;
-      if ((gparent->tree_entry.rbe_left = tmp->tree_entry.rbe_right) != NULL) {
-        tmp->tree_entry.rbe_right->tree_entry.rbe_parent = gparent;
-      }
-      if ((tmp->tree_entry.rbe_parent = gparent->tree_entry.rbe_parent) != NULL) {
-        if (gparent == gparent->tree_entry.rbe_parent->tree_entry.rbe_left) {
-          gparent->tree_entry.rbe_parent->tree_entry.rbe_left = tmp;
-        } else {
-          gparent->tree_entry.rbe_parent->tree_entry.rbe_right = tmp;
-        }
-      } else {
-        head->rbh_root = tmp;
-      }
-      tmp->tree_entry.rbe_right = gparent;
-      gparent->tree_entry.rbe_parent = tmp;
-    } else {
-      tmp = gparent->tree_entry.rbe_left;
-      if (tmp && tmp->tree_entry.rbe_color == RB_RED) {
-        tmp->tree_entry.rbe_color = RB_BLACK;
-        parent->tree_entry.rbe_color = RB_BLACK;
-        gparent->tree_entry.rbe_color = RB_RED;
-        elm = gparent;
-        
-        continue;
-      }
-      if (parent->tree_entry.rbe_left == elm) {
-        tmp = parent->tree_entry.rbe_left;
-        if ((parent->tree_entry.rbe_left = tmp->tree_entry.rbe_right) != NULL) {
-          tmp->tree_entry.rbe_right->tree_entry.rbe_parent = parent;
-        }
-
-        if ((tmp->tree_entry.rbe_parent = parent->tree_entry.rbe_parent) != NULL) {
-          if (parent == parent->tree_entry.rbe_parent->tree_entry.rbe_left) {
-            parent->tree_entry.rbe_parent->tree_entry.rbe_left = tmp;
-          } else {
-            parent->tree_entry.rbe_parent->tree_entry.rbe_right = tmp;
-          }
-        } else {
-          head->rbh_root = tmp;
-        }
-        tmp->tree_entry.rbe_right = parent;
-        parent->tree_entry.rbe_parent = tmp;
-        tmp = parent;
-        parent = elm;
-        elm = tmp;
-      }
-      parent->tree_entry.rbe_color = RB_BLACK;
-      gparent->tree_entry.rbe_color = RB_RED;
-      tmp = gparent->tree_entry.rbe_right;
-      if ((gparent->tree_entry.rbe_right = tmp->tree_entry.rbe_left) != NULL) {
-        tmp->tree_entry.rbe_left->tree_entry.rbe_parent = gparent;
-      }
-      if ((tmp->tree_entry.rbe_parent = gparent->tree_entry.rbe_parent) != NULL) {
-        if (gparent == gparent->tree_entry.rbe_parent->tree_entry.rbe_left) {
-          gparent->tree_entry.rbe_parent->tree_entry.rbe_left = tmp;
-        } else {
-          gparent->tree_entry.rbe_parent->tree_entry.rbe_right = tmp;
-        }
-      } else {
-        head->rbh_root = tmp;
-      }
-      tmp->tree_entry.rbe_left = gparent;
-      gparent->tree_entry.rbe_parent = tmp;
-    }
-  }
-  head->rbh_root->tree_entry.rbe_color = RB_BLACK;
-}
-
-
-static void uv__signal_tree_s_RB_REMOVE_COLOR(
-  struct uv__signal_tree_s* head, struct uv_signal_s* parent,
-  struct uv_signal_s* elm
-) {
-  struct uv_signal_s* tmp;
-
-  while ((elm == NULL || elm->tree_entry.rbe_color == RB_BLACK) && elm != head->rbh_root) {
-    if (parent->tree_entry.rbe_left == elm) {
-      tmp = parent->tree_entry.rbe_right;
-      if (tmp->tree_entry.rbe_color == RB_RED) {
-        tmp->tree_entry.rbe_color = RB_BLACK;
-        parent->tree_entry.rbe_color = RB_RED;
-        tmp = parent->tree_entry.rbe_right;
-        if ((parent->tree_entry.rbe_right = tmp->tree_entry.rbe_left) != NULL) {
-          tmp->tree_entry.rbe_left->tree_entry.rbe_parent = parent;
-        }
-        if ((tmp->tree_entry.rbe_parent = parent->tree_entry.rbe_parent) != NULL) {
-          if (parent == parent->tree_entry.rbe_parent->tree_entry.rbe_left) {
-            parent->tree_entry.rbe_parent->tree_entry.rbe_left = tmp;
-          } else {
-            parent->tree_entry.rbe_parent->tree_entry.rbe_right = tmp;
-          }
-        } else {
-          head->rbh_root = tmp;
-        }
-        tmp->tree_entry.rbe_left = parent;
-        parent->tree_entry.rbe_parent = tmp;
-        tmp = parent->tree_entry.rbe_right;
-      }
-      if ((tmp->tree_entry.rbe_left == NULL || tmp->tree_entry.rbe_left->tree_entry.rbe_color == RB_BLACK) &&
-          (tmp->tree_entry.rbe_right == NULL || tmp->tree_entry.rbe_right->tree_entry.rbe_color == RB_BLACK)) {
-        tmp->tree_entry.rbe_color = RB_RED;
-        elm = parent;
-        parent = elm->tree_entry.rbe_parent;
-      } else {
-        if (tmp->tree_entry.rbe_right == NULL || tmp->tree_entry.rbe_right->tree_entry.rbe_color == RB_BLACK) {
-          struct uv_signal_s* oleft;
-          
-          if ((oleft = tmp->tree_entry.rbe_left) != NULL) {
-            oleft->tree_entry.rbe_color = RB_BLACK;
-          }
-          tmp->tree_entry.rbe_color = RB_RED;
-          oleft = tmp->tree_entry.rbe_left;
-          if ((tmp->tree_entry.rbe_left = oleft->tree_entry.rbe_right) != NULL) {
-            oleft->tree_entry.rbe_right->tree_entry.rbe_parent = tmp;
-          }
-          if ((oleft->tree_entry.rbe_parent = tmp->tree_entry.rbe_parent) != NULL) {
-            if (tmp == tmp->tree_entry.rbe_parent->tree_entry.rbe_left) {
-              tmp->tree_entry.rbe_parent->tree_entry.rbe_left = oleft;
-            } else {
-              tmp->tree_entry.rbe_parent->tree_entry.rbe_right = oleft;
-            }
-          } else {
-            head->rbh_root = oleft;
-          }
-          oleft->tree_entry.rbe_right = tmp;
-          tmp->tree_entry.rbe_parent = oleft;
-          tmp = parent->tree_entry.rbe_right;
-        }
-        tmp->tree_entry.rbe_color = parent->tree_entry.rbe_color;
-        parent->tree_entry.rbe_color = RB_BLACK;
-        if (tmp->tree_entry.rbe_right) {
-          (tmp->tree_entry.rbe_right)->tree_entry.rbe_color = RB_BLACK;
-        }
-        tmp = parent->tree_entry.rbe_right;
-        if ((parent->tree_entry.rbe_right = tmp->tree_entry.rbe_left) != NULL) {
-          tmp->tree_entry.rbe_left->tree_entry.rbe_parent = parent;
-        }
-        if ((tmp->tree_entry.rbe_parent = parent->tree_entry.rbe_parent) != NULL) {
-          if (parent == parent->tree_entry.rbe_parent->tree_entry.rbe_left) {
-            parent->tree_entry.rbe_parent->tree_entry.rbe_left = tmp;
-          } else {
-            parent->tree_entry.rbe_parent->tree_entry.rbe_right = tmp;
-          }
-        } else {
-          head->rbh_root = tmp;
-        }
-        tmp->tree_entry.rbe_left = parent;
-        parent->tree_entry.rbe_parent = tmp;
-        elm = head->rbh_root;
-        
-        break;
-      }
-    } else {
-      tmp = parent->tree_entry.rbe_left;
-      if (tmp->tree_entry.rbe_color == RB_RED) {
-        tmp->tree_entry.rbe_color = RB_BLACK;
-        parent->tree_entry.rbe_color = RB_RED;
-        tmp = parent->tree_entry.rbe_left;
-        if ((parent->tree_entry.rbe_left = tmp->tree_entry.rbe_right) != NULL) {
-          tmp->tree_entry.rbe_right->tree_entry.rbe_parent = parent;
-        }
-
-        if ((tmp->tree_entry.rbe_parent = parent->tree_entry.rbe_parent) != NULL) {
-          if (parent == parent->tree_entry.rbe_parent->tree_entry.rbe_left) {
-            parent->tree_entry.rbe_parent->tree_entry.rbe_left = tmp;
-          } else {
-            parent->tree_entry.rbe_parent->tree_entry.rbe_right = tmp;
-          }
-        } else {
-          head->rbh_root = tmp;
-        }
-        tmp->tree_entry.rbe_right = parent;
-        parent->tree_entry.rbe_parent = tmp;
-        tmp = parent->tree_entry.rbe_left;
-      }
-      if ((tmp->tree_entry.rbe_left == NULL || tmp->tree_entry.rbe_left->tree_entry.rbe_color == RB_BLACK) &&
-          (tmp->tree_entry.rbe_right == NULL || tmp->tree_entry.rbe_right->tree_entry.rbe_color == RB_BLACK)) {
-        tmp->tree_entry.rbe_color = RB_RED;
-        elm = parent;
-        parent = elm->tree_entry.rbe_parent;
-      } else {
-        if (tmp->tree_entry.rbe_left == NULL || tmp->tree_entry.rbe_left->tree_entry.rbe_color == RB_BLACK) {
-          struct uv_signal_s* oright;
-          
-          if ((oright = tmp->tree_entry.rbe_right) != NULL) {
-            oright->tree_entry.rbe_color = RB_BLACK;
-          }
-          tmp->tree_entry.rbe_color = RB_RED;
-          oright = tmp->tree_entry.rbe_right;
-          if ((tmp->tree_entry.rbe_right = oright->tree_entry.rbe_left) != NULL) {
-            oright->tree_entry.rbe_left->tree_entry.rbe_parent = tmp;
-          }
-          if ((oright->tree_entry.rbe_parent = tmp->tree_entry.rbe_parent) != NULL) {
-            if (tmp == tmp->tree_entry.rbe_parent->tree_entry.rbe_left) {
-              tmp->tree_entry.rbe_parent->tree_entry.rbe_left = oright;
-            } else {
-              tmp->tree_entry.rbe_parent->tree_entry.rbe_right = oright;
-            }
-          } else {
-            head->rbh_root = oright;
-          }
-          oright->tree_entry.rbe_left = tmp;
-          tmp->tree_entry.rbe_parent = oright;
-          tmp = parent->tree_entry.rbe_left;
-        }
-        tmp->tree_entry.rbe_color = parent->tree_entry.rbe_color;
-        parent->tree_entry.rbe_color = RB_BLACK;
-        if (tmp->tree_entry.rbe_left) {
-          tmp->tree_entry.rbe_left->tree_entry.rbe_color = RB_BLACK;
-        }
-        tmp = parent->tree_entry.rbe_left;
-        if ((parent->tree_entry.rbe_left = tmp->tree_entry.rbe_right) != NULL) {
-          tmp->tree_entry.rbe_right->tree_entry.rbe_parent = parent;
-        }
-        if ((tmp->tree_entry.rbe_parent = parent->tree_entry.rbe_parent) != NULL) {
-          if (parent == parent->tree_entry.rbe_parent->tree_entry.rbe_left) {
-            parent->tree_entry.rbe_parent->tree_entry.rbe_left = tmp;
-          } else {
-            parent->tree_entry.rbe_parent->tree_entry.rbe_right = tmp;
-          }
-        } else {
-          head->rbh_root = tmp;
-        }
-        tmp->tree_entry.rbe_right = parent;
-        parent->tree_entry.rbe_parent = tmp;
-        elm = head->rbh_root;
-        
-        break;
-      }
-    }
-  }
-  
-  if (elm) {
-    elm->tree_entry.rbe_color = RB_BLACK;
+/* Readers announce themselves in the counter selected by the low bit of the
+ * epoch. A writer flips the epoch after publishing and waits for the
+ * counter of the previous epoch to drain.
+ */
+static unsigned int uv__signal_epoch;
+static unsigned int uv__signal_readers[2];
+
+/* While a uv_signal_start_many() or uv_signal_stop_many() batch holds the
+ * lock, loops joining or leaving a signal's snapshot are collected in
+ * uv__signal_changes and every touched snapshot is rebuilt once at the end
+ * of the batch. Replaced snapshots are freed after a single
+ * uv__signal_synchronize().
+ */
+typedef struct {
+  int signum;
+  int add;
+  uv_loop_t* loop;
+} uv__signal_change_t;
+
+static int uv__signal_batching;
+static uv__signal_change_t* uv__signal_changes;
+static unsigned int uv__signal_nchanges;
+static unsigned int uv__signal_changes_size;
+static void** uv__signal_retired;
+static unsigned int uv__signal_nretired;
+static unsigned int uv__signal_retired_size;
+
+/* Receiver thread mode, see uv_signal_use_thread(). uv__signal_thread_set
+ * holds the signals that are blocked everywhere and waited for by the
+ * receiver thread, uv__signal_thread_action what it does when one arrives.
+ */
+enum {
+  UV__SIGNAL_FORWARD = 0,  /* Nobody watches it, apply its disposition. */
+  UV__SIGNAL_DELIVER,
+  UV__SIGNAL_DELIVER_ONCE  /* Only one-shot watchers, then forward again. */
+};
+
+static int uv__signal_thread_enabled;
+static sigset_t uv__signal_thread_set;
+static int uv__signal_thread_action[UV__NSIG];
+
+
+static void uv__signal_lock(void) {
+  /* Serializes writers only, the signal handler never takes this lock. */
+  if (pthread_mutex_lock(&uv__signal_lock_mutex)) {
+    abort();
   }
 }
 
 
-static struct uv_signal_s* uv__signal_tree_s_RB_REMOVE(
-  struct uv__signal_tree_s* head, 
-  struct uv_signal_s* elm
-) {
-  struct uv_signal_s *child, *parent, *old = elm;
-  int color;
-  
-  if (elm->tree_entry.rbe_left == NULL) {
-    child = elm->tree_entry.rbe_right;
-  } else if (elm->tree_entry.rbe_right == NULL) {
-    child = elm->tree_entry.rbe_left;
-  } else {
-    struct uv_signal_s* left;
-    
-    elm = elm->tree_entry.rbe_right;
-    while ((left = elm->tree_entry.rbe_left) != NULL) {
-      elm = left;
-    }
-    child = elm->tree_entry.rbe_right;
-    parent = elm->tree_entry.rbe_parent;
-    color = elm->tree_entry.rbe_color;
-    if (child) {
-      child->tree_entry.rbe_parent = parent;
-    }
-    if (parent) {
-      if (parent->tree_entry.rbe_left == elm) {
-        parent->tree_entry.rbe_left = child;
-      } else {
-        parent->tree_entry.rbe_right = child;
-      }
-    } else {
-      head->rbh_root = child;
-    }
-    if (elm->tree_entry.rbe_parent == old) {
-      parent = elm;
-    }
-    elm->tree_entry = old->tree_entry;
-    if (old->tree_entry.rbe_parent) {
-      if (old->tree_entry.rbe_parent->tree_entry.rbe_left == old) {
-        old->tree_entry.rbe_parent->tree_entry.rbe_left = elm;
-      } else {
-        old->tree_entry.rbe_parent->tree_entry.rbe_right = elm;
-      }
-    } else {
-      head->rbh_root = elm;
-    }
-    old->tree_entry.rbe_left->tree_entry.rbe_parent = elm;
-    if (old->tree_entry.rbe_right) {
-      old->tree_entry.rbe_right->tree_entry.rbe_parent = elm;
-    }
-    if (parent) {
-      left = parent;
-      while ((left = left->tree_entry.rbe_parent) != NULL) {}
-    }
-    goto color;
-  }
-  parent = elm->tree_entry.rbe_parent;
-  color = elm->tree_entry.rbe_color;
-  if (child) {
-    child->tree_entry.rbe_parent = parent;
-  }
-  if (parent) {
-    if (parent->tree_entry.rbe_left == elm) {
-      parent->tree_entry.rbe_left = child;
-    } else {
-      parent->tree_entry.rbe_right = child;
-    }
-  } else {
-    head->rbh_root = child;
-  }
-color:
-  if (color == 0) {
-    uv__signal_tree_s_RB_REMOVE_COLOR(head, parent, child);
-  }
-
-  return (old);
-}
-
-
-static struct uv_signal_s* uv__signal_tree_s_RB_INSERT(
-  struct uv__signal_tree_s* head, 
-  struct uv_signal_s* elm
-) {
-  struct uv_signal_s* tmp;
-  struct uv_signal_s* parent = NULL;
-  
-  int comp = 0;
-  tmp = head->rbh_root;
-  
-  while (tmp) {
-    parent = tmp;
-    comp = uv__signal_compare(elm, parent);
-    if (comp < 0) {
-      tmp = tmp->tree_entry.rbe_left;
-    } else if (comp > 0) {
-      tmp = tmp->tree_entry.rbe_right;
-    } else {
-      return tmp;
-    }
+static void uv__signal_unlock(void) {
+  if (pthread_mutex_unlock(&uv__signal_lock_mutex)) {
+    abort();
   }
-  elm->tree_entry.rbe_parent = parent;
-  elm->tree_entry.rbe_left = elm->tree_entry.rbe_right = NULL;
-  elm->tree_entry.rbe_color = RB_RED;
-  if (parent != NULL) {
-    if (comp < 0) {
-      parent->tree_entry.rbe_left = elm;
-    } else {
-      parent->tree_entry.rbe_right = elm;
+}
+
+
+static unsigned int uv__signal_read_begin(void) {
+  /* Async-signal-safe: this never blocks and makes no syscalls. It only
+   * retries when a writer flips the epoch at the same time.
+   */
+  unsigned int epoch;
+
+  for (;;) {
+    epoch = __atomic_load_n(&uv__signal_epoch, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&uv__signal_readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&uv__signal_epoch, __ATOMIC_SEQ_CST) == epoch) {
+      return epoch;
     }
-  } else {
-    head->rbh_root = elm;
+
+    __atomic_fetch_sub(&uv__signal_readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
   }
-  
-  uv__signal_tree_s_RB_INSERT_COLOR(head, elm);
-  
-  return NULL;
 }
 
 
-static struct uv_signal_s* uv__signal_tree_s_RB_NFIND(
-  struct uv__signal_tree_s* head, 
-  struct uv_signal_s* elm
-) {
-  struct uv_signal_s* tmp = head->rbh_root;
-  struct uv_signal_s* res = NULL;
-  int comp;
-  
-  while (tmp) {
-    comp = uv__signal_compare(elm, tmp);
-    if (comp < 0) {
-      res = tmp;
-      tmp = tmp->tree_entry.rbe_left;
-    } else if (comp > 0) {
-      tmp = tmp->tree_entry.rbe_right;
-    } else {
-      return tmp;
-    }
+static void uv__signal_read_end(unsigned int epoch) {
+  __atomic_fetch_sub(&uv__signal_readers[epoch & 1], 1, __ATOMIC_RELEASE);
+}
+
+
+static void uv__signal_synchronize(void) {
+  /* This function must be called with the signal lock held. Readers only
+   * run for the duration of a signal handler, so waiting is short.
+   */
+  unsigned int epoch;
+
+  epoch = __atomic_fetch_add(&uv__signal_epoch, 1, __ATOMIC_SEQ_CST);
+
+  while (__atomic_load_n(&uv__signal_readers[epoch & 1], __ATOMIC_ACQUIRE) != 0) {
+    sched_yield();
   }
-  
-  return res;
 }
 
 
-static struct uv_signal_s* uv__signal_tree_s_RB_NEXT(
-  struct uv_signal_s* elm
-) {
-  if (elm->tree_entry.rbe_right) {
-    elm = elm->tree_entry.rbe_right;
-    while (elm->tree_entry.rbe_left) {
-      elm = elm->tree_entry.rbe_left;
-    }
-  } else {
-    if (elm->tree_entry.rbe_parent && (elm == elm->tree_entry.rbe_parent->tree_entry.rbe_left)) {
-      elm = elm->tree_entry.rbe_parent;
+static uv__signal_set_t* uv__signal_set_read(int signum) {
+  return __atomic_load_n(&uv__signal_table[signum], __ATOMIC_ACQUIRE);
+}
+
+
+static unsigned int uv__signal_chunk_search(uv__signal_chunk_t* chunk, uv_loop_t* loop) {
+  /* Returns the index of the first entry that doesn't sort before {loop}. */
+  unsigned int lo;
+  unsigned int hi;
+  unsigned int mid;
+
+  lo = 0;
+  hi = chunk->nentries;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (chunk->entries[mid].loop < loop) {
+      lo = mid + 1;
     } else {
-      while (elm->tree_entry.rbe_parent && (elm == elm->tree_entry.rbe_parent->tree_entry.rbe_right)) {
-        elm = elm->tree_entry.rbe_parent;
-      }
-      elm = elm->tree_entry.rbe_parent;
+      hi = mid;
     }
   }
-  
-  return elm;
-}
 
+  return lo;
+}
 
-static void uv__signal_global_reinit(void);
 
-static void uv__signal_global_init(void) {
-  uv__signal_global_reinit();
-}
+static unsigned int uv__signal_set_search(uv__signal_set_t* set, uv_loop_t* loop) {
+  /* Returns the index of the last chunk whose first entry doesn't sort after
+   * {loop}, or 0.
+   */
+  unsigned int lo;
+  unsigned int hi;
+  unsigned int mid;
 
+  lo = 1;
+  hi = set->nchunks;
 
-void uv__signal_cleanup(void) {
-  if (uv__signal_lock_pipefd[0] != -1) {
-    uv__close(uv__signal_lock_pipefd[0]);
-    uv__signal_lock_pipefd[0] = -1;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (set->chunks[mid]->entries[0].loop <= loop) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
   }
 
-  if (uv__signal_lock_pipefd[1] != -1) {
-    uv__close(uv__signal_lock_pipefd[1]);
-    uv__signal_lock_pipefd[1] = -1;
-  }
+  return lo - 1;
 }
 
 
-static void uv__signal_global_reinit(void) {
-  uv__signal_cleanup();
+static uv__signal_set_t* uv__signal_set_alloc(unsigned int nchunks) {
+  uv__signal_set_t* set;
 
-  if (uv__make_pipe(uv__signal_lock_pipefd, 0)) {
+  set = uv__malloc(sizeof(*set) + (nchunks - 1) * sizeof(set->chunks[0]));
+  if (set == NULL) {
     abort();
   }
 
-  if (uv__signal_unlock()) {
+  set->nchunks = nchunks;
+  return set;
+}
+
+
+static uv__signal_chunk_t* uv__signal_chunk_alloc(void) {
+  uv__signal_chunk_t* chunk;
+
+  chunk = uv__malloc(sizeof(*chunk));
+  if (chunk == NULL) {
     abort();
   }
+
+  return chunk;
 }
 
 
-void uv__signal_global_once_init(void) {
-  uv__signal_global_init();
+static void uv__signal_publish(int signum,
+                               uv__signal_set_t* set,
+                               uv__signal_set_t* old_set,
+                               uv__signal_chunk_t* old_chunk) {
+  /* This function must be called with the signal lock held. */
+  __atomic_store_n(&uv__signal_table[signum], set, __ATOMIC_RELEASE);
+
+  if (old_set == NULL) {
+    return;
+  }
+
+  uv__signal_synchronize();
+  uv__free(old_chunk);
+  uv__free(old_set);
 }
 
 
-static int uv__signal_lock(void) {
-  int r;
-  char data;
+static void uv__signal_retire(void* ptr) {
+  /* This function must be called with the signal lock held. */
+  void** retired;
+  unsigned int size;
 
-  do {
-    r = read(uv__signal_lock_pipefd[0], &data, sizeof data);
-  } while (r < 0 && errno == EINTR);
+  if (uv__signal_nretired == uv__signal_retired_size) {
+    size = uv__signal_retired_size ? 2 * uv__signal_retired_size : 64;
+    retired = uv__reallocf(uv__signal_retired, size * sizeof(retired[0]));
+    if (retired == NULL) {
+      abort();
+    }
+    uv__signal_retired = retired;
+    uv__signal_retired_size = size;
+  }
 
-  return (r < 0) ? -1 : 0;
+  uv__signal_retired[uv__signal_nretired++] = ptr;
 }
 
 
-static int uv__signal_unlock(void) {
-  int r;
-  char data = 42;
+static void uv__signal_change(int signum, uv_loop_t* loop, int add) {
+  /* This function must be called with the signal lock held. */
+  uv__signal_change_t* changes;
+  unsigned int size;
 
-  do {
-    r = write(uv__signal_lock_pipefd[1], &data, sizeof data);
-  } while (r < 0 && errno == EINTR);
+  if (uv__signal_nchanges == uv__signal_changes_size) {
+    size = uv__signal_changes_size ? 2 * uv__signal_changes_size : 64;
+    changes = uv__reallocf(uv__signal_changes, size * sizeof(changes[0]));
+    if (changes == NULL) {
+      abort();
+    }
+    uv__signal_changes = changes;
+    uv__signal_changes_size = size;
+  }
 
-  return (r < 0) ? -1 : 0;
+  changes = &uv__signal_changes[uv__signal_nchanges++];
+  changes->signum = signum;
+  changes->add = add;
+  changes->loop = loop;
 }
 
 
-static void uv__signal_block_and_lock(sigset_t* saved_sigmask) {
-  sigset_t new_mask;
+static int uv__signal_change_compare(const void* a, const void* b) {
+  const uv__signal_change_t* x = a;
+  const uv__signal_change_t* y = b;
 
-  if (sigfillset(&new_mask)) {
-    abort();
+  if (x->signum != y->signum) {
+    return x->signum - y->signum;
   }
 
-  /* to shut up valgrind */
-  sigemptyset(saved_sigmask);
-  if (pthread_sigmask(SIG_SETMASK, &new_mask, saved_sigmask)) {
-    abort();
+  return (x->loop > y->loop) - (x->loop < y->loop);
+}
+
+
+static void uv__signal_set_rebuild(int signum,
+                                   const uv__signal_change_t* changes,
+                                   unsigned int nchanges) {
+  /* This function must be called with the signal lock held. Merges the
+   * sorted {changes} into a fresh copy of the snapshot, with chunks filled
+   * to 3/4 so later single inserts rarely split them.
+   */
+  uv__signal_set_t* old_set;
+  uv__signal_set_t* set;
+  uv__signal_chunk_t** chunks;
+  uv__signal_chunk_t* chunk;
+  uv_loop_t* loop;
+  unsigned int nentries;
+  unsigned int nchunks;
+  unsigned int fill;
+  unsigned int c;
+  unsigned int i;
+  unsigned int k;
+
+  old_set = uv__signal_table[signum];
+  fill = UV__SIGNAL_CHUNK_SIZE / 4 * 3;
+
+  nentries = nchanges;
+  for (c = 0; old_set != NULL && c < old_set->nchunks; c++) {
+    nentries += old_set->chunks[c]->nentries;
   }
 
-  if (uv__signal_lock()) {
+  chunks = uv__malloc((nentries / fill + 1) * sizeof(chunks[0]));
+  if (chunks == NULL) {
     abort();
   }
-}
 
+  nchunks = 0;
+  chunk = NULL;
+  c = 0;
+  i = 0;
+  k = 0;
+
+  for (;;) {
+    /* Skip past exhausted chunks of the old snapshot. */
+    while (old_set != NULL && c < old_set->nchunks && i == old_set->chunks[c]->nentries) {
+      c++;
+      i = 0;
+    }
 
-static void uv__signal_unlock_and_unblock(sigset_t* saved_sigmask) {
-  if (uv__signal_unlock()) {
-    abort();
+    if (old_set != NULL && c < old_set->nchunks) {
+      loop = old_set->chunks[c]->entries[i].loop;
+
+      if (k < nchanges && changes[k].loop < loop) {
+        /* A loop that joins. */
+        assert(changes[k].add);
+        loop = changes[k++].loop;
+      } else if (k < nchanges && changes[k].loop == loop) {
+        /* A loop that leaves. */
+        assert(!changes[k].add);
+        k++;
+        i++;
+        continue;
+      } else {
+        i++;
+      }
+    } else if (k < nchanges) {
+      assert(changes[k].add);
+      loop = changes[k++].loop;
+    } else {
+      break;
+    }
+
+    if (chunk == NULL || chunk->nentries == fill) {
+      chunk = uv__signal_chunk_alloc();
+      chunk->nentries = 0;
+      chunks[nchunks++] = chunk;
+    }
+
+    chunk->entries[chunk->nentries++].loop = loop;
   }
 
-  if (pthread_sigmask(SIG_SETMASK, saved_sigmask, NULL)) {
-    abort();
+  set = NULL;
+  if (nchunks > 0) {
+    set = uv__signal_set_alloc(nchunks);
+    memcpy(set->chunks, chunks, nchunks * sizeof(chunks[0]));
+    set->nentries = 0;
+    for (c = 0; c < nchunks; c++) {
+      set->nentries += chunks[c]->nentries;
+    }
+  }
+  uv__free(chunks);
+
+  __atomic_store_n(&uv__signal_table[signum], set, __ATOMIC_RELEASE);
+
+  if (old_set != NULL) {
+    for (c = 0; c < old_set->nchunks; c++) {
+      uv__signal_retire(old_set->chunks[c]);
+    }
+    uv__signal_retire(old_set);
   }
 }
 
 
-static uv_signal_t* uv__signal_first_handle(int signum) {
+static void uv__signal_batch_begin(void) {
   /* This function must be called with the signal lock held. */
-  uv_signal_t lookup;
-  uv_signal_t* handle;
+  uv__signal_batching = 1;
+}
 
-  lookup.signum = signum;
-  lookup.flags = 0;
-  lookup.loop = NULL;
 
-  handle = uv__signal_tree_s_RB_NFIND(&uv__signal_tree, &lookup);
+static void uv__signal_batch_end(void) {
+  /* This function must be called with the signal lock held. */
+  unsigned int first;
+  unsigned int i;
 
-  if (handle != NULL && handle->signum == signum) {
-    return handle;
-  }
+  uv__signal_batching = 0;
 
-  return NULL;
-}
+  qsort(uv__signal_changes,
+        uv__signal_nchanges,
+        sizeof(uv__signal_changes[0]),
+        uv__signal_change_compare);
 
+  for (first = 0; first < uv__signal_nchanges; first = i) {
+    for (i = first + 1;
+         i < uv__signal_nchanges &&
+         uv__signal_changes[i].signum == uv__signal_changes[first].signum;
+         i++);
 
-static void uv__signal_handler(int signum) {
-  uv__signal_msg_t msg;
-  uv_signal_t* handle;
-  int saved_errno;
+    uv__signal_set_rebuild(uv__signal_changes[first].signum,
+                           uv__signal_changes + first,
+                           i - first);
+  }
 
-  saved_errno = errno;
-  memset(&msg, 0, sizeof msg);
+  uv__signal_nchanges = 0;
 
-  if (uv__signal_lock()) {
-    errno = saved_errno;
+  if (uv__signal_nretired == 0) {
     return;
   }
 
-  for (handle = uv__signal_first_handle(signum);
-       handle != NULL && handle->signum == signum;
-       handle = uv__signal_tree_s_RB_NEXT(handle)) {
-    int r;
+  uv__signal_synchronize();
 
-    msg.signum = signum;
-    msg.handle = handle;
+  for (i = 0; i < uv__signal_nretired; i++) {
+    uv__free(uv__signal_retired[i]);
+  }
 
-    /* write() should be atomic for small data chunks, so the entire message
-     * should be written at once. In theory the pipe could become full, in
-     * which case the user is out of luck.
-     */
-    do {
-      r = write(handle->loop->signal_pipefd[1], &msg, sizeof msg);
-    } while (r == -1 && errno == EINTR);
+  uv__signal_nretired = 0;
+}
 
-    assert(r == sizeof msg || (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)));
 
-    if (r != -1) {
-      handle->caught_signals++;
+static void uv__signal_set_insert(int signum, uv_loop_t* loop) {
+  /* This function must be called with the signal lock held. */
+  uv__signal_set_t* old_set;
+  uv__signal_set_t* set;
+  uv__signal_chunk_t* old_chunk;
+  uv__signal_chunk_t* chunk;
+  uv__signal_chunk_t* next;
+  unsigned int split;
+  unsigned int c;
+  unsigned int i;
+
+  old_set = uv__signal_table[signum];
+
+  if (old_set == NULL) {
+    chunk = uv__signal_chunk_alloc();
+    chunk->nentries = 0;
+    set = uv__signal_set_alloc(1);
+    set->chunks[0] = chunk;
+    old_chunk = NULL;
+    c = 0;
+  } else {
+    c = uv__signal_set_search(old_set, loop);
+    old_chunk = old_set->chunks[c];
+    chunk = uv__signal_chunk_alloc();
+    *chunk = *old_chunk;
+
+    if (chunk->nentries < UV__SIGNAL_CHUNK_SIZE) {
+      set = uv__signal_set_alloc(old_set->nchunks);
+      memcpy(set->chunks, old_set->chunks, old_set->nchunks * sizeof(set->chunks[0]));
+    } else {
+      /* Split a full chunk in half, the new entry goes into one of them. */
+      split = UV__SIGNAL_CHUNK_SIZE / 2;
+      next = uv__signal_chunk_alloc();
+      next->nentries = UV__SIGNAL_CHUNK_SIZE - split;
+      memcpy(next->entries, chunk->entries + split, next->nentries * sizeof(next->entries[0]));
+      chunk->nentries = split;
+
+      set = uv__signal_set_alloc(old_set->nchunks + 1);
+      memcpy(set->chunks, old_set->chunks, (c + 1) * sizeof(set->chunks[0]));
+      memcpy(set->chunks + c + 2,
+             old_set->chunks + c + 1,
+             (old_set->nchunks - c - 1) * sizeof(set->chunks[0]));
+      set->chunks[c] = chunk;
+      set->chunks[c + 1] = next;
+
+      if (next->entries[0].loop < loop) {
+        chunk = next;
+        c++;
+      }
     }
+
+    set->chunks[c] = chunk;
   }
 
-  uv__signal_unlock();
-  errno = saved_errno;
-}
+  i = uv__signal_chunk_search(chunk, loop);
+  memmove(chunk->entries + i + 1,
+          chunk->entries + i,
+          (chunk->nentries - i) * sizeof(chunk->entries[0]));
+  chunk->entries[i].loop = loop;
+  chunk->nentries++;
+  set->nentries = old_set != NULL ? old_set->nentries + 1 : 1;
 
+  uv__signal_publish(signum, set, old_set, old_chunk);
+}
 
-static int uv__signal_register_handler(int signum, int oneshot) {
-  /* When this function is called, the signal lock must be held. */
-  struct sigaction sa;
 
-  /* XXX use a separate signal stack? */
-  memset(&sa, 0, sizeof(sa));
-  if (sigfillset(&sa.sa_mask)) {
-    abort();
-  }
-  sa.sa_handler = uv__signal_handler;
-  sa.sa_flags = SA_RESTART;
-  if (oneshot) {
-    sa.sa_flags |= SA_RESETHAND;
+static void uv__signal_set_remove(int signum, uv_loop_t* loop) {
+  /* This function must be called with the signal lock held. */
+  uv__signal_set_t* old_set;
+  uv__signal_set_t* set;
+  uv__signal_chunk_t* old_chunk;
+  uv__signal_chunk_t* chunk;
+  unsigned int c;
+  unsigned int i;
+
+  old_set = uv__signal_table[signum];
+  assert(old_set != NULL);
+
+  c = uv__signal_set_search(old_set, loop);
+  old_chunk = old_set->chunks[c];
+  i = uv__signal_chunk_search(old_chunk, loop);
+  assert(i < old_chunk->nentries && old_chunk->entries[i].loop == loop);
+
+  if (old_chunk->nentries > 1) {
+    chunk = uv__signal_chunk_alloc();
+    *chunk = *old_chunk;
+    chunk->nentries--;
+    memmove(chunk->entries + i,
+            chunk->entries + i + 1,
+            (chunk->nentries - i) * sizeof(chunk->entries[0]));
+
+    set = uv__signal_set_alloc(old_set->nchunks);
+    memcpy(set->chunks, old_set->chunks, old_set->nchunks * sizeof(set->chunks[0]));
+    set->chunks[c] = chunk;
+  } else if (old_set->nchunks > 1) {
+    set = uv__signal_set_alloc(old_set->nchunks - 1);
+    memcpy(set->chunks, old_set->chunks, c * sizeof(set->chunks[0]));
+    memcpy(set->chunks + c,
+           old_set->chunks + c + 1,
+           (old_set->nchunks - c - 1) * sizeof(set->chunks[0]));
+  } else {
+    set = NULL;
   }
 
-  /* XXX save old action so we can restore it later on? */
-  if (sigaction(signum, &sa, NULL)) {
-    return errno;
+  if (set != NULL) {
+    set->nentries = old_set->nentries - 1;
   }
 
-  return 0;
+  uv__signal_publish(signum, set, old_set, old_chunk);
 }
 
 
-static void uv__signal_unregister_handler(int signum) {
-  /* When this function is called, the signal lock must be held. */
-  struct sigaction sa;
+/* A loop's handles for a signal stay in the order uv__signal_compare() gave
+ * the tree this table replaced: handles without UV_SIGNAL_ONE_SHOT first,
+ * then by address. Stop leaves a hole and start appends, the array is
+ * compacted once half of it is holes and sorted again before it's walked if
+ * an append broke the order.
+ */
+static int uv__signal_slot_compare(const void* a, const void* b) {
+  uv_signal_t* w1;
+  uv_signal_t* w2;
+  unsigned int f1;
+  unsigned int f2;
 
-  memset(&sa, 0, sizeof(sa));
-  sa.sa_handler = SIG_DFL;
+  w1 = *(uv_signal_t* const*) a;
+  w2 = *(uv_signal_t* const*) b;
 
-  /* sigaction can only fail with EINVAL or EFAULT; an attempt to deregister a
-   * signal implies that it was successfully registered earlier, so EINVAL
-   * should never happen.
-   */
-  if (sigaction(signum, &sa, NULL)) {
-    abort();
-  }
+  f1 = w1->flags & UV_SIGNAL_ONE_SHOT;
+  f2 = w2->flags & UV_SIGNAL_ONE_SHOT;
+  if (f1 < f2) return -1;
+  if (f1 > f2) return 1;
+
+  if ((uintptr_t) w1 < (uintptr_t) w2) return -1;
+  if ((uintptr_t) w1 > (uintptr_t) w2) return 1;
+
+  return 0;
 }
 
 
-static int uv__signal_loop_once_init(uv_loop_t* loop) {
-  int err;
+static void uv__signal_slot_add(struct uv__signal_slot* slot, uv_signal_t* handle) {
+  uv_signal_t** handles;
+  uv_signal_t* last;
+  unsigned int size;
 
-  /* Return if already initialized. */
-  if (loop->signal_pipefd[0] != -1) {
-    return 0;
+  if (slot->nhandles == slot->size) {
+    size = slot->size ? 2 * slot->size : 4;
+    handles = uv__reallocf(slot->handles, size * sizeof(slot->handles[0]));
+    if (handles == NULL) {
+      abort();
+    }
+    slot->handles = handles;
+    slot->size = size;
   }
 
-  err = uv__make_pipe(loop->signal_pipefd, UV_NONBLOCK_PIPE);
-  if (err) {
-    return err;
+  if (slot->nhandles > 0) {
+    last = slot->handles[slot->nhandles - 1];
+    if (last == NULL || uv__signal_slot_compare(&last, &handle) > 0) {
+      slot->unsorted = 1;
+    }
   }
 
-  uv__io_init(&loop->signal_io_watcher, uv__signal_event, loop->signal_pipefd[0]);
-  uv__io_start(loop, &loop->signal_io_watcher, POLLIN);
-
-  return 0;
+  handle->slot_index = slot->nhandles;
+  slot->handles[slot->nhandles++] = handle;
 }
 
 
-int uv_signal_init(uv_loop_t* loop, uv_signal_t* handle) {
-  int err;
+static void uv__signal_slot_compact(struct uv__signal_slot* slot) {
+  unsigned int i;
+  unsigned int j;
 
-  err = uv__signal_loop_once_init(loop);
-  if (err) {
-    return err;
+  for (i = 0, j = 0; i < slot->nhandles; i++) {
+    if (slot->handles[i] != NULL) {
+      slot->handles[j++] = slot->handles[i];
+    }
   }
 
-  handle->loop = loop;
-  handle->flags = UV_HANDLE_REF;  /* Ref the loop when active. */
-  handle->signum = 0;
-  handle->caught_signals = 0;
-  handle->dispatched_signals = 0;
+  slot->nhandles = j;
+  slot->nholes = 0;
 
-  return 0;
+  if (slot->nhandles == 0) {
+    uv__free(slot->handles);
+    slot->handles = NULL;
+    slot->size = 0;
+    slot->unsorted = 0;
+    return;
+  }
+
+  if (slot->unsorted) {
+    qsort(slot->handles,
+          slot->nhandles,
+          sizeof(slot->handles[0]),
+          uv__signal_slot_compare);
+    slot->unsorted = 0;
+  }
+
+  for (i = 0; i < slot->nhandles; i++) {
+    slot->handles[i]->slot_index = i;
+  }
 }
 
 
-void uv__signal_close(uv_signal_t* handle) {
-  uv__signal_stop(handle);
+/* Called before the loop walks the slot. */
+static void uv__signal_slot_order(struct uv__signal_slot* slot) {
+  if (slot->unsorted) {
+    uv__signal_slot_compact(slot);
+  }
 }
 
 
-int uv_signal_start(uv_signal_t* handle, uv_signal_cb signal_cb, int signum) {
-  return uv__signal_start(handle, signal_cb, signum, 0);
+/* Called when the loop is done walking the slot, or after a stop outside
+ * the walk.
+ */
+static void uv__signal_slot_tidy(struct uv__signal_slot* slot) {
+  if (slot->nholes * 2 > slot->nhandles) {
+    uv__signal_slot_compact(slot);
+  }
 }
 
 
-int uv_signal_start_oneshot(uv_signal_t* handle, uv_signal_cb signal_cb, int signum) {
-  return uv__signal_start(handle, signal_cb, signum, 1);
+static void uv__signal_slot_remove(uv_loop_t* loop, int signum, uv_signal_t* handle) {
+  struct uv__signal_slot* slot;
+  unsigned int i;
+
+  slot = &loop->signal_slots[signum];
+  i = handle->slot_index;
+  assert(i < slot->nhandles && slot->handles[i] == handle);
+
+  slot->handles[i] = NULL;
+  slot->nholes++;
+
+  /* uv__signal_fanout() tidies up a slot it's walking when it's done. */
+  if (loop->signal_dispatching != signum) {
+    uv__signal_slot_tidy(slot);
+  }
 }
 
 
-static int uv__signal_start(uv_signal_t* handle, uv_signal_cb signal_cb, int signum, int oneshot) {
-  sigset_t saved_sigmask;
-  int err;
-  uv_signal_t* first_handle;
+static int uv__signal_slot_empty(struct uv__signal_slot* slot) {
+  return slot->nhandles == slot->nholes;
+}
 
-  assert((handle->flags & (UV_HANDLE_CLOSING | UV_HANDLE_CLOSED)) == 0);
 
-  /* If the user supplies signum == 0, then return an error already. If the
-   * signum is otherwise invalid then uv__signal_register will find out
-   * eventually.
-   */
-  if (signum == 0) {
-    return -1;
+static struct uv__signal_ring* uv__signal_ring_create(void) {
+  struct uv__signal_ring* ring;
+  struct rlimit limit;
+  unsigned int i;
+
+  ring = uv__malloc(sizeof(*ring));
+  if (ring == NULL) {
+    return NULL;
   }
 
-  /* Short circuit: if the signal watcher is already watching {signum} don't
-   * go through the process of deregistering and registering the handler.
-   * Additionally, this avoids pending signals getting lost in the small
-   * time frame that handle->signum == 0.
+  ring->head = 0;
+  ring->tail = 0;
+  ring->throttled = 0;
+
+  /* Half the ring, or half the kernel's queue if that's smaller: senders
+   * run into RLIMIT_SIGPENDING first then.
    */
-  if (signum == handle->signum) {
-    handle->signal_cb = signal_cb;
-    return 0;
+  ring->backoff = UV__SIGNAL_RING_SIZE / 2;
+  if (getrlimit(RLIMIT_SIGPENDING, &limit) == 0 &&
+      limit.rlim_cur != RLIM_INFINITY &&
+      limit.rlim_cur / 2 < ring->backoff) {
+    ring->backoff = limit.rlim_cur / 2;
   }
 
-  /* If the signal handler was already active, stop it first. */
-  if (handle->signum != 0) {
-    uv__signal_stop(handle);
+  for (i = 0; i < UV__SIGNAL_RING_SIZE; i++) {
+    ring->cells[i].seq = i;
   }
 
-  uv__signal_block_and_lock(&saved_sigmask);
+  return ring;
+}
 
-  /* If at this point there are no active signal watchers for this signum (in
+
+static int uv__signal_ring_push(struct uv__signal_ring* ring,
+                                const uv_siginfo_t* info,
+                                uint64_t ns) {
+  uv__signal_cell_t* cell;
+  unsigned int pos;
+  unsigned int seq;
+
+  pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+  for (;;) {
+    cell = &ring->cells[pos % UV__SIGNAL_RING_SIZE];
+    seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+
+    if (seq == pos) {
+      if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if ((int) (seq - pos) < 0) {
+      return -1;  /* Full. */
+    } else {
+      pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    }
+  }
+
+  cell->info = *info;
+  cell->ns = ns;
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+  if (pos + 1 - __atomic_load_n(&ring->head, __ATOMIC_RELAXED) >= UV__SIGNAL_RING_HIGH &&
+      __atomic_exchange_n(&ring->throttled, 1, __ATOMIC_RELAXED) == 0) {
+    __atomic_fetch_add(&uv__signal_nthrottled, 1, __ATOMIC_SEQ_CST);
+  }
+
+  return 0;
+}
+
+
+static int uv__signal_ring_pop(struct uv__signal_ring* ring, uv_siginfo_t* info, uint64_t* ns) {
+  /* Only the loop thread pops. */
+  uv__signal_cell_t* cell;
+  unsigned int pos;
+
+  pos = ring->head;
+  cell = &ring->cells[pos % UV__SIGNAL_RING_SIZE];
+
+  /* Empty, or the producer that claimed this cell hasn't filled it yet. It
+   * wakes up the loop again once it has.
+   */
+  if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+    return -1;
+  }
+
+  *info = cell->info;
+  *ns = cell->ns;
+  __atomic_store_n(&cell->seq, pos + UV__SIGNAL_RING_SIZE, __ATOMIC_RELEASE);
+  __atomic_store_n(&ring->head, pos + 1, __ATOMIC_RELAXED);
+
+  return 0;
+}
+
+
+static void uv__signal_wakeup(uv_loop_t* loop) {
+  int r;
+
+  uint64_t one;
+
+  /* Only the first signal since the loop last looked writes to the eventfd.
+   * If the write fails the counter is saturated and the loop wakes up anyway.
+   */
+  if (__atomic_exchange_n(&loop->signal_pending, 1, __ATOMIC_SEQ_CST) != 0) {
+    return;
+  }
+
+  one = 1;
+  do {
+    r = write(loop->signal_wakeup_fd, &one, sizeof(one));
+  } while (r == -1 && errno == EINTR);
+
+  assert(r == sizeof(one) || (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)));
+}
+
+
+static uint64_t uv__signal_now(void) {
+  /* Async-signal-safe. */
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts)) {
+    return 0;
+  }
+
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static int uv__signal_notify(uv_loop_t* loop,
+                             const uv_siginfo_t* info,
+                             uint64_t ns,
+                             uv_loop_t* self) {
+  /* Returns 1 if the loop's ring is throttled. */
+  struct uv__signal_slot* slot;
+  struct uv__signal_ring* ring;
+  uint64_t oldest;
+  int throttled;
+
+  slot = &loop->signal_slots[info->signo];
+  throttled = 0;
+
+  if (__atomic_load_n(&slot->ninfo, __ATOMIC_ACQUIRE) > 0) {
+    ring = __atomic_load_n(&loop->signal_ring, __ATOMIC_ACQUIRE);
+    if (uv__signal_ring_push(ring, info, ns)) {
+      __atomic_fetch_add(&slot->lost, 1, __ATOMIC_RELAXED);
+    }
+    throttled = __atomic_load_n(&ring->throttled, __ATOMIC_RELAXED);
+  }
+
+  /* Only the first signal since the loop last looked is timed. */
+  oldest = 0;
+  __atomic_compare_exchange_n(&slot->caught_ns, &oldest, ns, 0,
+                              __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+  __atomic_fetch_add(&slot->caught, 1, __ATOMIC_RELEASE);
+
+  if (loop != self) {
+    uv__signal_wakeup(loop);
+  }
+
+  return throttled;
+}
+
+
+static uv_loop_t* uv__signal_pick(uv__signal_set_t* set, int signum, unsigned int policy) {
+  /* Async-signal-safe. Round-robin takes the next entry, least-loaded the
+   * one with the fewest signals caught but not dispatched, scanning from the
+   * next entry so idle loops take turns. The turn moves past the entry that
+   * was picked, or the one after a busy loop would get twice its share. Lost
+   * races only skew the choice.
+   */
+  struct uv__signal_slot* slot;
+  uv__signal_chunk_t* chunk;
+  uv_loop_t* best;
+  unsigned int best_load;
+  unsigned int best_n;
+  unsigned int load;
+  unsigned int start;
+  unsigned int n;
+  unsigned int c;
+  unsigned int i;
+
+  start = __atomic_fetch_add(&uv__signal_rotor[signum], 1, __ATOMIC_RELAXED);
+  start %= set->nentries;
+
+  for (c = 0; start >= set->chunks[c]->nentries; c++) {
+    start -= set->chunks[c]->nentries;
+  }
+
+  chunk = set->chunks[c];
+  i = start;
+
+  if (policy & UV_SIGNAL_ROTATE) {
+    return chunk->entries[i].loop;
+  }
+
+  best = NULL;
+  best_load = 0;
+  best_n = 0;
+
+  for (n = 0; n < set->nentries; n++) {
+    if (i == chunk->nentries) {
+      c = (c + 1) % set->nchunks;
+      chunk = set->chunks[c];
+      i = 0;
+    }
+
+    slot = &chunk->entries[i].loop->signal_slots[signum];
+    load = __atomic_load_n(&slot->caught, __ATOMIC_RELAXED) -
+           __atomic_load_n(&slot->dispatched, __ATOMIC_RELAXED);
+
+    if (best == NULL || load < best_load) {
+      best = chunk->entries[i].loop;
+      best_load = load;
+      best_n = n;
+      if (load == 0) {
+        break;
+      }
+    }
+
+    i++;
+  }
+
+  if (best_n > 0) {
+    __atomic_fetch_add(&uv__signal_rotor[signum], best_n, __ATOMIC_RELAXED);
+  }
+
+  return best;
+}
+
+
+static int uv__signal_deliver(const uv_siginfo_t* info, uint64_t ns, uv_loop_t* self) {
+  /* This function must be called between uv__signal_read_begin() and
+   * uv__signal_read_end(). Counts the signal once for every loop watching
+   * it, or the one loop its policy picks, queues its siginfo for loops with
+   * uv_signal_start_info() handles and wakes up all of them but {self},
+   * which drains its own slots. {ns} is when the signal arrived. Returns 1
+   * if a ring it went into is throttled, the caller takes no more of the
+   * signal until nothing is.
+   */
+  uv__signal_set_t* set;
+  uv__signal_chunk_t* chunk;
+  unsigned int policy;
+  unsigned int c;
+  unsigned int i;
+  int throttled;
+  int signum;
+
+  signum = info->signo;
+  set = uv__signal_set_read(signum);
+  if (set == NULL) {
+    return 0;
+  }
+
+  policy = __atomic_load_n(&uv__signal_policy[signum], __ATOMIC_RELAXED);
+  if (policy != 0) {
+    return uv__signal_notify(uv__signal_pick(set, signum, policy), info, ns, self);
+  }
+
+  throttled = 0;
+  for (c = 0; c < set->nchunks; c++) {
+    chunk = set->chunks[c];
+
+    for (i = 0; i < chunk->nentries; i++) {
+      throttled |= uv__signal_notify(chunk->entries[i].loop, info, ns, self);
+    }
+  }
+
+  return throttled;
+}
+
+
+static void uv__signal_handler(int signum, siginfo_t* si, void* ucontext) {
+  uv_siginfo_t info;
+  unsigned int epoch;
+  uint64_t ns;
+  int saved_errno;
+  int throttled;
+
+  saved_errno = errno;
+  ns = uv__signal_now();
+
+  if (__atomic_load_n(&uv__signal_resethand[signum], __ATOMIC_RELAXED)) {
+    __atomic_store_n(&uv__signal_disarmed[signum], 1, __ATOMIC_RELAXED);
+  }
+
+  info.signo = signum;
+  info.code = si->si_code;
+  info.pid = si->si_pid;
+  info.uid = si->si_uid;
+  info.value = si->si_value;
+
+  epoch = uv__signal_read_begin();
+  throttled = uv__signal_deliver(&info, ns, NULL);
+  uv__signal_read_end(epoch);
+
+  /* Leave the signal blocked in this thread when the handler returns. */
+  if (throttled) {
+    sigaddset(&((ucontext_t*) ucontext)->uc_sigmask, signum);
+    __atomic_store_n(&uv__signal_held[signum], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&uv__signal_held_gen, 1, __ATOMIC_RELEASE);
+  }
+
+  errno = saved_errno;
+}
+
+
+static void uv__signal_forward(int signum) {
+  /* Re-raise an unwatched signal on the receiver thread with it unblocked
+   * there, so its disposition applies as if libuv never blocked it: the
+   * default action, SIG_IGN or a handler installed by the application.
+   */
+  sigset_t mask;
+
+  sigemptyset(&mask);
+  sigaddset(&mask, signum);
+
+  if (syscall(SYS_tgkill, getpid(), syscall(SYS_gettid), signum)) {
+    abort();
+  }
+
+  pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
+  pthread_sigmask(SIG_BLOCK, &mask, NULL);
+}
+
+
+static void* uv__signal_thread(void* arg) {
+  /* Signals whose ring is throttled stay out of {wait} and queued in the
+   * kernel, the thread polls for the throttle to clear in between.
+   */
+  static const struct timespec poll = { 0, 1000000 };
+  uv_siginfo_t info;
+  unsigned int epoch;
+  sigset_t wait;
+  uint64_t ns;
+  siginfo_t si;
+  int holding;
+  int action;
+  int signum;
+
+  holding = 0;
+
+  for (;;) {
+    if (holding && __atomic_load_n(&uv__signal_nthrottled, __ATOMIC_SEQ_CST) == 0) {
+      holding = 0;
+    }
+
+    if (holding) {
+      signum = sigtimedwait(&wait, &si, &poll);
+    } else {
+      wait = uv__signal_thread_set;
+      signum = sigwaitinfo(&wait, &si);
+    }
+
+    if (signum == -1) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      abort();
+    }
+
+    ns = uv__signal_now();
+
+    action = __atomic_load_n(&uv__signal_thread_action[signum], __ATOMIC_ACQUIRE);
+
+    /* Like SA_RESETHAND, only the first signal goes to one-shot watchers. A
+     * failed exchange reloads {action}, a watcher was started or stopped.
+     */
+    while (action == UV__SIGNAL_DELIVER_ONCE &&
+           !__atomic_compare_exchange_n(&uv__signal_thread_action[signum],
+                                        &action,
+                                        UV__SIGNAL_FORWARD,
+                                        0,
+                                        __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE));
+
+    if (action == UV__SIGNAL_DELIVER_ONCE) {
+      __atomic_store_n(&uv__signal_disarmed[signum], 1, __ATOMIC_RELAXED);
+    }
+
+    if (action == UV__SIGNAL_FORWARD) {
+      uv__signal_forward(signum);
+      continue;
+    }
+
+    info.signo = signum;
+    info.code = si.si_code;
+    info.pid = si.si_pid;
+    info.uid = si.si_uid;
+    info.value = si.si_value;
+
+    epoch = uv__signal_read_begin();
+    if (uv__signal_deliver(&info, ns, NULL)) {
+      sigdelset(&wait, signum);
+      holding = 1;
+    }
+    uv__signal_read_end(epoch);
+  }
+
+  return NULL;
+}
+
+
+int uv_signal_use_thread(void) {
+  pthread_attr_t attr;
+  pthread_t thread;
+  int signum;
+  int err;
+
+  uv__signal_lock();
+
+  if (uv__signal_thread_enabled) {
+    uv__signal_unlock();
+    return 0;
+  }
+
+  for (signum = 1; signum < UV__NSIG; signum++) {
+    if (uv__signal_nhandles[signum] > 0) {
+      uv__signal_unlock();
+      return EBUSY;
+    }
+  }
+
+  /* Everything but the signals the kernel sends to the faulting thread and
+   * the ones that can't be caught. glibc keeps its internal signals out of
+   * the mask by itself.
+   */
+  sigfillset(&uv__signal_thread_set);
+  sigdelset(&uv__signal_thread_set, SIGKILL);
+  sigdelset(&uv__signal_thread_set, SIGSTOP);
+  sigdelset(&uv__signal_thread_set, SIGSEGV);
+  sigdelset(&uv__signal_thread_set, SIGBUS);
+  sigdelset(&uv__signal_thread_set, SIGFPE);
+  sigdelset(&uv__signal_thread_set, SIGILL);
+  sigdelset(&uv__signal_thread_set, SIGTRAP);
+  sigdelset(&uv__signal_thread_set, SIGSYS);
+  sigdelset(&uv__signal_thread_set, SIGABRT);
+  sigdelset(&uv__signal_thread_set, SIGPIPE);
+
+  /* Threads created from here on, the receiver included, inherit the mask. */
+  err = pthread_sigmask(SIG_BLOCK, &uv__signal_thread_set, NULL);
+  if (err) {
+    uv__signal_unlock();
+    return err;
+  }
+
+  if (pthread_attr_init(&attr)) {
+    abort();
+  }
+
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  err = pthread_create(&thread, &attr, uv__signal_thread, NULL);
+  pthread_attr_destroy(&attr);
+
+  if (err) {
+    pthread_sigmask(SIG_UNBLOCK, &uv__signal_thread_set, NULL);
+    uv__signal_unlock();
+    return err;
+  }
+
+  uv__signal_thread_enabled = 1;
+  uv__signal_unlock();
+
+  return 0;
+}
+
+
+static int uv__signal_register_handler(int signum, int oneshot) {
+  /* When this function is called, the signal lock must be held. */
+  struct sigaction sa;
+
+  __atomic_store_n(&uv__signal_resethand[signum], oneshot, __ATOMIC_RELAXED);
+  __atomic_store_n(&uv__signal_disarmed[signum], 0, __ATOMIC_RELAXED);
+
+  /* The receiver thread takes it from here, the disposition isn't touched. */
+  if (uv__signal_thread_enabled && sigismember(&uv__signal_thread_set, signum) == 1) {
+    __atomic_store_n(&uv__signal_thread_action[signum],
+                     oneshot ? UV__SIGNAL_DELIVER_ONCE : UV__SIGNAL_DELIVER,
+                     __ATOMIC_RELEASE);
+    return 0;
+  }
+
+  /* XXX use a separate signal stack? */
+  memset(&sa, 0, sizeof(sa));
+  if (sigfillset(&sa.sa_mask)) {
+    abort();
+  }
+  sa.sa_sigaction = uv__signal_handler;
+  sa.sa_flags = SA_RESTART | SA_SIGINFO;
+  if (oneshot) {
+    sa.sa_flags |= SA_RESETHAND;
+  }
+
+  /* XXX save old action so we can restore it later on? */
+  if (sigaction(signum, &sa, NULL)) {
+    return errno;
+  }
+
+  return 0;
+}
+
+
+static void uv__signal_unregister_handler(int signum) {
+  /* When this function is called, the signal lock must be held. */
+  struct sigaction sa;
+
+  __atomic_store_n(&uv__signal_resethand[signum], 0, __ATOMIC_RELAXED);
+
+  if (uv__signal_thread_enabled && sigismember(&uv__signal_thread_set, signum) == 1) {
+    __atomic_store_n(&uv__signal_thread_action[signum], UV__SIGNAL_FORWARD, __ATOMIC_RELEASE);
+    return;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = SIG_DFL;
+
+  /* sigaction can only fail with EINVAL or EFAULT; an attempt to deregister a
+   * signal implies that it was successfully registered earlier, so EINVAL
+   * should never happen.
+   */
+  if (sigaction(signum, &sa, NULL)) {
+    abort();
+  }
+}
+
+
+static int uv__signal_loop_once_init(uv_loop_t* loop) {
+  /* Return if already initialized. */
+  if (loop->signal_wakeup_fd != -1) {
+    return 0;
+  }
+
+  loop->signal_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (loop->signal_wakeup_fd == -1) {
+    return errno;
+  }
+
+  uv__io_init(&loop->signal_io_watcher, uv__signal_event, loop->signal_wakeup_fd);
+  uv__io_start(loop, &loop->signal_io_watcher, POLLIN);
+
+  return 0;
+}
+
+
+static int uv__signal_fd_add(uv_loop_t* loop, int signum) {
+  sigset_t mask;
+  int err;
+  int fd;
+
+  if (loop->signal_fd_refs[signum]++ > 0) {
+    return 0;
+  }
+
+  sigaddset(&loop->signal_fd_mask, signum);
+
+  fd = signalfd(loop->signal_fd, &loop->signal_fd_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (fd == -1) {
+    err = errno;
+    sigdelset(&loop->signal_fd_mask, signum);
+    loop->signal_fd_refs[signum]--;
+    return err;
+  }
+
+  if (loop->signal_fd == -1) {
+    loop->signal_fd = fd;
+    uv__io_init(&loop->signal_fd_watcher, uv__signal_fd_event, fd);
+    uv__io_start(loop, &loop->signal_fd_watcher, POLLIN);
+  }
+
+  /* Keep the kernel from running uv__signal_handler on this thread, so the
+   * signal stays pending until it is read from the signalfd. Signals that
+   * are delivered to other threads still go through the handler.
+   */
+  sigemptyset(&mask);
+  sigaddset(&mask, signum);
+  if (pthread_sigmask(SIG_BLOCK, &mask, NULL)) {
+    abort();
+  }
+
+  return 0;
+}
+
+
+static void uv__signal_fd_remove(uv_loop_t* loop, int signum) {
+  sigset_t mask;
+
+  assert(loop->signal_fd_refs[signum] > 0);
+
+  if (--loop->signal_fd_refs[signum] > 0) {
+    return;
+  }
+
+  sigdelset(&loop->signal_fd_mask, signum);
+
+  if (signalfd(loop->signal_fd, &loop->signal_fd_mask, SFD_NONBLOCK | SFD_CLOEXEC) == -1) {
+    abort();
+  }
+
+  sigemptyset(&mask);
+  sigaddset(&mask, signum);
+  if (pthread_sigmask(SIG_UNBLOCK, &mask, NULL)) {
+    abort();
+  }
+}
+
+
+int uv_signal_init(uv_loop_t* loop, uv_signal_t* handle) {
+  int err;
+
+  err = uv__signal_loop_once_init(loop);
+  if (err) {
+    return err;
+  }
+
+  handle->loop = loop;
+  handle->flags = UV_HANDLE_REF;  /* Ref the loop when active. */
+  handle->signum = 0;
+  handle->caught_signals = 0;
+  handle->dispatched_signals = 0;
+  handle->dropped_signals = 0;
+  handle->coalesced_signals = 0;
+  handle->coalesce_cb = NULL;
+  handle->info_cb = NULL;
+  handle->recv_cb = NULL;
+
+  return 0;
+}
+
+
+void uv__signal_close(uv_signal_t* handle) {
+  uv__signal_stop(handle);
+}
+
+
+int uv_signal_start(uv_signal_t* handle, uv_signal_cb signal_cb, int signum) {
+  return uv__signal_start(handle, signal_cb, signum, 0);
+}
+
+
+int uv_signal_start_oneshot(uv_signal_t* handle, uv_signal_cb signal_cb, int signum) {
+  return uv__signal_start(handle, signal_cb, signum, UV_SIGNAL_ONE_SHOT);
+}
+
+
+int uv_signal_start_policy(uv_signal_t* handle,
+                           uv_signal_cb signal_cb,
+                           int signum,
+                           uv_signal_policy policy) {
+  switch (policy) {
+    case UV_SIGNAL_BROADCAST:
+      return uv__signal_start(handle, signal_cb, signum, 0);
+    case UV_SIGNAL_ROUND_ROBIN:
+      return uv__signal_start(handle, signal_cb, signum, UV_SIGNAL_ROTATE);
+    case UV_SIGNAL_LEAST_LOADED:
+      return uv__signal_start(handle, signal_cb, signum, UV_SIGNAL_BALANCE);
+  }
+
+  return EINVAL;
+}
+
+
+int uv_signal_start_coalesced(uv_signal_t* handle, uv_signal_coalesce_cb coalesce_cb, int signum) {
+  handle->coalesce_cb = coalesce_cb;
+  return uv__signal_start(handle, NULL, signum, UV_SIGNAL_COALESCE);
+}
+
+
+static int uv__signal_ring_init(uv_loop_t* loop) {
+  struct uv__signal_ring* ring;
+
+  if (loop->signal_ring != NULL) {
+    return 0;
+  }
+
+  ring = uv__signal_ring_create();
+  if (ring == NULL) {
+    return ENOMEM;
+  }
+
+  __atomic_store_n(&loop->signal_ring, ring, __ATOMIC_RELEASE);
+  return 0;
+}
+
+
+int uv_signal_start_info(uv_signal_t* handle, uv_signal_info_cb info_cb, int signum) {
+  int err;
+
+  err = uv__signal_ring_init(handle->loop);
+  if (err) {
+    return err;
+  }
+
+  handle->info_cb = info_cb;
+  return uv__signal_start(handle, NULL, signum, UV_SIGNAL_INFO);
+}
+
+
+static int uv__signal_channel(int channel) {
+  if (channel < 0 || channel > SIGRTMAX - SIGRTMIN) {
+    return -1;
+  }
+
+  return SIGRTMIN + channel;
+}
+
+
+int uv_signal_recv_start(uv_signal_t* handle, uv_signal_recv_cb recv_cb, int channel) {
+  int signum;
+  int err;
+
+  signum = uv__signal_channel(channel);
+  if (signum == -1) {
+    return EINVAL;
+  }
+
+  err = uv__signal_ring_init(handle->loop);
+  if (err) {
+    return err;
+  }
+
+  handle->recv_cb = recv_cb;
+  return uv__signal_start(handle, NULL, signum, UV_SIGNAL_RECV);
+}
+
+
+int uv_signal_send(int pid, int channel, union sigval value) {
+  int signum;
+
+  signum = uv__signal_channel(channel);
+  if (signum == -1) {
+    return EINVAL;
+  }
+
+  if (sigqueue(pid, signum, value)) {
+    return errno;
+  }
+
+  return 0;
+}
+
+
+int uv_signal_send_pidfd(int pidfd, int channel, union sigval value) {
+  siginfo_t info;
+  int signum;
+
+  signum = uv__signal_channel(channel);
+  if (signum == -1) {
+    return EINVAL;
+  }
+
+  /* Same record sigqueue() would build. */
+  memset(&info, 0, sizeof(info));
+  info.si_signo = signum;
+  info.si_code = SI_QUEUE;
+  info.si_pid = getpid();
+  info.si_uid = getuid();
+  info.si_value = value;
+
+  if (syscall(SYS_pidfd_send_signal, pidfd, signum, &info, 0)) {
+    return errno;
+  }
+
+  return 0;
+}
+
+
+static int uv__signal_needs_register(int signum, int oneshot) {
+  /* When this function is called, the signal lock must be held.
+   *
+   * If at this point there are no active signal watchers for this signum (in
    * any of the loops), it's time to try and register a handler for it here.
-   * Also in case there's only one-shot handlers and a regular handler comes in.
+   * Also in case there's only one-shot handlers and a regular handler comes in,
+   * or the one-shot handler already fired.
+   */
+  return uv__signal_nhandles[signum] == 0 ||
+         (!oneshot && uv__signal_nregular[signum] == 0) ||
+         __atomic_load_n(&uv__signal_disarmed[signum], __ATOMIC_RELAXED);
+}
+
+
+static void uv__signal_attach(uv_signal_t* handle, int signum, unsigned int flags) {
+  /* When this function is called, the signal lock must be held and the
+   * handler for {signum} must be registered.
+   */
+  struct uv__signal_slot* slot;
+
+  uv__signal_nhandles[signum]++;
+  if (!(flags & UV_SIGNAL_ONE_SHOT)) {
+    uv__signal_nregular[signum]++;
+  }
+
+  __atomic_store_n(&uv__signal_policy[signum], flags & UV__SIGNAL_POLICY, __ATOMIC_RELAXED);
+
+  handle->signum = signum;
+  handle->flags |= flags;
+
+  /* The first handle of this loop makes the handler notify it. Signals
+   * counted before that don't belong to anybody.
+   */
+  slot = &handle->loop->signal_slots[signum];
+  if (uv__signal_slot_empty(slot)) {
+    __atomic_store_n(&slot->dispatched,
+                     __atomic_load_n(&slot->caught, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->caught_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->lost, 0, __ATOMIC_RELAXED);
+
+    if (uv__signal_batching) {
+      uv__signal_change(signum, handle->loop, 1);
+    } else {
+      uv__signal_set_insert(signum, handle->loop);
+    }
+  }
+
+  uv__signal_slot_add(slot, handle);
+  if (flags & UV__SIGNAL_RECORDS) {
+    __atomic_fetch_add(&slot->ninfo, 1, __ATOMIC_RELEASE);
+  }
+}
+
+
+static void uv__signal_detach(uv_signal_t* handle) {
+  /* When this function is called, the signal lock must be held. The caller
+   * fixes up the handler registration for handle->signum afterwards.
+   */
+  int signum;
+
+  signum = handle->signum;
+
+  uv__signal_slot_remove(handle->loop, signum, handle);
+  if (handle->flags & UV__SIGNAL_RECORDS) {
+    __atomic_fetch_sub(&handle->loop->signal_slots[signum].ninfo, 1, __ATOMIC_RELEASE);
+  }
+
+  if (uv__signal_slot_empty(&handle->loop->signal_slots[signum])) {
+    if (uv__signal_batching) {
+      uv__signal_change(signum, handle->loop, 0);
+    } else {
+      uv__signal_set_remove(signum, handle->loop);
+    }
+  }
+
+  uv__signal_nhandles[signum]--;
+  if (!(handle->flags & UV_SIGNAL_ONE_SHOT)) {
+    uv__signal_nregular[signum]--;
+  }
+}
+
+
+static void uv__signal_detached(int signum, int rem_regular) {
+  /* When this function is called, the signal lock must be held.
+   *
+   * Check if there are other active signal watchers observing this signal. If
+   * not, unregister the signal handler. If only one-shot watchers are left,
+   * the handler must reset itself again.
+   */
+  int ret;
+
+  if (uv__signal_nhandles[signum] == 0) {
+    uv__signal_unregister_handler(signum);
+  } else if (uv__signal_nregular[signum] == 0 && rem_regular) {
+    ret = uv__signal_register_handler(signum, 1);
+    assert(ret == 0);
+    (void)ret;
+  }
+}
+
+
+static int uv__signal_uses_fd(const uv_signal_t* handle) {
+  /* The receiver thread would compete with the signalfd for the signal. */
+  return (handle->loop->flags & UV_LOOP_SIGNALFD) && !uv__signal_thread_enabled;
+}
+
+
+static void uv__signal_set_active(uv_signal_t* handle, uv_signal_cb signal_cb);
+
+
+static int uv__signal_activate(uv_signal_t* handle, uv_signal_cb signal_cb) {
+  /* Called without the signal lock, after uv__signal_attach(). */
+  int err;
+
+  if (uv__signal_uses_fd(handle)) {
+    err = uv__signal_fd_add(handle->loop, handle->signum);
+    if (err) {
+      uv__signal_stop(handle);
+      return err;
+    }
+    handle->flags |= UV_SIGNAL_FD;
+  }
+
+  uv__signal_set_active(handle, signal_cb);
+
+  return 0;
+}
+
+
+static void uv__signal_set_active(uv_signal_t* handle, uv_signal_cb signal_cb) {
+  handle->signal_cb = signal_cb;
+  if ((handle->flags & UV_HANDLE_ACTIVE) != 0) {
+    return;
+  }
+  handle->flags |= UV_HANDLE_ACTIVE;
+  if ((handle->flags & UV_HANDLE_REF) != 0) {
+    handle->loop->active_handles++;
+  }
+}
+
+
+static void uv__signal_deactivate(uv_signal_t* handle, int signum) {
+  /* Called after uv__signal_detach(), with or without the signal lock. */
+  if (handle->flags & UV_SIGNAL_FD) {
+    uv__signal_fd_remove(handle->loop, signum);
+    handle->flags &= ~UV_SIGNAL_FD;
+  }
+
+  handle->flags &= ~(UV_SIGNAL_ONE_SHOT | UV_SIGNAL_COALESCE | UV__SIGNAL_RECORDS | UV__SIGNAL_POLICY);
+  handle->signum = 0;
+  if ((handle->flags & UV_HANDLE_ACTIVE) == 0) {
+    return;
+  }
+  handle->flags &= ~UV_HANDLE_ACTIVE;
+  if ((handle->flags & UV_HANDLE_REF) != 0) {
+    handle->loop->active_handles--;
+  }
+}
+
+
+static int uv__signal_start(uv_signal_t* handle, uv_signal_cb signal_cb, int signum, unsigned int flags) {
+  int oneshot;
+  int old;
+  int err;
+
+  assert((handle->flags & (UV_HANDLE_CLOSING | UV_HANDLE_CLOSED)) == 0);
+
+  /* If the user supplies signum == 0, then return an error already. If the
+   * signum is otherwise invalid then uv__signal_register will find out
+   * eventually.
+   */
+  if (signum == 0) {
+    return -1;
+  }
+
+  if (signum < 0 || signum >= UV__NSIG) {
+    return EINVAL;
+  }
+
+  /* Short circuit: if the signal watcher is already watching {signum} don't
+   * go through the process of deregistering and registering the handler.
+   * Additionally, this avoids pending signals getting lost in the small
+   * time frame that handle->signum == 0.
+   */
+  if (signum == handle->signum &&
+      (flags & (UV_SIGNAL_COALESCE | UV__SIGNAL_RECORDS | UV__SIGNAL_POLICY)) ==
+      (handle->flags & (UV_SIGNAL_COALESCE | UV__SIGNAL_RECORDS | UV__SIGNAL_POLICY))) {
+    handle->signal_cb = signal_cb;
+    return 0;
+  }
+
+  oneshot = (flags & UV_SIGNAL_ONE_SHOT) != 0;
+
+  uv__signal_lock();
+
+  /* Counted deliveries can't be both spread and broadcast. Checked before
+   * the handle lets go of the signal it watches, a refused start leaves it
+   * watching that.
+   */
+  if (uv__signal_nhandles[signum] > (unsigned int) (handle->signum == signum) &&
+      uv__signal_policy[signum] != (flags & UV__SIGNAL_POLICY)) {
+    uv__signal_unlock();
+    return EBUSY;
+  }
+
+  /* Likewise for an invalid signal. Moving within {signum} can't fail, its
+   * handler is in place already.
    */
-  first_handle = uv__signal_first_handle(signum);
-  if (first_handle == NULL || (!oneshot && (first_handle->flags & UV_SIGNAL_ONE_SHOT))) {
+  if (handle->signum != signum && uv__signal_needs_register(signum, oneshot)) {
+    err = uv__signal_register_handler(signum, oneshot);
+    if (err) {
+      uv__signal_unlock();
+      return err;
+    }
+  }
+
+  /* If the signal handler was already active, stop it first. */
+  old = handle->signum;
+  if (old != 0) {
+    uv__signal_detach(handle);
+    uv__signal_detached(old, !(handle->flags & UV_SIGNAL_ONE_SHOT));
+    uv__signal_deactivate(handle, old);
+  }
+
+  if (uv__signal_needs_register(signum, oneshot)) {
     err = uv__signal_register_handler(signum, oneshot);
     if (err) {
-      /* Registering the signal handler failed. Must be an invalid signal. */
-      uv__signal_unlock_and_unblock(&saved_sigmask);
+      uv__signal_unlock();
       return err;
     }
   }
 
-  handle->signum = signum;
-  if (oneshot) {
-    handle->flags |= UV_SIGNAL_ONE_SHOT;
+  uv__signal_attach(handle, signum, flags);
+
+  uv__signal_unlock();
+
+  return uv__signal_activate(handle, signal_cb);
+}
+
+
+int uv_signal_start_many(uv_signal_t** handles,
+                         const int* signums,
+                         unsigned int nhandles,
+                         uv_signal_cb signal_cb) {
+  unsigned int moving[UV__NSIG];
+  unsigned char registered[UV__NSIG];
+  unsigned char touched[UV__NSIG];
+  unsigned char rem_regular[UV__NSIG];
+  uv_signal_t* handle;
+  unsigned int i;
+  unsigned int j;
+  int signum;
+  int err;
+
+  /* Everything that can fail is done before any handle changes: argument
+   * checks, adding the signals to signalfds, the policy check and handler
+   * registration. Handles already watching their signal with
+   * uv_signal_start() only get the new callback, the rest are marked with
+   * UV_SIGNAL_BATCHED until they are attached.
+   */
+  err = 0;
+  j = 0;
+  for (i = 0; i < nhandles; i++) {
+    handle = handles[i];
+    assert((handle->flags & (UV_HANDLE_CLOSING | UV_HANDLE_CLOSED)) == 0);
+
+    if (signums[i] <= 0 || signums[i] >= UV__NSIG || (handle->flags & UV_SIGNAL_BATCHED)) {
+      err = EINVAL;
+      break;
+    }
+
+    handle->flags |= UV_SIGNAL_BATCHED;
+  }
+
+  if (err) {
+    goto fail;
+  }
+
+  for (j = 0; j < nhandles; j++) {
+    handle = handles[j];
+    if (handle->signum == signums[j] &&
+        !(handle->flags & (UV_SIGNAL_ONE_SHOT | UV_SIGNAL_COALESCE | UV__SIGNAL_RECORDS | UV__SIGNAL_POLICY))) {
+      handle->flags &= ~UV_SIGNAL_BATCHED;
+      continue;
+    }
+
+    if (uv__signal_uses_fd(handle)) {
+      err = uv__signal_fd_add(handle->loop, signums[j]);
+      if (err) {
+        goto fail;
+      }
+    }
+  }
+
+  memset(moving, 0, sizeof(moving));
+  memset(registered, 0, sizeof(registered));
+  memset(touched, 0, sizeof(touched));
+  memset(rem_regular, 0, sizeof(rem_regular));
+
+  for (i = 0; i < nhandles; i++) {
+    handle = handles[i];
+    if ((handle->flags & UV_SIGNAL_BATCHED) && handle->signum != 0) {
+      moving[handle->signum]++;
+    }
+  }
+
+  uv__signal_lock();
+
+  /* Handles of this batch that watch a signal now are moved away from it. */
+  for (i = 0; i < nhandles; i++) {
+    signum = signums[i];
+    if (uv__signal_nhandles[signum] > moving[signum] && uv__signal_policy[signum] != 0) {
+      err = EBUSY;
+      break;
+    }
+  }
+
+  /* At most one sigaction() per signal. Moved handles are detached after, so
+   * a signal the batch starts never loses its handler in between.
+   */
+  for (i = 0; err == 0 && i < nhandles; i++) {
+    signum = signums[i];
+    if (!(handles[i]->flags & UV_SIGNAL_BATCHED) ||
+        registered[signum] ||
+        !uv__signal_needs_register(signum, 0)) {
+      continue;
+    }
+
+    err = uv__signal_register_handler(signum, 0);
+    if (err == 0) {
+      registered[signum] = 1;
+    }
+  }
+
+  if (err) {
+    for (signum = 1; signum < UV__NSIG; signum++) {
+      if (registered[signum]) {
+        uv__signal_detached(signum, 1);
+      }
+    }
+    uv__signal_unlock();
+    i = nhandles;
+    goto fail;
+  }
+
+  uv__signal_batch_begin();
+
+  for (i = 0; i < nhandles; i++) {
+    handle = handles[i];
+    if (!(handle->flags & UV_SIGNAL_BATCHED) || handle->signum == 0) {
+      continue;
+    }
+
+    signum = handle->signum;
+    touched[signum] = 1;
+    if (!(handle->flags & UV_SIGNAL_ONE_SHOT)) {
+      rem_regular[signum] = 1;
+    }
+
+    uv__signal_detach(handle);
+    uv__signal_deactivate(handle, signum);
+  }
+
+  for (i = 0; i < nhandles; i++) {
+    if (handles[i]->flags & UV_SIGNAL_BATCHED) {
+      uv__signal_attach(handles[i], signums[i], 0);
+    }
+  }
+
+  for (signum = 1; signum < UV__NSIG; signum++) {
+    if (touched[signum]) {
+      uv__signal_detached(signum, rem_regular[signum]);
+    }
+  }
+
+  uv__signal_batch_end();
+  uv__signal_unlock();
+
+  for (i = 0; i < nhandles; i++) {
+    handle = handles[i];
+    if (handle->flags & UV_SIGNAL_BATCHED) {
+      handle->flags &= ~UV_SIGNAL_BATCHED;
+      if (uv__signal_uses_fd(handle)) {
+        handle->flags |= UV_SIGNAL_FD;
+      }
+    }
+
+    uv__signal_set_active(handle, signal_cb);
+  }
+
+  return 0;
+
+fail:
+  /* Undo the signalfd additions made before handle {j}, then the marks. */
+  while (j-- > 0) {
+    handle = handles[j];
+    if ((handle->flags & UV_SIGNAL_BATCHED) && uv__signal_uses_fd(handle)) {
+      uv__signal_fd_remove(handle->loop, signums[j]);
+    }
+  }
+
+  while (i-- > 0) {
+    handles[i]->flags &= ~UV_SIGNAL_BATCHED;
   }
 
-  uv__signal_tree_s_RB_INSERT(&uv__signal_tree, handle);
+  return err;
+}
 
-  uv__signal_unlock_and_unblock(&saved_sigmask);
 
-  handle->signal_cb = signal_cb;
-  if ((handle->flags & UV_HANDLE_ACTIVE) != 0) {
-    return 0;           
-  }              
-  handle->flags |= UV_HANDLE_ACTIVE;                                           
-  if ((handle->flags & UV_HANDLE_REF) != 0) {
-    handle->loop->active_handles++;
+static void uv__signal_latency(uv_loop_t* loop, uint64_t ns, uint64_t now) {
+  unsigned int bucket;
+
+  /* Not timed, the signal raced with the previous drain. */
+  if (ns == 0) {
+    return;
   }
 
-  return 0;
+  bucket = 0;
+  if (now > ns) {
+    bucket = 64 - __builtin_clzll(now - ns);
+    if (bucket >= UV_SIGNAL_LATENCY_BUCKETS) {
+      bucket = UV_SIGNAL_LATENCY_BUCKETS - 1;
+    }
+  }
+
+  loop->signal_stats.latency[bucket]++;
 }
 
 
-static void uv__signal_event(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
-  uv__signal_msg_t* msg;
+static void uv__signal_fanout(uv_loop_t* loop, int signum, unsigned int count) {
+  struct uv__signal_slot* slot;
+  uv_signal_stats_t* stats;
   uv_signal_t* handle;
-  char buf[sizeof(uv__signal_msg_t) * 32];
-  size_t bytes, end, i;
-  int r;
+  unsigned int nhandles;
+  unsigned int i;
+  unsigned int k;
 
-  bytes = 0;
-  end = 0;
+  slot = &loop->signal_slots[signum];
+  stats = &loop->signal_stats;
 
-  do {
-    r = read(loop->signal_pipefd[0], buf + bytes, sizeof(buf) - bytes);
+  /* Handles started by a callback didn't see these signals, so only walk
+   * the ones that are there now. Handles stopped by a callback leave a hole.
+   */
+  uv__signal_slot_order(slot);
+  nhandles = slot->nhandles;
+  loop->signal_dispatching = signum;
 
-    if (r == -1 && errno == EINTR) {
+  for (i = 0; i < nhandles; i++) {
+    handle = slot->handles[i];
+    if (handle == NULL) {
       continue;
     }
 
-    if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-      /* If there are bytes in the buffer already (which really is extremely
-       * unlikely if possible at all) we can't exit the function here. We'll
-       * spin until more bytes are read instead.
-       */
-      if (bytes > 0) {
-        continue;
-      }
+    /* These get the queued siginfo records instead. */
+    if (handle->flags & UV__SIGNAL_RECORDS) {
+      continue;
+    }
 
-      /* Otherwise, there was nothing there. */
-      return;
+    assert(!(handle->flags & UV_HANDLE_CLOSING));
+    handle->caught_signals += count;
+    stats->caught += count;
+
+    if (handle->flags & UV_SIGNAL_COALESCE) {
+      handle->dispatched_signals += count;
+      handle->coalesced_signals += count - 1;
+      stats->dispatched += count;
+      stats->coalesced += count - 1;
+      handle->coalesce_cb(handle, signum, count);
+      continue;
     }
 
-    /* Other errors really should never happen. */
-    if (r == -1) {
-      abort();
+    /* Stopped by a callback or as a one-shot, the rest never reaches it. */
+    for (k = 0; k < count && slot->handles[i] == handle; k++) {
+      handle->dispatched_signals++;
+      stats->dispatched++;
+      handle->signal_cb(handle, signum);
+
+      if (handle->flags & UV_SIGNAL_ONE_SHOT) {
+        uv__signal_stop(handle);
+      }
     }
+  }
 
-    bytes += r;
+  loop->signal_dispatching = 0;
 
-    /* `end` is rounded down to a multiple of sizeof(uv__signal_msg_t). */
-    end = (bytes / sizeof(uv__signal_msg_t)) * sizeof(uv__signal_msg_t);
+  uv__signal_slot_tidy(slot);
+}
 
-    for (i = 0; i < end; i += sizeof(uv__signal_msg_t)) {
-      msg = (uv__signal_msg_t*) (buf + i);
-      handle = msg->handle;
 
-      if (msg->signum == handle->signum) {
-        assert(!(handle->flags & UV_HANDLE_CLOSING));
-        handle->signal_cb(handle, handle->signum);
-      }
+static int uv__signal_congested(uv_loop_t* loop) {
+  /* A throttled ring leaves the signal in the kernel's queue, where it
+   * counts against the sender's RLIMIT_SIGPENDING. Before that the ring
+   * holds the backlog, or with a signalfd the kernel's queue, which is
+   * only read as far as the ring can take.
+   */
+  struct uv__signal_ring* ring;
+  unsigned int fill;
+
+  ring = loop->signal_ring;
+  if (__atomic_load_n(&ring->throttled, __ATOMIC_RELAXED)) {
+    return 1;
+  }
+
+  fill = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) - ring->head;
+  return fill >= ring->backoff || loop->signal_fd_backlog >= ring->backoff;
+}
+
+
+static void uv__signal_records_dispatch(uv_loop_t* loop,
+                                        const uv_siginfo_t* msgs,
+                                        unsigned int nmsgs,
+                                        int status) {
+  /* All records in {msgs} are for the same signal. */
+  struct uv__signal_slot* slot;
+  uv_signal_stats_t* stats;
+  uv_signal_t* handle;
+  unsigned int nhandles;
+  unsigned int i;
+  unsigned int k;
+
+  slot = &loop->signal_slots[msgs[0].signo];
+  stats = &loop->signal_stats;
+  uv__signal_slot_order(slot);
+  nhandles = slot->nhandles;
+  loop->signal_dispatching = msgs[0].signo;
+
+  for (i = 0; i < nhandles; i++) {
+    handle = slot->handles[i];
+    if (handle == NULL || (handle->flags & UV__SIGNAL_RECORDS) == 0) {
+      continue;
+    }
 
+    handle->caught_signals += nmsgs;
+    stats->caught += nmsgs;
+
+    if (handle->flags & UV_SIGNAL_RECV) {
+      handle->dispatched_signals += nmsgs;
+      stats->dispatched += nmsgs;
+      handle->recv_cb(handle, msgs, nmsgs, status);
+      continue;
+    }
+
+    /* Stop once the callback stops the handle. */
+    for (k = 0; k < nmsgs && slot->handles[i] == handle; k++) {
       handle->dispatched_signals++;
+      stats->dispatched++;
+      handle->info_cb(handle, &msgs[k]);
+    }
+  }
 
-      if (handle->flags & UV_SIGNAL_ONE_SHOT) {
-        uv__signal_stop(handle);
+  loop->signal_dispatching = 0;
+
+  uv__signal_slot_tidy(slot);
+}
+
+
+static void uv__signal_unthrottle(uv_loop_t* loop) {
+  struct uv__queue* q;
+  uv_loop_t* stalled;
+
+  /* Called with the ring empty. The last ring to drain resumes the signalfd
+   * loops that stopped reading, handler and receiver thread look for
+   * themselves.
+   */
+  if (__atomic_exchange_n(&loop->signal_ring->throttled, 0, __ATOMIC_RELAXED) == 0) {
+    return;
+  }
+
+  if (__atomic_sub_fetch(&uv__signal_nthrottled, 1, __ATOMIC_SEQ_CST) > 0) {
+    return;
+  }
+
+  uv__signal_lock();
+
+  while (!uv__queue_empty(&uv__signal_stalled)) {
+    q = uv__queue_head(&uv__signal_stalled);
+    uv__queue_remove(q);
+    uv__queue_init(q);
+    stalled = uv__queue_data(q, uv_loop_t, signal_stalled_queue);
+    if (stalled != loop) {
+      uv__signal_wakeup(stalled);
+    }
+  }
+
+  uv__signal_unlock();
+}
+
+
+static void uv__signal_resume(uv_loop_t* loop) {
+  sigset_t mask;
+  unsigned int gen;
+  int signum;
+
+  if (__atomic_load_n(&uv__signal_nthrottled, __ATOMIC_SEQ_CST) > 0) {
+    return;
+  }
+
+  if (loop->signal_fd_stalled) {
+    uv__signal_lock();
+    uv__queue_remove(&loop->signal_stalled_queue);
+    uv__queue_init(&loop->signal_stalled_queue);
+    uv__signal_unlock();
+    loop->signal_fd_stalled = 0;
+    uv__io_start(loop, &loop->signal_fd_watcher, POLLIN);
+  }
+
+  /* Unblock what the handler left blocked in this thread. Signals this loop
+   * reads from its signalfd or the receiver thread waits for stay blocked.
+   */
+  gen = __atomic_load_n(&uv__signal_held_gen, __ATOMIC_ACQUIRE);
+  if (gen == loop->signal_held_gen) {
+    return;
+  }
+
+  loop->signal_held_gen = gen;
+  sigemptyset(&mask);
+
+  for (signum = 1; signum < UV__NSIG; signum++) {
+    if (!__atomic_load_n(&uv__signal_held[signum], __ATOMIC_RELAXED)) {
+      continue;
+    }
+
+    if (sigismember(&loop->signal_fd_mask, signum) == 1) {
+      continue;
+    }
+
+    if (__atomic_load_n(&uv__signal_thread_enabled, __ATOMIC_ACQUIRE) &&
+        sigismember(&uv__signal_thread_set, signum) == 1) {
+      continue;
+    }
+
+    sigaddset(&mask, signum);
+  }
+
+  pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
+}
+
+
+static void uv__signal_records_lost(uv_loop_t* loop,
+                                    struct uv__signal_slot* slot,
+                                    unsigned int lost) {
+  uv_signal_t* handle;
+  unsigned int i;
+
+  /* Every handle that consumes records missed them. */
+  for (i = 0; i < slot->nhandles; i++) {
+    handle = slot->handles[i];
+    if (handle == NULL || (handle->flags & UV__SIGNAL_RECORDS) == 0) {
+      continue;
+    }
+
+    handle->dropped_signals += lost;
+    loop->signal_stats.dropped += lost;
+  }
+}
+
+
+static void uv__signal_records_drain(uv_loop_t* loop) {
+  uv_siginfo_t batch[UV__SIGNAL_BATCH];
+  uint64_t ns[UV__SIGNAL_BATCH];
+  uint64_t now;
+  unsigned int n;
+  unsigned int i;
+  unsigned int j;
+  int status;
+
+  /* Records are handed out in runs of the same signal so channels see their
+   * messages in order and in batches. Records queued for a signal no handle
+   * on this loop watches any more are simply dropped.
+   */
+  while (loop->signal_ring != NULL) {
+    for (n = 0; n < UV__SIGNAL_BATCH; n++) {
+      if (uv__signal_ring_pop(loop->signal_ring, &batch[n], &ns[n])) {
+        break;
       }
     }
 
-    bytes -= end;
+    if (n == 0) {
+      uv__signal_unthrottle(loop);
+      break;
+    }
 
-    /* If there are any "partial" messages left, move them to the start of the
-     * the buffer, and spin. This should not happen.
-     */
-    if (bytes) {
-      memmove(buf, buf + end, bytes);
+    now = uv__signal_now();
+    for (i = 0; i < n; i++) {
+      uv__signal_latency(loop, ns[i], now);
+    }
+
+    status = uv__signal_congested(loop) ? EAGAIN : 0;
+
+    for (i = 0; i < n; i = j) {
+      for (j = i + 1; j < n && batch[j].signo == batch[i].signo; j++);
+      uv__signal_records_dispatch(loop, batch + i, j - i, status);
+    }
+  }
+}
+
+
+static void uv__signal_drain(uv_loop_t* loop) {
+  struct uv__signal_slot* slot;
+  unsigned int caught;
+  unsigned int count;
+  unsigned int lost;
+  uint64_t oldest;
+  uint64_t now;
+  int signum;
+
+  uv__signal_records_drain(loop);
+
+  for (signum = 1; signum < UV__NSIG; signum++) {
+    slot = &loop->signal_slots[signum];
+    if (uv__signal_slot_empty(slot)) {
+      continue;
+    }
+
+    if (__atomic_load_n(&slot->lost, __ATOMIC_RELAXED) > 0) {
+      lost = __atomic_exchange_n(&slot->lost, 0, __ATOMIC_RELAXED);
+      uv__signal_records_lost(loop, slot, lost);
+    }
+
+    caught = __atomic_load_n(&slot->caught, __ATOMIC_ACQUIRE);
+    count = caught - slot->dispatched;
+    if (count == 0) {
       continue;
     }
-  } while (end == sizeof buf);
+
+    __atomic_store_n(&slot->dispatched, caught, __ATOMIC_RELAXED);
+
+    /* Taken after the count, a signal that slips in between is timed with
+     * the next batch, from when that batch's first signal arrived.
+     */
+    oldest = __atomic_exchange_n(&slot->caught_ns, 0, __ATOMIC_RELAXED);
+
+    /* Record-only slots were timed by uv__signal_records_drain(). */
+    if (slot->nhandles - slot->nholes > slot->ninfo) {
+      now = uv__signal_now();
+      uv__signal_latency(loop, oldest, now);
+    }
+
+    uv__signal_fanout(loop, signum, count);
+  }
+
+  uv__signal_resume(loop);
+}
+
+
+void uv__signal_run_pending(uv_loop_t* loop) {
+  /* Clear the flag first so signals caught from here on write a new wakeup. */
+  if (__atomic_exchange_n(&loop->signal_pending, 0, __ATOMIC_SEQ_CST) == 0) {
+    return;
+  }
+
+  uv__signal_drain(loop);
 }
 
 
-static int uv__signal_compare(uv_signal_t* w1, uv_signal_t* w2) {
-  int f1;
-  int f2;
-  /* Compare signums first so all watchers with the same signnum end up
-   * adjacent.
+static void uv__signal_event(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  uint64_t wakeups;
+  int r;
+
+  /* The eventfd only carries wakeups, the counts are in the slots. One read
+   * resets it.
    */
-  if (w1->signum < w2->signum) return -1;
-  if (w1->signum > w2->signum) return 1;
+  do {
+    r = read(loop->signal_wakeup_fd, &wakeups, sizeof(wakeups));
+  } while (r == -1 && errno == EINTR);
+
+  /* Other errors really should never happen. */
+  if (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    abort();
+  }
+
+  uv__signal_run_pending(loop);
+}
+
 
-  /* Handlers without UV_SIGNAL_ONE_SHOT set will come first, so if the first
-   * handler returned is a one-shot handler, the rest will be too.
+static int uv__signal_fd_batch(uv_loop_t* loop,
+                               const struct signalfd_siginfo* info,
+                               size_t n) {
+  uv_siginfo_t si;
+  unsigned int epoch;
+  uint64_t ns;
+  int throttled;
+  size_t i;
+
+  ns = uv__signal_now();
+
+  /* This loop's own slots are drained below without a wakeup, other loops
+   * are notified as if the handler had run.
    */
-  f1 = w1->flags & UV_SIGNAL_ONE_SHOT;
-  f2 = w2->flags & UV_SIGNAL_ONE_SHOT;
-  if (f1 < f2) return -1;
-  if (f1 > f2) return 1;
+  epoch = uv__signal_read_begin();
+  throttled = 0;
+
+  for (i = 0; i < n; i++) {
+    si.signo = info[i].ssi_signo;
+    si.code = info[i].ssi_code;
+    si.pid = info[i].ssi_pid;
+    si.uid = info[i].ssi_uid;
+    si.value.sival_ptr = (void*) (uintptr_t) info[i].ssi_ptr;
+    throttled |= uv__signal_deliver(&si, ns, loop);
+  }
+
+  uv__signal_read_end(epoch);
+
+  /* The kernel queue holds the backlog losslessly, don't move more of it
+   * into the ring than the ring can take. A short read emptied it.
+   */
+  loop->signal_fd_backlog += n;
+  if (loop->signal_ring != NULL) {
+    uv__signal_records_drain(loop);
+  }
+  if (n < UV__SIGNAL_BATCH) {
+    loop->signal_fd_backlog = 0;
+  }
 
-  /* Sort by loop pointer, so we can easily look up the first item after
-   * { .signum = x, .loop = NULL }.
+  /* Another loop's ring is still throttled, stop reading until it drains.
+   * Checked again under the lock, uv__signal_unthrottle() empties the
+   * stalled queue under it once the count drops to zero.
    */
-  if (w1->loop < w2->loop) return -1;
-  if (w1->loop > w2->loop) return 1;
+  if (!throttled || loop->signal_fd_stalled) {
+    return loop->signal_fd_stalled;
+  }
 
-  if (w1 < w2) return -1;
-  if (w1 > w2) return 1;
+  uv__signal_lock();
 
-  return 0;
+  if (__atomic_load_n(&uv__signal_nthrottled, __ATOMIC_SEQ_CST) > 0) {
+    loop->signal_fd_stalled = 1;
+    uv__queue_insert_tail(&uv__signal_stalled, &loop->signal_stalled_queue);
+    uv__io_stop(loop, &loop->signal_fd_watcher, POLLIN);
+  }
+
+  uv__signal_unlock();
+
+  return loop->signal_fd_stalled;
+}
+
+
+static void uv__signal_fd_event(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  struct signalfd_siginfo info[UV__SIGNAL_BATCH];
+  size_t n;
+  ssize_t r;
+
+  do {
+    do {
+      r = read(w->fd, info, sizeof info);
+    } while (r == -1 && errno == EINTR);
+
+    if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      loop->signal_fd_backlog = 0;
+      break;
+    }
+
+    if (r == -1) {
+      abort();
+    }
+
+    n = r / sizeof(info[0]);
+    if (uv__signal_fd_batch(loop, info, n)) {
+      break;
+    }
+  } while (n == ARRAY_SIZE(info));
+
+  uv__signal_drain(loop);
 }
 
 
@@ -904,49 +2391,149 @@ int uv_signal_stop(uv_signal_t* handle) {
 }
 
 
+int uv_signal_stats(const uv_signal_t* handle, uv_signal_stats_t* stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->caught = handle->caught_signals;
+  stats->dispatched = handle->dispatched_signals;
+  stats->dropped = handle->dropped_signals;
+  stats->coalesced = handle->coalesced_signals;
+
+  return 0;
+}
+
+
+int uv_loop_signal_stats(const uv_loop_t* loop, uv_signal_stats_t* stats) {
+  *stats = loop->signal_stats;
+
+  return 0;
+}
+
+
+int uv_signal_stop_many(uv_signal_t** handles, unsigned int nhandles) {
+  unsigned char touched[UV__NSIG];
+  unsigned char rem_regular[UV__NSIG];
+  uv_signal_t* handle;
+  unsigned int i;
+  unsigned int j;
+  int signum;
+
+  /* A handle listed twice would be detached twice. */
+  for (i = 0; i < nhandles; i++) {
+    if (handles[i]->flags & UV_SIGNAL_BATCHED) {
+      break;
+    }
+    handles[i]->flags |= UV_SIGNAL_BATCHED;
+  }
+
+  for (j = 0; j < i; j++) {
+    handles[j]->flags &= ~UV_SIGNAL_BATCHED;
+  }
+
+  if (i < nhandles) {
+    return EINVAL;
+  }
+
+  memset(touched, 0, sizeof(touched));
+  memset(rem_regular, 0, sizeof(rem_regular));
+
+  uv__signal_lock();
+  uv__signal_batch_begin();
+
+  for (i = 0; i < nhandles; i++) {
+    handle = handles[i];
+    assert((handle->flags & (UV_HANDLE_CLOSING | UV_HANDLE_CLOSED)) == 0);
+
+    if (handle->signum == 0) {
+      continue;
+    }
+
+    touched[handle->signum] = 1;
+    if (!(handle->flags & UV_SIGNAL_ONE_SHOT)) {
+      rem_regular[handle->signum] = 1;
+    }
+
+    uv__signal_detach(handle);
+  }
+
+  /* At most one sigaction() per signal. */
+  for (signum = 1; signum < UV__NSIG; signum++) {
+    if (touched[signum]) {
+      uv__signal_detached(signum, rem_regular[signum]);
+    }
+  }
+
+  uv__signal_batch_end();
+  uv__signal_unlock();
+
+  for (i = 0; i < nhandles; i++) {
+    if (handles[i]->signum != 0) {
+      uv__signal_deactivate(handles[i], handles[i]->signum);
+    }
+  }
+
+  return 0;
+}
+
+
 static void uv__signal_stop(uv_signal_t* handle) {
-  uv_signal_t* removed_handle;
-  sigset_t saved_sigmask;
-  uv_signal_t* first_handle;
-  int rem_oneshot;
-  int first_oneshot;
-  int ret;
+  int signum;
 
   /* If the watcher wasn't started, this is a no-op. */
   if (handle->signum == 0) {
     return;
   }
 
-  uv__signal_block_and_lock(&saved_sigmask);
+  signum = handle->signum;
+
+  uv__signal_lock();
+  uv__signal_detach(handle);
+  uv__signal_detached(signum, !(handle->flags & UV_SIGNAL_ONE_SHOT));
+  uv__signal_unlock();
 
-  removed_handle = uv__signal_tree_s_RB_REMOVE(&uv__signal_tree, handle);
-  assert(removed_handle == handle);
-  (void) removed_handle;
+  uv__signal_deactivate(handle, signum);
+}
 
-  /* Check if there are other active signal watchers observing this signal. If
-   * not, unregister the signal handler.
-   */
-  first_handle = uv__signal_first_handle(handle->signum);
-  if (first_handle == NULL) {
-    uv__signal_unregister_handler(handle->signum);
-  } else {
-    rem_oneshot = handle->flags & UV_SIGNAL_ONE_SHOT;
-    first_oneshot = first_handle->flags & UV_SIGNAL_ONE_SHOT;
-    if (first_oneshot && !rem_oneshot) {
-      ret = uv__signal_register_handler(handle->signum, 1);
-      assert(ret == 0);
-      (void)ret;
+
+void uv__signal_loop_cleanup(uv_loop_t* loop) {
+  struct uv__signal_slot* slot;
+  unsigned int i;
+  int signum;
+
+  /* Stopping the loop's handles takes it out of the signal tables. */
+  for (signum = 1; signum < UV__NSIG; signum++) {
+    slot = &loop->signal_slots[signum];
+    while (!uv__signal_slot_empty(slot)) {
+      i = slot->nhandles;
+      while (slot->handles[--i] == NULL);
+      uv__signal_stop(slot->handles[i]);
     }
   }
 
-  uv__signal_unlock_and_unblock(&saved_sigmask);
+  /* Wait out the handlers and receiver thread that still found it there. */
+  uv__signal_lock();
+  uv__signal_synchronize();
 
-  handle->signum = 0;
-  if ((handle->flags & UV_HANDLE_ACTIVE) == 0) {
-    return;
+  if (loop->signal_fd_stalled) {
+    uv__queue_remove(&loop->signal_stalled_queue);
+    uv__queue_init(&loop->signal_stalled_queue);
+    loop->signal_fd_stalled = 0;
   }
-  handle->flags &= ~UV_HANDLE_ACTIVE;
-  if ((handle->flags & UV_HANDLE_REF) != 0) {
-    handle->loop->active_handles--;
+
+  uv__signal_unlock();
+
+  if (loop->signal_ring != NULL) {
+    uv__signal_unthrottle(loop);
+    uv__free(loop->signal_ring);
+    loop->signal_ring = NULL;
+  }
+
+  if (loop->signal_fd != -1) {
+    uv__close(loop->signal_fd);
+    loop->signal_fd = -1;
+  }
+
+  if (loop->signal_wakeup_fd != -1) {
+    uv__close(loop->signal_wakeup_fd);
+    loop->signal_wakeup_fd = -1;
   }
 }
@@ -0,0 +1,48 @@
+#include "uv.h"
+#include "internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+
+
+struct uv__thread_ctx {
+  uv_thread_cb entry;
+  void* arg;
+};
+
+
+static void* uv__thread_start(void* arg) {
+  struct uv__thread_ctx ctx;
+
+  ctx = *(struct uv__thread_ctx*) arg;
+  uv__free(arg);
+  ctx.entry(ctx.arg);
+
+  return NULL;
+}
+
+
+int uv_thread_create(uv_thread_t* tid, uv_thread_cb entry, void* arg) {
+  struct uv__thread_ctx* ctx;
+  int err;
+
+  ctx = uv__malloc(sizeof(*ctx));
+  if (ctx == NULL) {
+    return ENOMEM;
+  }
+
+  ctx->entry = entry;
+  ctx->arg = arg;
+
+  err = pthread_create(tid, NULL, uv__thread_start, ctx);
+  if (err) {
+    uv__free(ctx);
+  }
+
+  return err;
+}
+
+
+int uv_thread_join(uv_thread_t* tid) {
+  return pthread_join(*tid, NULL);
+}
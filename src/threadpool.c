@@ -0,0 +1,271 @@
+#include "uv.h"
+#include "internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAX_THREADPOOL_SIZE 1024
+
+/* Each worker has its own deque. Requests are spread over them round-robin,
+ * a worker takes from the head of its own and steals from the tail of the
+ * others' when it runs out, so a long request doesn't hold up the ones
+ * queued behind it.
+ */
+struct uv__worker {
+  pthread_mutex_t mutex;
+  struct uv__queue deque;
+  unsigned int size;  /* Read without the mutex to skip empty victims. */
+  uv_thread_t thread;
+} __attribute__((aligned(64)));
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static struct uv__worker* workers;
+static unsigned int nworkers;
+static unsigned int next_worker;
+
+/* Idle workers sleep on idle_cond. npending counts requests in all deques;
+ * a worker bumps nidle before it checks npending and a submitter bumps
+ * npending before it checks nidle, so one of them sees the other.
+ */
+static pthread_mutex_t idle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int nidle;
+static unsigned int npending;
+
+
+static uv_work_t* uv__worker_pop(struct uv__worker* w, int steal) {
+  struct uv__queue* q;
+
+  if (__atomic_load_n(&w->size, __ATOMIC_RELAXED) == 0) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&w->mutex);
+
+  if (uv__queue_empty(&w->deque)) {
+    pthread_mutex_unlock(&w->mutex);
+    return NULL;
+  }
+
+  q = steal ? w->deque.prev : uv__queue_head(&w->deque);
+  uv__queue_remove(q);
+  __atomic_store_n(&w->size, w->size - 1, __ATOMIC_RELAXED);
+
+  pthread_mutex_unlock(&w->mutex);
+
+  __atomic_fetch_sub(&npending, 1, __ATOMIC_SEQ_CST);
+  return uv__queue_data(q, uv_work_t, wq);
+}
+
+
+static uv_work_t* uv__worker_take(struct uv__worker* self) {
+  uv_work_t* req;
+  unsigned int i;
+  unsigned int n;
+
+  req = uv__worker_pop(self, 0);
+  if (req != NULL) {
+    return req;
+  }
+
+  n = self - workers;
+  for (i = 1; i < nworkers; i++) {
+    req = uv__worker_pop(&workers[(n + i) % nworkers], 1);
+    if (req != NULL) {
+      return req;
+    }
+  }
+
+  return NULL;
+}
+
+
+static void uv__worker_wait(void) {
+  pthread_mutex_lock(&idle_mutex);
+  __atomic_fetch_add(&nidle, 1, __ATOMIC_SEQ_CST);
+
+  while (__atomic_load_n(&npending, __ATOMIC_SEQ_CST) == 0) {
+    pthread_cond_wait(&idle_cond, &idle_mutex);
+  }
+
+  __atomic_fetch_sub(&nidle, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&idle_mutex);
+}
+
+
+static void uv__work_post(uv_work_t* req) {
+  uv_loop_t* loop;
+  uv_work_t* head;
+
+  /* The loop may run after_work_cb and reuse {req} as soon as it's pushed. */
+  loop = req->loop;
+
+  head = __atomic_load_n(&loop->work_done, __ATOMIC_RELAXED);
+  do {
+    req->done_next = head;
+  } while (!__atomic_compare_exchange_n(&loop->work_done,
+                                        &head,
+                                        req,
+                                        1,
+                                        __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED));
+
+  uv_async_send(&loop->work_async);
+}
+
+
+static void uv__worker(void* arg) {
+  struct uv__worker* self;
+  uv_work_t* req;
+
+  self = arg;
+
+  for (;;) {
+    req = uv__worker_take(self);
+    if (req == NULL) {
+      uv__worker_wait();
+      continue;
+    }
+
+    req->work_cb(req);
+    uv__work_post(req);
+  }
+}
+
+
+static void uv__threadpool_init(void) {
+  const char* val;
+  sigset_t saved;
+  sigset_t all;
+  unsigned int i;
+  long n;
+
+  n = 0;
+  val = getenv("UV_THREADPOOL_SIZE");
+  if (val != NULL) {
+    n = atol(val);
+  }
+
+  if (n <= 0) {
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  if (n <= 0) {
+    n = 1;
+  }
+
+  if (n > MAX_THREADPOOL_SIZE) {
+    n = MAX_THREADPOOL_SIZE;
+  }
+
+  nworkers = n;
+  workers = uv__calloc(nworkers, sizeof(workers[0]));
+  if (workers == NULL) {
+    abort();
+  }
+
+  for (i = 0; i < nworkers; i++) {
+    if (pthread_mutex_init(&workers[i].mutex, NULL)) {
+      abort();
+    }
+    uv__queue_init(&workers[i].deque);
+  }
+
+  /* Signals are for the loop threads, or the receiver thread; the workers
+   * inherit a full mask.
+   */
+  sigfillset(&all);
+  if (pthread_sigmask(SIG_SETMASK, &all, &saved)) {
+    abort();
+  }
+
+  for (i = 0; i < nworkers; i++) {
+    if (uv_thread_create(&workers[i].thread, uv__worker, &workers[i])) {
+      abort();
+    }
+  }
+
+  if (pthread_sigmask(SIG_SETMASK, &saved, NULL)) {
+    abort();
+  }
+}
+
+
+static void uv__work_done(uv_async_t* handle) {
+  uv_loop_t* loop;
+  uv_work_t* req;
+  uv_work_t* next;
+  uv_work_t* prev;
+
+  loop = handle->loop;
+
+  /* Take everything at once, then restore completion order. */
+  req = __atomic_exchange_n(&loop->work_done, NULL, __ATOMIC_ACQUIRE);
+  prev = NULL;
+  while (req != NULL) {
+    next = req->done_next;
+    req->done_next = prev;
+    prev = req;
+    req = next;
+  }
+
+  for (req = prev; req != NULL; req = next) {
+    next = req->done_next;
+    loop->active_reqs--;
+
+    if (req->after_work_cb != NULL) {
+      req->after_work_cb(req, 0);
+    }
+  }
+}
+
+
+int uv_queue_work(uv_loop_t* loop,
+                  uv_work_t* req,
+                  uv_work_cb work_cb,
+                  uv_after_work_cb after_work_cb) {
+  struct uv__worker* w;
+  int err;
+
+  if (work_cb == NULL) {
+    return EINVAL;
+  }
+
+  pthread_once(&once, uv__threadpool_init);
+
+  /* The pending requests keep the loop alive, not the handle. */
+  if (loop->work_async.loop == NULL) {
+    err = uv_async_init(loop, &loop->work_async, uv__work_done);
+    if (err) {
+      return err;
+    }
+
+    uv_unref((uv_handle_t*) &loop->work_async);
+    loop->work_async.flags |= UV_HANDLE_INTERNAL;
+  }
+
+  req->loop = loop;
+  req->work_cb = work_cb;
+  req->after_work_cb = after_work_cb;
+  loop->active_reqs++;
+
+  w = &workers[__atomic_fetch_add(&next_worker, 1, __ATOMIC_RELAXED) % nworkers];
+
+  pthread_mutex_lock(&w->mutex);
+  uv__queue_insert_tail(&w->deque, &req->wq);
+  __atomic_store_n(&w->size, w->size + 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&w->mutex);
+
+  __atomic_fetch_add(&npending, 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&nidle, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&idle_mutex);
+    pthread_cond_signal(&idle_cond);
+    pthread_mutex_unlock(&idle_mutex);
+  }
+
+  return 0;
+}
@@ -0,0 +1,359 @@
+#include "uv.h"
+#include "internal.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+
+#define UV__TIMER_MASK ((uint64_t) UV__TIMER_SLOTS - 1)
+#define UV__TIMER_OVERFLOW (UV__TIMER_LEVELS * UV__TIMER_SLOTS)
+
+
+static uint64_t uv__timer_span(unsigned int level) {
+  /* Time covered by one slot of {level}. */
+  return (uint64_t) 1 << (UV__TIMER_BITS * level);
+}
+
+
+static void uv__timer_insert(uv_loop_t* loop, uv_timer_t* handle) {
+  struct uv__queue* slot;
+  struct uv__queue* q;
+  uint64_t expiry;
+  uint64_t diff;
+  unsigned int level;
+  unsigned int index;
+
+  /* Timers already due go in the next slot to run. */
+  expiry = handle->timeout;
+  if (expiry < loop->timer_clock) {
+    expiry = loop->timer_clock;
+  }
+
+  diff = expiry ^ loop->timer_clock;
+  level = 0;
+  if (diff != 0) {
+    level = (63 - __builtin_clzll(diff)) / UV__TIMER_BITS;
+  }
+
+  if (level < UV__TIMER_LEVELS) {
+    index = level * UV__TIMER_SLOTS +
+            ((expiry >> (UV__TIMER_BITS * level)) & UV__TIMER_MASK);
+    loop->timer_bits[level] |= (uint64_t) 1 << (index % UV__TIMER_SLOTS);
+  } else {
+    index = UV__TIMER_OVERFLOW;
+  }
+
+  /* Keep slots in start order so timers due in the same millisecond run in
+   * the order they were started. A new timer has the highest start_id and a
+   * cascaded slot is moved down in order before the clock gets to where new
+   * timers go in the same slots, so the walk stops at the tail. Sorting the
+   * slot when it runs instead costs a pass over timers that aren't in the
+   * cache, see bench_timers.
+   */
+  slot = &loop->timer_wheel[index];
+  q = slot->prev;
+  while (q != slot &&
+         uv__queue_data(q, uv_timer_t, node)->start_id > handle->start_id) {
+    q = q->prev;
+  }
+
+  uv__queue_insert_tail(q->next, &handle->node);
+  handle->slot = index;
+}
+
+
+static void uv__timer_remove(uv_loop_t* loop, uv_timer_t* handle) {
+  unsigned int index;
+
+  uv__queue_remove(&handle->node);
+  uv__queue_init(&handle->node);
+
+  /* handle->slot is stale for timers that were moved to the ready list, the
+   * slot is empty or reused then and this is a no-op.
+   */
+  index = handle->slot;
+  if (index < UV__TIMER_OVERFLOW && uv__queue_empty(&loop->timer_wheel[index])) {
+    loop->timer_bits[index / UV__TIMER_SLOTS] &=
+        ~((uint64_t) 1 << (index % UV__TIMER_SLOTS));
+  }
+}
+
+
+static void uv__timer_take(uv_loop_t* loop, unsigned int index, struct uv__queue* list) {
+  struct uv__queue* slot;
+
+  slot = &loop->timer_wheel[index];
+  if (uv__queue_empty(slot)) {
+    return;
+  }
+
+  uv__queue_add(list, slot);
+  uv__queue_init(slot);
+
+  if (index < UV__TIMER_OVERFLOW) {
+    loop->timer_bits[index / UV__TIMER_SLOTS] &=
+        ~((uint64_t) 1 << (index % UV__TIMER_SLOTS));
+  }
+}
+
+
+static void uv__timer_cascade(uv_loop_t* loop) {
+  struct uv__queue list;
+  struct uv__queue* q;
+  uv_timer_t* handle;
+  unsigned int level;
+  unsigned int index;
+
+  /* Called when timer_clock reaches a multiple of UV__TIMER_SLOTS. Every
+   * level whose slot starts here moves its timers down, top level first so
+   * they can move more than one level.
+   */
+  for (level = UV__TIMER_LEVELS; level > 0; level--) {
+    if ((loop->timer_clock & (uv__timer_span(level) - 1)) != 0) {
+      continue;
+    }
+
+    if (level == UV__TIMER_LEVELS) {
+      index = UV__TIMER_OVERFLOW;
+    } else {
+      index = level * UV__TIMER_SLOTS +
+              ((loop->timer_clock >> (UV__TIMER_BITS * level)) & UV__TIMER_MASK);
+    }
+
+    uv__queue_init(&list);
+    uv__timer_take(loop, index, &list);
+
+    while (!uv__queue_empty(&list)) {
+      q = uv__queue_head(&list);
+      uv__queue_remove(q);
+      handle = uv__queue_data(q, uv_timer_t, node);
+      uv__timer_insert(loop, handle);
+    }
+  }
+}
+
+
+static int uv__timer_next(const uv_loop_t* loop, uint64_t* next) {
+  uint64_t clock;
+  uint64_t bits;
+  unsigned int level;
+  unsigned int index;
+
+  /* Level 0 gives the exact expiry of the next timer, higher levels the time
+   * their next occupied slot is cascaded, which is no later than the expiry
+   * of the timers in it. The slot at timer_clock's own position is always
+   * empty above level 0, it was cascaded when the clock got there.
+   */
+  clock = loop->timer_clock;
+
+  for (level = 0; level < UV__TIMER_LEVELS; level++) {
+    index = (clock >> (UV__TIMER_BITS * level)) & UV__TIMER_MASK;
+    bits = loop->timer_bits[level] & (~(uint64_t) 0 << index);
+    if (bits == 0) {
+      continue;
+    }
+
+    *next = (clock & ~(uv__timer_span(level + 1) - 1)) |
+            ((uint64_t) __builtin_ctzll(bits) << (UV__TIMER_BITS * level));
+    return level;
+  }
+
+  if (!uv__queue_empty(&loop->timer_wheel[UV__TIMER_OVERFLOW])) {
+    *next = (clock | (uv__timer_span(UV__TIMER_LEVELS) - 1)) + 1;
+    return UV__TIMER_LEVELS;
+  }
+
+  return -1;
+}
+
+
+void uv__timers_init(uv_loop_t* loop) {
+  unsigned int i;
+
+  for (i = 0; i < ARRAY_SIZE(loop->timer_wheel); i++) {
+    uv__queue_init(&loop->timer_wheel[i]);
+  }
+
+  for (i = 0; i < ARRAY_SIZE(loop->timer_bits); i++) {
+    loop->timer_bits[i] = 0;
+  }
+
+  loop->timer_clock = loop->time;
+  loop->timer_counter = 0;
+}
+
+
+int uv_timer_init(uv_loop_t* loop, uv_timer_t* handle) {
+  handle->loop = loop;
+  handle->flags = UV_HANDLE_REF;  /* Ref the loop when active. */
+  handle->timer_cb = NULL;
+  handle->timeout = 0;
+  handle->repeat = 0;
+  handle->start_id = 0;
+  handle->slot = UV__TIMER_OVERFLOW;
+  uv__queue_init(&handle->node);
+  return 0;
+}
+
+
+int uv_timer_start(uv_timer_t* handle,
+                   uv_timer_cb cb,
+                   uint64_t timeout,
+                   uint64_t repeat) {
+  uint64_t clamped_timeout;
+
+  if (cb == NULL) {
+    return EINVAL;
+  }
+
+  uv_timer_stop(handle);
+
+  clamped_timeout = handle->loop->time + timeout;
+  if (clamped_timeout < timeout) {
+    clamped_timeout = (uint64_t) -1;
+  }
+
+  handle->timer_cb = cb;
+  handle->timeout = clamped_timeout;
+  handle->repeat = repeat;
+  /* start_id is the second index to be compared in timer order. */
+  handle->start_id = handle->loop->timer_counter++;
+
+  uv__timer_insert(handle->loop, handle);
+
+  handle->flags |= UV_HANDLE_ACTIVE;
+  if ((handle->flags & UV_HANDLE_REF) != 0) {
+    handle->loop->active_handles++;
+  }
+
+  return 0;
+}
+
+
+int uv_timer_stop(uv_timer_t* handle) {
+  if ((handle->flags & UV_HANDLE_ACTIVE) == 0) {
+    return 0;
+  }
+
+  uv__timer_remove(handle->loop, handle);
+
+  handle->flags &= ~UV_HANDLE_ACTIVE;
+  if ((handle->flags & UV_HANDLE_REF) != 0) {
+    handle->loop->active_handles--;
+  }
+
+  return 0;
+}
+
+
+int uv_timer_again(uv_timer_t* handle) {
+  if (handle->timer_cb == NULL) {
+    return EINVAL;
+  }
+
+  if (handle->repeat) {
+    uv_timer_stop(handle);
+    uv_timer_start(handle, handle->timer_cb, handle->repeat, handle->repeat);
+  }
+
+  return 0;
+}
+
+
+void uv_timer_set_repeat(uv_timer_t* handle, uint64_t repeat) {
+  handle->repeat = repeat;
+}
+
+
+uint64_t uv_timer_get_repeat(const uv_timer_t* handle) {
+  return handle->repeat;
+}
+
+
+uint64_t uv_timer_get_due_in(const uv_timer_t* handle) {
+  if (handle->loop->time >= handle->timeout) {
+    return 0;
+  }
+
+  return handle->timeout - handle->loop->time;
+}
+
+
+int uv__next_timeout(const uv_loop_t* loop) {
+  uint64_t next;
+  uint64_t diff;
+
+  if (uv__timer_next(loop, &next) < 0) {
+    return -1;  /* block indefinitely */
+  }
+
+  if (next <= loop->time) {
+    return 0;
+  }
+
+  diff = next - loop->time;
+  if (diff > INT_MAX) {
+    diff = INT_MAX;
+  }
+
+  return (int) diff;
+}
+
+
+void uv__run_timers(uv_loop_t* loop) {
+  struct uv__queue ready;
+  struct uv__queue* q;
+  uv_timer_t* handle;
+  uint64_t next;
+  int level;
+
+  /* Move everything due up to loop->time to a list first, timers that are
+   * started from the callbacks run on the next iteration at the earliest.
+   */
+  uv__queue_init(&ready);
+
+  for (;;) {
+    level = uv__timer_next(loop, &next);
+    if (level < 0 || next > loop->time) {
+      break;
+    }
+
+    if (level == 0) {
+      uv__timer_take(loop, next & UV__TIMER_MASK, &ready);
+
+      /* The clock stays on the current millisecond, timers started for it
+       * from the callbacks go in its slot and make the next poll not block.
+       */
+      if (next == loop->time) {
+        loop->timer_clock = next;
+        break;
+      }
+
+      next++;
+    }
+
+    loop->timer_clock = next;
+    if ((next & UV__TIMER_MASK) == 0) {
+      uv__timer_cascade(loop);
+    }
+  }
+
+  /* Nothing is due before loop->time, skipping the empty slots on the way
+   * doesn't change where the remaining timers belong.
+   */
+  if (loop->timer_clock < loop->time) {
+    loop->timer_clock = loop->time;
+    if ((loop->timer_clock & UV__TIMER_MASK) == 0) {
+      uv__timer_cascade(loop);
+    }
+  }
+
+  while (!uv__queue_empty(&ready)) {
+    q = uv__queue_head(&ready);
+    handle = uv__queue_data(q, uv_timer_t, node);
+
+    uv_timer_stop(handle);
+    uv_timer_again(handle);
+    handle->timer_cb(handle);
+  }
+}
@@ -1,5 +1,6 @@
 #include "uv.h"
 #include "uv-common.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <errno.h>
 
@@ -33,6 +34,13 @@ void uv_unref(uv_handle_t* handle) {
   }
 }
 
+void* uv__malloc(size_t size) {
+  if (size > 0) {
+    return uv__allocator.local_malloc(size);
+  }
+  return NULL;
+}
+
 void uv__free(void* ptr) {
   int saved_errno;
 
@@ -44,6 +52,10 @@ void uv__free(void* ptr) {
   errno = saved_errno;
 }
 
+void* uv__calloc(size_t count, size_t size) {
+  return uv__allocator.local_calloc(count, size);
+}
+
 void* uv__realloc(void* ptr, size_t size) {
   if (size > 0) {
     return uv__allocator.local_realloc(ptr, size);
@@ -63,4 +75,28 @@ void* uv__reallocf(void* ptr, size_t size) {
   }
 
   return newptr;
+}
+
+void* uv__malloc_aligned(size_t align, size_t size) {
+  char* base;
+  char* ptr;
+
+  /* {align} is a power of two. The block uv__malloc() returned is stored
+   * right before the aligned pointer, for uv__free_aligned().
+   */
+  base = uv__malloc(size + align + sizeof(void*));
+  if (base == NULL) {
+    return NULL;
+  }
+
+  ptr = (char*) (((uintptr_t) base + sizeof(void*) + align - 1) & ~(uintptr_t) (align - 1));
+  ((void**) ptr)[-1] = base;
+
+  return ptr;
+}
+
+void uv__free_aligned(void* ptr) {
+  if (ptr != NULL) {
+    uv__free(((void**) ptr)[-1]);
+  }
 }
\ No newline at end of file
@@ -12,13 +12,31 @@ enum {
   UV_HANDLE_CLOSING  = 0x00000001,
   UV_HANDLE_CLOSED   = 0x00000002,
   UV_HANDLE_INTERNAL = 0x00000010,
-  UV_SIGNAL_ONE_SHOT = 0x02000000
+  UV_SIGNAL_BATCHED  = 0x00400000,
+  UV_SIGNAL_ROTATE   = 0x00800000,
+  UV_SIGNAL_BALANCE  = 0x01000000,
+  UV_SIGNAL_ONE_SHOT = 0x02000000,
+  UV_SIGNAL_FD       = 0x04000000,
+  UV_SIGNAL_COALESCE = 0x08000000,
+  UV_SIGNAL_INFO     = 0x10000000,
+  UV_SIGNAL_RECV     = 0x20000000,
+  UV_PROCESS_STATUS_LOST = 0x40000000
+};
+
+enum {
+  UV_LOOP_SIGNALFD = 0x00000001
 };
 
 void uv__io_init(uv__io_t* w, uv__io_cb cb, int fd);
 void uv__io_start(uv_loop_t* loop, uv__io_t* w, unsigned int events);
+void uv__io_stop(uv_loop_t* loop, uv__io_t* w, unsigned int events);
+void uv__io_close(uv_loop_t* loop, uv__io_t* w);
 
 /* Allocator prototypes */
+void* uv__malloc(size_t size);
 void uv__free(void* ptr);
+void* uv__calloc(size_t count, size_t size);
 void* uv__realloc(void* ptr, size_t size);
-void* uv__reallocf(void* ptr, size_t size);
\ No newline at end of file
+void* uv__reallocf(void* ptr, size_t size);
+void* uv__malloc_aligned(size_t align, size_t size);
+void uv__free_aligned(void* ptr);
\ No newline at end of file